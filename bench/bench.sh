@@ -0,0 +1,18 @@
+#!/bin/bash
+
+# Runs the microbenchmarks for several tasklet counts: barrier costs and DPU throughputs depend on NR_TASKLETS
+declare -a TASKLETS=(1 2 4 8 11 12 16 24)
+
+for i in "${!TASKLETS[@]}"; do
+    make clean > /dev/null
+    if ! NR_TASKLETS=${TASKLETS[$i]} make bench > /dev/null; then
+        echo "bench: build failed with NR_TASKLETS=${TASKLETS[$i]}" >&2
+        exit 1
+    fi
+    # Host microbenchmarks do not depend on the tasklets: run them once
+    if [ $i -eq 0 ]; then
+        ./bin/bench_host "$@" 2> /dev/null | grep -a "bench("
+    else
+        ./bin/bench_host -d "$@" 2> /dev/null | grep -a "bench("
+    fi
+done
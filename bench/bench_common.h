@@ -0,0 +1,33 @@
+#ifndef _BENCH_COMMON_H_
+#define _BENCH_COMMON_H_
+
+#include "../support/common.h"
+
+// Microbenchmarks of the DPU primitives the kernels are built on
+typedef struct {
+    enum benches {
+        bench_mram_seq = 0, // mram_read of size_bytes blocks at consecutive addresses
+        bench_mram_random = 1, // mram_read of size_bytes blocks at random 8-byte aligned addresses, as model probes
+        bench_wram = 2, // 32-bit loads from a WRAM buffer of size_bytes, a power of two
+        bench_barrier = 3, // barrier_wait, all tasklets take part
+        nr_benches = 4,
+    } bench;
+    uint32_t size_bytes; // Bytes per mram_read, or of the WRAM buffer
+    uint32_t offset_bytes; // Start of the reads from an address aligned on BENCH_MRAM_ALIGNMENT_B, multiple of 8
+    uint32_t stride_bytes; // Between consecutive reads, 0 for size_bytes
+    uint32_t iterations; // Operations per active tasklet
+    uint32_t active_tasklets; // Tasklets performing operations: 1 for latencies, NR_TASKLETS for throughputs
+} bench_params_t;
+
+typedef struct {
+    uint64_t cycles; // Cycles of the tasklet over all its operations
+    uint64_t ops;
+    uint64_t sink; // Keeps the loads alive
+} bench_result_t;
+
+#define BENCH_MRAM_ALIGNMENT_B 2048
+#define BENCH_MRAM_READ_MAX_B 2048
+#define BENCH_MRAM_REGION_B (1 << 20) // MRAM read by each tasklet
+#define BENCH_WRAM_BUFFER_B 2048 // Per tasklet: 24 tasklets fit in WRAM_HEAP_BUDGET_B
+
+#endif
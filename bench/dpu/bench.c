@@ -0,0 +1,92 @@
+/*
+* Microbenchmarks of DPU primitives: MRAM reads by size, alignment and access pattern, WRAM loads and barriers
+*
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <defs.h>
+#include <mram.h>
+#include <alloc.h>
+#include <perfcounter.h>
+#include <barrier.h>
+
+#include "../bench_common.h"
+
+__host bench_params_t BENCH_ARGUMENTS;
+__host bench_result_t BENCH_RESULTS[NR_TASKLETS];
+
+BARRIER_INIT(my_barrier, NR_TASKLETS);
+
+// Same generator on every tasklet, seeded by its id, so that runs are repeatable
+static inline uint32_t bench_next_random(uint32_t* state) {
+    *state = *state * 1664525 + 1013904223;
+    return *state;
+}
+
+static uint64_t mram_reads(bench_params_t* args, uint8_t* buffer, unsigned int tasklet_id, bool random) {
+    uint32_t base = (uint32_t) DPU_MRAM_HEAP_POINTER;
+    base = (base + BENCH_MRAM_ALIGNMENT_B - 1) / BENCH_MRAM_ALIGNMENT_B * BENCH_MRAM_ALIGNMENT_B;
+    base += tasklet_id * BENCH_MRAM_REGION_B + args->offset_bytes;
+
+    // No division in the loop: it would cost more than the reads on the DPU
+    const uint32_t stride = args->stride_bytes > 0 ? args->stride_bytes : args->size_bytes;
+    const uint32_t end = base + BENCH_MRAM_REGION_B - BENCH_MRAM_ALIGNMENT_B;
+    uint32_t address = base;
+    uint32_t state = tasklet_id + 1;
+    uint64_t sink = 0;
+    for(uint32_t it = 0; it < args->iterations; ++it) {
+        if(random)
+            address = base + ((bench_next_random(&state) >> 8) & (BENCH_MRAM_REGION_B / 2 - 8));
+        mram_read(address, buffer, args->size_bytes);
+        sink += buffer[0];
+
+        if(!random && (address += stride) + args->size_bytes > end)
+            address = base;
+    }
+    return sink;
+}
+
+static uint64_t wram_loads(bench_params_t* args, uint32_t* buffer) {
+    const uint32_t words = args->size_bytes / sizeof(uint32_t);
+    for(uint32_t it = 0; it < words; ++it)
+        buffer[it] = it;
+
+    uint64_t sink = 0;
+    for(uint32_t it = 0; it < args->iterations; ++it)
+        sink += buffer[it & (words - 1)];
+    return sink;
+}
+
+int main(void) {
+    unsigned int tasklet_id = me();
+    bench_params_t args = BENCH_ARGUMENTS;
+    if(tasklet_id == 0) {
+        mem_reset(); // Reset the heap
+        perfcounter_config(COUNT_CYCLES, true);
+    }
+    barrier_wait(&my_barrier);
+
+    uint8_t* buffer = (uint8_t*) mem_alloc(BENCH_WRAM_BUFFER_B);
+    bench_result_t* result = &BENCH_RESULTS[tasklet_id];
+    result->ops = 0;
+    result->sink = 0;
+
+    barrier_wait(&my_barrier);
+    perfcounter_t start = perfcounter_get();
+    if(args.bench == bench_barrier) {
+        for(uint32_t it = 0; it < args.iterations; ++it)
+            barrier_wait(&my_barrier);
+        result->ops = args.iterations;
+    }
+    else if(tasklet_id < args.active_tasklets) {
+        if(args.bench == bench_wram)
+            result->sink = wram_loads(&args, (uint32_t*) buffer);
+        else
+            result->sink = mram_reads(&args, buffer, tasklet_id, args.bench == bench_mram_random);
+        result->ops = args.iterations;
+    }
+    result->cycles = perfcounter_get() - start;
+
+    return 0;
+}
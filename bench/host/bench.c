@@ -0,0 +1,226 @@
+/**
+* @file bench.c
+* @brief Microbenchmarks of the building blocks of the kernels: DPU primitives (on one DPU, simulator or hardware)
+* and host preprocessing. Every measurement is printed as one line:
+*   bench(<dpu|host>), <name>, <parameter>, <tasklets or threads>, <operations>, <value>, <unit>
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <dpu.h>
+
+#include "../bench_common.h"
+#include "../../cbthowen/model.h"
+#include "../../cbthowen/data_loader.h"
+#include "../../cbthowen/batch.h"
+#include "../../cbthowen/parallel.h"
+#include "../../cbthowen/packed_model.h"
+
+#ifndef BENCH_DPU_BINARY
+#define BENCH_DPU_BINARY "./bin/bench_dpu"
+#endif
+
+// MNIST-sized model: 784 pixels of 2 bits, 28 inputs per filter
+#define BENCH_PIXELS 784
+#define BENCH_BITS_PER_INPUT 2
+#define BENCH_FILTER_INPUTS 28
+#define BENCH_FILTER_ENTRIES 1024
+#define BENCH_FILTER_HASHES 2
+#define BENCH_HOST_SAMPLES 4096
+
+// Synthetic model of the MNIST-Large filter shape over the same inputs, for the regression workloads of perf_check.sh
+#define SYNTHETIC_FILTER_INPUTS 49
+#define SYNTHETIC_FILTER_ENTRIES 8192
+#define SYNTHETIC_FILTER_HASHES 4
+#define SYNTHETIC_BLEACH 10
+#define SYNTHETIC_SEED 1
+
+static double now_s() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Runs one benchmark on the DPU and returns the cycles per operation of the slowest active tasklet
+static double dpu_bench_run(struct dpu_set_t dpu_set, bench_params_t args) {
+    DPU_ASSERT(dpu_broadcast_to(dpu_set, "BENCH_ARGUMENTS", 0, &args, sizeof(args), DPU_XFER_DEFAULT));
+    DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
+
+    bench_result_t results[NR_TASKLETS];
+    struct dpu_set_t dpu;
+    DPU_FOREACH(dpu_set, dpu) {
+        DPU_ASSERT(dpu_copy_from(dpu, "BENCH_RESULTS", 0, results, sizeof(results)));
+        break;
+    }
+
+    uint64_t cycles = 0;
+    for(unsigned int it = 0; it < NR_TASKLETS; ++it) {
+        if(results[it].ops > 0 && results[it].cycles > cycles)
+            cycles = results[it].cycles;
+    }
+    return args.iterations > 0 ? (double) cycles / args.iterations : 0.0;
+}
+
+static void dpu_benches(unsigned int iterations) {
+    struct dpu_set_t dpu_set;
+    DPU_ASSERT(dpu_alloc(1, DPU_ALLOC_PROFILE, &dpu_set));
+    DPU_ASSERT(dpu_load(dpu_set, BENCH_DPU_BINARY, NULL));
+
+    const unsigned int tasklet_counts[2] = { 1, NR_TASKLETS };
+    for(unsigned int count_it = 0; count_it < (NR_TASKLETS > 1 ? 2 : 1); ++count_it) {
+        const unsigned int tasklets = tasklet_counts[count_it];
+
+        // Latency and throughput vs. size of the DMA
+        for(uint32_t size = 8; size <= BENCH_MRAM_READ_MAX_B; size *= 2) {
+            bench_params_t args = { .bench = bench_mram_seq, .size_bytes = size, .offset_bytes = 0, .iterations = iterations, .active_tasklets = tasklets };
+            double cycles = dpu_bench_run(dpu_set, args);
+            printf("bench(dpu), mram_read_seq, %u, %u, %u, %.2f, cycles/read\n", size, tasklets, iterations, cycles);
+            printf("bench(dpu), mram_read_seq_bw, %u, %u, %u, %.3f, bytes/cycle\n", size, tasklets, iterations, tasklets * size / cycles);
+        }
+
+        // Alignment of the DMA start, 8-byte reads as the model probes: every read starts at the same offset of a 2 KB line
+        for(uint32_t offset = 0; offset < 64; offset += 8) {
+            bench_params_t args = { .bench = bench_mram_seq, .size_bytes = 8, .offset_bytes = offset, .stride_bytes = BENCH_MRAM_ALIGNMENT_B, .iterations = iterations, .active_tasklets = tasklets };
+            printf("bench(dpu), mram_read_offset, %u, %u, %u, %.2f, cycles/read\n", offset, tasklets, iterations, dpu_bench_run(dpu_set, args));
+        }
+        for(uint32_t size = 8; size <= 64; size *= 2) {
+            bench_params_t args = { .bench = bench_mram_seq, .size_bytes = size, .offset_bytes = BENCH_MRAM_ALIGNMENT_B - 8, .stride_bytes = BENCH_MRAM_ALIGNMENT_B, .iterations = iterations, .active_tasklets = tasklets };
+            printf("bench(dpu), mram_read_straddle, %u, %u, %u, %.2f, cycles/read\n", size, tasklets, iterations, dpu_bench_run(dpu_set, args));
+        }
+
+        // Random probes vs. sequential reads of the same size
+        for(uint32_t size = 8; size <= 64; size *= 2) {
+            bench_params_t args = { .bench = bench_mram_random, .size_bytes = size, .offset_bytes = 0, .iterations = iterations, .active_tasklets = tasklets };
+            printf("bench(dpu), mram_read_random, %u, %u, %u, %.2f, cycles/read\n", size, tasklets, iterations, dpu_bench_run(dpu_set, args));
+        }
+
+        for(uint32_t size = 64; size <= BENCH_WRAM_BUFFER_B; size *= 4) {
+            bench_params_t args = { .bench = bench_wram, .size_bytes = size, .iterations = iterations, .active_tasklets = tasklets };
+            printf("bench(dpu), wram_load, %u, %u, %u, %.2f, cycles/load\n", size, tasklets, iterations, dpu_bench_run(dpu_set, args));
+        }
+    }
+
+    // Barrier cost depends on NR_TASKLETS, fixed at build time
+    bench_params_t args = { .bench = bench_barrier, .iterations = iterations, .active_tasklets = NR_TASKLETS };
+    printf("bench(dpu), barrier, 0, %u, %u, %.2f, cycles/barrier\n", NR_TASKLETS, iterations, dpu_bench_run(dpu_set, args));
+
+    DPU_ASSERT(dpu_free(dpu_set));
+}
+
+static void host_benches(unsigned int repetitions) {
+    const size_t num_inputs = BENCH_PIXELS * BENCH_BITS_PER_INPUT;
+    model_t model;
+    model_init(&model, num_inputs, 10, BENCH_FILTER_INPUTS, BENCH_FILTER_ENTRIES, BENCH_FILTER_HASHES, BENCH_BITS_PER_INPUT, 1);
+
+    bmatrix_t pixels, binarized, reordered;
+    bmatrix_init(&pixels, BENCH_HOST_SAMPLES, BENCH_PIXELS);
+    bmatrix_init(&binarized, BENCH_HOST_SAMPLES, num_inputs);
+    bmatrix_init(&reordered, BENCH_HOST_SAMPLES, num_inputs);
+    for(size_t it = 0; it < BENCH_HOST_SAMPLES * BENCH_PIXELS; ++it)
+        pixels.data[it] = rand() % 256;
+
+    const size_t threads = parallel_num_threads();
+    binarizer_t binarizer;
+    binarizer_init(&binarizer, &pixels, BENCH_PIXELS, BENCH_HOST_SAMPLES, BENCH_BITS_PER_INPUT);
+    double start = now_s();
+    for(unsigned int rep = 0; rep < repetitions; ++rep)
+        binarizer_apply(&binarizer, &binarized, &pixels, BENCH_HOST_SAMPLES);
+    double elapsed = now_s() - start;
+    printf("bench(host), thermometer, %u, %zu, %u, %.1f, samples/s\n", BENCH_BITS_PER_INPUT, threads, repetitions * BENCH_HOST_SAMPLES, repetitions * BENCH_HOST_SAMPLES / elapsed);
+    binarizer_free(&binarizer);
+
+    start = now_s();
+    for(unsigned int rep = 0; rep < repetitions; ++rep)
+        reorder_dataset(&reordered, &binarized, model.input_order, BENCH_HOST_SAMPLES, num_inputs);
+    elapsed = now_s() - start;
+    printf("bench(host), reorder_array, %zu, %zu, %u, %.1f, MB/s\n", num_inputs, threads, repetitions * BENCH_HOST_SAMPLES, repetitions * BENCH_HOST_SAMPLES * num_inputs / elapsed / 1e6);
+
+    // Single hashes, then all the hashes of a sample
+    entry_t sink = 0;
+    const size_t num_hashes = (size_t) repetitions * BENCH_HOST_SAMPLES * model.num_filters;
+    start = now_s();
+    for(unsigned int rep = 0; rep < repetitions; ++rep) {
+        for(size_t sample_it = 0; sample_it < BENCH_HOST_SAMPLES; ++sample_it) {
+            element_t* chunk = MATRIX_AXIS1(reordered, sample_it);
+            for(size_t filter_it = 0; filter_it < model.num_filters; ++filter_it, chunk += model.filter_inputs)
+                sink ^= h3_hash(chunk, MATRIX_AXIS1(model.hash_parameters, filter_it % model.filter_hashes), model.filter_inputs, model.filter_hashes);
+        }
+    }
+    elapsed = now_s() - start;
+    printf("bench(host), h3_hash, %zu, 1, %zu, %.1f, Mhashes/s\n", model.filter_inputs, num_hashes, num_hashes / elapsed / 1e6);
+
+    tensor3d_t hashes;
+    tensor_init(&hashes, BENCH_HOST_SAMPLES, model.num_filters, model.filter_hashes);
+    start = now_s();
+    for(unsigned int rep = 0; rep < repetitions; ++rep)
+        batch_hashing(&hashes, &model, &reordered, BENCH_HOST_SAMPLES);
+    elapsed = now_s() - start;
+    printf("bench(host), batch_hashing, %zu, %zu, %u, %.1f, samples/s\n", model.num_filters * model.filter_hashes, threads, repetitions * BENCH_HOST_SAMPLES, repetitions * BENCH_HOST_SAMPLES / elapsed);
+
+    if(sink == (entry_t) -1) puts(""); // Keeps the hashes alive
+
+    free(hashes.data);
+    free(pixels.data);
+    free(binarized.data);
+    free(reordered.data);
+}
+
+// Counters are drawn in [0; 2 * bleach]: about 7% of the filters respond, as in trained models
+static void write_synthetic_model(const char* path) {
+    srand(SYNTHETIC_SEED); // Same model, hence same cycle counts, on every run
+    model_t model;
+    model_init(&model, BENCH_PIXELS * BENCH_BITS_PER_INPUT, 10, SYNTHETIC_FILTER_INPUTS, SYNTHETIC_FILTER_ENTRIES, SYNTHETIC_FILTER_HASHES, BENCH_BITS_PER_INPUT, SYNTHETIC_BLEACH);
+
+    const size_t num_counters = model.num_classes * model.num_filters * model.filter_entries;
+    for(size_t it = 0; it < num_counters; ++it)
+        model.data.data[it] = rand() % (2 * SYNTHETIC_BLEACH + 1);
+
+    write_packed_model(path, &model);
+    printf("Synthetic model (%zu filters of %zu inputs, %zu entries, %zu hashes) written to %s\n", 
+        model.num_filters, model.filter_inputs, model.filter_entries, model.filter_hashes, path);
+}
+
+static void usage() {
+    fprintf(stderr,
+        "\nUsage:  ./bench_host [options]"
+        "\n"
+        "\n    -h        help"
+        "\n    -n <N>    operations per tasklet of each DPU microbenchmark (default=4096)"
+        "\n    -r <R>    repetitions of each host microbenchmark over 4096 samples (default=8)"
+        "\n    -d        DPU microbenchmarks only"
+        "\n    -c        host microbenchmarks only"
+        "\n    -g <G>    write the synthetic large model used by perf_check.sh at path G and exit"
+        "\n");
+}
+
+int main(int argc, char** argv) {
+    unsigned int iterations = 4096;
+    unsigned int repetitions = 8;
+    bool run_dpu = true, run_host = true;
+
+    int opt;
+    while((opt = getopt(argc, argv, "hn:r:dcg:")) >= 0) {
+        switch(opt) {
+        case 'g': write_synthetic_model(optarg); return 0;
+        case 'n': iterations = atoi(optarg); break;
+        case 'r': repetitions = atoi(optarg); break;
+        case 'd': run_host = false; break;
+        case 'c': run_dpu = false; break;
+        default:
+            usage();
+            exit(opt == 'h' ? 0 : 1);
+        }
+    }
+
+    if(run_dpu)
+        dpu_benches(iterations);
+    if(run_host)
+        host_benches(repetitions);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#define _GNU_SOURCE
+#include "arena.h"
+
+#include <sys/mman.h>
+
+// Explicit huge pages are 2 MB on the hosts of the UPMEM servers
+#define ARENA_HUGE_PAGE_SIZE (2ul << 20)
+
+int arena_init(arena_t* arena, size_t capacity, int flags) {
+    arena->base = NULL;
+    arena->capacity = ARENA_SIZE(capacity > 0 ? capacity : 1);
+    arena->used = 0;
+    arena->flags = 0;
+
+    const int populate = (flags & ARENA_PREFAULT) ? MAP_POPULATE : 0;
+    void* base = MAP_FAILED;
+
+    if(flags & ARENA_HUGE_PAGES) {
+        arena->mapped_bytes = (arena->capacity + ARENA_HUGE_PAGE_SIZE - 1) / ARENA_HUGE_PAGE_SIZE * ARENA_HUGE_PAGE_SIZE;
+        base = mmap(NULL, arena->mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate, -1, 0);
+        if(base != MAP_FAILED)
+            arena->flags |= ARENA_HUGE_PAGES;
+    }
+
+    if(base == MAP_FAILED) {
+        arena->mapped_bytes = arena->capacity;
+        // Transparent huge pages must be requested before the pages are faulted in
+        base = mmap(NULL, arena->mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | ((flags & ARENA_HUGE_PAGES) ? 0 : populate), -1, 0);
+        if(base == MAP_FAILED) return 0;
+
+        if(flags & ARENA_HUGE_PAGES) {
+            if(madvise(base, arena->mapped_bytes, MADV_HUGEPAGE) == 0)
+                arena->flags |= ARENA_HUGE_PAGES;
+            if(flags & ARENA_PREFAULT)
+                madvise(base, arena->mapped_bytes, MADV_WILLNEED);
+        }
+    }
+
+    arena->flags |= flags & ARENA_PREFAULT;
+    arena->base = (unsigned char*) base;
+    return 1;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    size = ARENA_SIZE(size);
+    assert(arena->used + size <= arena->capacity && "Arena exhausted!");
+
+    void* block = arena->base + arena->used;
+    arena->used += size;
+    return block;
+}
+
+size_t arena_mark(arena_t* arena) {
+    return arena->used;
+}
+
+void arena_release(arena_t* arena, size_t mark) {
+    assert(mark <= arena->used);
+    arena->used = mark;
+}
+
+void arena_reset(arena_t* arena) {
+    arena->used = 0;
+}
+
+void arena_free(arena_t* arena) {
+    if(arena->base != NULL)
+        munmap(arena->base, arena->mapped_bytes);
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->used = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+// Every allocation starts on a cache line
+#define ARENA_ALIGNMENT 64
+#define ARENA_SIZE(bytes) ((((bytes) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT) * ARENA_ALIGNMENT)
+
+#define ARENA_HUGE_PAGES 0x1 // Back the arena with huge pages (explicit if available, transparent otherwise)
+#define ARENA_PREFAULT 0x2 // Fault every page in when the arena is created rather than on first touch
+
+/**
+ * Bump allocator over a single anonymous mapping. Allocations are not zeroed (fresh pages are),
+ * are never freed individually, and are recycled all at once with arena_reset or down to a mark with arena_release.
+ */
+typedef struct {
+    unsigned char* base;
+    size_t capacity;
+    size_t used;
+    size_t mapped_bytes;
+    int flags; // Flags effectively applied
+} arena_t;
+
+/**
+ * @brief Maps an arena of at least capacity bytes
+ *
+ * @param arena
+ * @param capacity
+ * @param flags ARENA_HUGE_PAGES and/or ARENA_PREFAULT
+ * @return 1 on success, 0 if the memory could not be mapped
+ */
+int arena_init(arena_t* arena, size_t capacity, int flags);
+
+// 64-byte aligned block of size bytes, asserts that the arena is large enough
+void* arena_alloc(arena_t* arena, size_t size);
+
+// Current fill level, to release every allocation made after it with arena_release
+size_t arena_mark(arena_t* arena);
+void arena_release(arena_t* arena, size_t mark);
+void arena_reset(arena_t* arena);
+
+void arena_free(arena_t* arena);
+
+#endif
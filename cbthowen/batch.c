@@ -1,16 +1,90 @@
 #include "batch.h"
+#include "parallel.h"
 
-void batch_hashing(tensor3d_t* resulting_hashes, model_t* model, bmatrix_t* input_batch, size_t batch_size) {
-    matrix_t tmp_hashes = { .stride = model->filter_hashes, .data=NULL };
-    // init_matrix(&tmp_hashes, model->num_filters, model->filter_hashes);
-    for(size_t it = 0; it < batch_size; ++it) {
-        tmp_hashes.data = TENSOR3D_AXIS1(*resulting_hashes, it);
-        perform_hashing(tmp_hashes, model, MATRIX_AXIS1(*input_batch, it));
+typedef struct {
+    tensor3d_t* resulting_hashes;
+    model_t* model;
+    bmatrix_t* input_batch;
+} hashing_ctx_t;
+
+static void hashing_worker(void* arg, size_t thread_it, size_t begin, size_t end) {
+    (void) thread_it;
+    hashing_ctx_t* ctx = (hashing_ctx_t*) arg;
+    matrix_t tmp_hashes = { .stride = ctx->model->filter_hashes, .data=NULL };
+    for(size_t it = begin; it < end; ++it) {
+        tmp_hashes.data = TENSOR3D_AXIS1(*ctx->resulting_hashes, it);
+        perform_hashing(tmp_hashes, ctx->model, MATRIX_AXIS1(*ctx->input_batch, it));
     }
 }
 
+void batch_hashing(tensor3d_t* resulting_hashes, model_t* model, bmatrix_t* input_batch, size_t batch_size) {
+    size_t num_threads = parallel_num_threads();
+    if(num_threads > batch_size) num_threads = batch_size > 0 ? batch_size : 1;
+
+    hashing_ctx_t ctx = { .resulting_hashes = resulting_hashes, .model = model, .input_batch = input_batch };
+    parallel_for(batch_size, num_threads, hashing_worker, &ctx);
+}
+
 void batch_prediction(size_t* results, model_t* model, bmatrix_t* input_batch, size_t batch_size) {
     for(size_t it = 0; it < batch_size; ++it) {
         results[it] = model_predict2(model, MATRIX_AXIS1(*input_batch, it));
     }
 }
+
+void batch_prediction_hashed(size_t* results, model_t* model, tensor3d_t* hashes, size_t batch_size) {
+    matrix_t sample_hashes = { .stride = model->filter_hashes, .data=NULL };
+    for(size_t it = 0; it < batch_size; ++it) {
+        sample_hashes.data = TENSOR3D_AXIS1(*hashes, it);
+        results[it] = model_predict_backend(model, &sample_hashes);
+    }
+}
+
+void batch_prediction_hashed_early_exit(size_t* results, model_t* model, tensor3d_t* hashes, size_t batch_size, size_t* probes) {
+    matrix_t sample_hashes = { .stride = model->filter_hashes, .data=NULL };
+    for(size_t it = 0; it < batch_size; ++it) {
+        sample_hashes.data = TENSOR3D_AXIS1(*hashes, it);
+        results[it] = model_predict_backend_early_exit(model, &sample_hashes, probes);
+    }
+}
+
+void batch_bleach_sweep(uint64_t* correct, model_t* model, tensor3d_t* hashes, unsigned char* labels, size_t batch_size, size_t num_bleach_values) {
+    size_t* minima = (size_t*) malloc(model->num_classes * num_bleach_values * sizeof(size_t)); // (#Classes, num_bleach_values)
+    entry_t popcounts[model->num_classes];
+
+    for(size_t it = 0; it < batch_size; ++it) {
+        for(size_t minimum_it = 0; minimum_it < model->num_classes * num_bleach_values; ++minimum_it)
+            minima[minimum_it] = 0;
+
+        for(size_t filter_it = 0; filter_it < model->num_filters; ++filter_it) {
+            entry_t* filter_hashes = TENSOR3D_AXIS2(*hashes, it, filter_it);
+            for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it) {
+                entry_t resp = filter_reduction(TENSOR3D_AXIS2(model->data, discr_it, filter_it), filter_hashes, model->filter_hashes);
+                ++minima[discr_it * num_bleach_values + (resp < num_bleach_values - 1 ? resp : num_bleach_values - 1)];
+            }
+        }
+
+        for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it)
+            popcounts[discr_it] = 0;
+        for(size_t bleach_it = num_bleach_values; bleach_it-- > 0;) {
+            size_t response_index = 0;
+            entry_t max_popcount = 0;
+            for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it) {
+                popcounts[discr_it] += minima[discr_it * num_bleach_values + bleach_it];
+                if(popcounts[discr_it] >= max_popcount) {
+                    max_popcount = popcounts[discr_it];
+                    response_index = discr_it;
+                }
+            }
+            correct[bleach_it] += (response_index == labels[it]);
+        }
+    }
+
+    free(minima);
+}
+
+void batch_confusion(uint64_t* confusion, size_t* predictions, unsigned char* labels, size_t batch_size, size_t num_classes) {
+    for(size_t it = 0; it < batch_size; ++it) {
+        if(labels[it] < num_classes)
+            ++confusion[labels[it] * num_classes + predictions[it]];
+    }
+}
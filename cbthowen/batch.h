@@ -20,5 +20,46 @@ void batch_hashing(tensor3d_t* resulting_hashes, model_t* model, bmatrix_t* inpu
 
 void batch_prediction(size_t* results, model_t* model, bmatrix_t* input_batch, size_t batch_size);
 
+/**
+ * @brief Performs inference on an already hashed batch (skips reordering and hashing)
+ * 
+ * @param results of shape (batch_size)
+ * @param model 
+ * @param hashes of shape (batch_size, #num_filters, #filter_hashes)
+ * @param batch_size 
+ */
+void batch_prediction_hashed(size_t* results, model_t* model, tensor3d_t* hashes, size_t batch_size);
+
+/**
+ * @brief Same as batch_prediction_hashed, using early exits (see model_predict_backend_early_exit)
+ * 
+ * @param probes Incremented by the number of entries actually probed. Can be NULL.
+ */
+void batch_prediction_hashed_early_exit(size_t* results, model_t* model, tensor3d_t* hashes, size_t batch_size, size_t* probes);
+
+/**
+ * @brief Counts the samples of a labeled, hashed batch that are correctly classified at each bleach in [0; num_bleach_values),
+ * in a single pass: the histogram of the filter minima of a class gives its popcount at every bleach.
+ * 
+ * @param correct of shape (num_bleach_values), incremented
+ * @param model 
+ * @param hashes of shape (batch_size, #num_filters, #filter_hashes)
+ * @param labels of shape (batch_size)
+ * @param batch_size 
+ * @param num_bleach_values 
+ */
+void batch_bleach_sweep(uint64_t* correct, model_t* model, tensor3d_t* hashes, unsigned char* labels, size_t batch_size, size_t num_bleach_values);
+
+/**
+ * @brief Counts the (label, prediction) pairs of a labeled batch. Labels outside [0; num_classes) are ignored.
+ * 
+ * @param confusion of shape (num_classes, num_classes), incremented
+ * @param predictions of shape (batch_size)
+ * @param labels of shape (batch_size)
+ * @param batch_size 
+ * @param num_classes 
+ */
+void batch_confusion(uint64_t* confusion, size_t* predictions, unsigned char* labels, size_t batch_size, size_t num_classes);
+
 
 #endif 
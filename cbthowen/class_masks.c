@@ -0,0 +1,80 @@
+#include "class_masks.h"
+
+// Bit planes of the popcounts: enough for 2^32 filters
+#define CLASS_MASKS_MAX_PLANES 32
+
+static inline uint32_t class_mask_at(model_t* model, size_t index) {
+    if(model->mask_bytes == 1) return ((uint8_t*) model->class_masks)[index];
+    if(model->mask_bytes == 2) return ((uint16_t*) model->class_masks)[index];
+    return ((uint32_t*) model->class_masks)[index];
+}
+
+void model_build_class_masks(model_t* model) {
+    assert(model->num_classes <= CLASS_MASKS_MAX_CLASSES && "Too many classes for class masks!");
+
+    model->mask_bytes = model->num_classes <= 8 ? 1 : model->num_classes <= 16 ? 2 : 4;
+    const size_t num_masks = model->num_filters * model->filter_entries;
+
+    free(model->class_masks);
+    model->class_masks = calloc(num_masks, model->mask_bytes);
+    for(size_t filter_it = 0; filter_it < model->num_filters; ++filter_it) {
+        for(size_t entry_it = 0; entry_it < model->filter_entries; ++entry_it) {
+            uint32_t mask = 0;
+            for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it)
+                mask |= (uint32_t) (*TENSOR3D(model->data, discr_it, filter_it, entry_it) >= model->bleach) << discr_it;
+
+            const size_t index = filter_it * model->filter_entries + entry_it;
+            if(model->mask_bytes == 1) ((uint8_t*) model->class_masks)[index] = mask;
+            else if(model->mask_bytes == 2) ((uint16_t*) model->class_masks)[index] = mask;
+            else ((uint32_t*) model->class_masks)[index] = mask;
+        }
+    }
+}
+
+size_t class_masks_size_bytes(model_t* model) {
+    return model->num_filters * model->filter_entries * model->mask_bytes;
+}
+
+size_t model_predict_backend_class_masks(model_t* model, matrix_t* hashes_buffer) {
+    uint32_t planes[CLASS_MASKS_MAX_PLANES];
+    size_t num_planes = 0;
+
+    for(size_t filter_it = 0; filter_it < model->num_filters; ++filter_it) {
+        entry_t* hashes = MATRIX_AXIS1(*hashes_buffer, filter_it);
+        uint32_t responses = (uint32_t) -1;
+        for(size_t hash_it = 0; hash_it < model->filter_hashes; ++hash_it)
+            responses &= class_mask_at(model, filter_it * model->filter_entries + hashes[hash_it]);
+
+        // Ripple-carry addition of one bit per class
+        for(size_t plane_it = 0; responses != 0; ++plane_it) {
+            if(plane_it == num_planes) planes[num_planes++] = 0;
+            uint32_t carry = planes[plane_it] & responses;
+            planes[plane_it] ^= responses;
+            responses = carry;
+        }
+    }
+
+    // Pick the argmax of popcounts, ties go to the last discriminator
+    size_t response_index = 0;
+    entry_t max_popcount = 0;
+    for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it) {
+        entry_t popcount = 0;
+        for(size_t plane_it = 0; plane_it < num_planes; ++plane_it)
+            popcount |= ((planes[plane_it] >> discr_it) & 1) << plane_it;
+
+        if(popcount >= max_popcount) {
+            max_popcount = popcount;
+            response_index = discr_it;
+        }
+    }
+
+    return response_index;
+}
+
+void batch_prediction_hashed_class_masks(size_t* results, model_t* model, tensor3d_t* hashes, size_t batch_size) {
+    matrix_t sample_hashes = { .stride = model->filter_hashes, .data=NULL };
+    for(size_t it = 0; it < batch_size; ++it) {
+        sample_hashes.data = TENSOR3D_AXIS1(*hashes, it);
+        results[it] = model_predict_backend_class_masks(model, &sample_hashes);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef CLASS_MASKS_H
+#define CLASS_MASKS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "model.h"
+
+#define CLASS_MASKS_MAX_CLASSES 32
+
+/**
+ * @brief Derives the inference-only layout of the model for its bleach: for each (filter, entry), the mask of
+ * the classes whose counter reaches the bleach, on 1, 2 or 4 bytes depending on the number of classes.
+ * The response of a filter for all classes is then the AND of the masks of its hashes.
+ *
+ * @param model An initialized model with at most CLASS_MASKS_MAX_CLASSES classes
+ */
+void model_build_class_masks(model_t* model);
+
+/**
+ * @brief Size of class_masks, of shape (#Filters, #Entries)
+ */
+size_t class_masks_size_bytes(model_t* model);
+
+/**
+ * @brief Same prediction as model_predict_backend from the class masks (see model_build_class_masks).
+ * The responses of the filters are summed in bit-sliced counters: bit c of plane k is bit k of the popcount of class c.
+ *
+ * @param model A model with class masks
+ * @param hashes_buffer
+ * @return size_t
+ */
+size_t model_predict_backend_class_masks(model_t* model, matrix_t* hashes_buffer);
+
+/**
+ * @brief Same as batch_prediction_hashed, from the class masks
+ *
+ * @param results of shape (batch_size)
+ * @param model
+ * @param hashes of shape (batch_size, #num_filters, #filter_hashes)
+ * @param batch_size
+ */
+void batch_prediction_hashed_class_masks(size_t* results, model_t* model, tensor3d_t* hashes, size_t batch_size);
+
+#endif
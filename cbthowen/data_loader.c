@@ -62,6 +62,20 @@ void load_infimnist(bmatrix_t* patterns, unsigned char* labels, size_t num_sampl
     load_mnist_file(patterns, labels, INFIMNIST_PATTERNS, INFIMNIST_LABELS, num_samples);
 }
 
+void load_patterns(bmatrix_t* patterns, char* image_path, size_t num_samples) {
+    uint32_t info_buffer[MNIST_LEN_INFO_IMAGE];
+
+    read_mnist_file(image_path, num_samples, MNIST_IM_SIZE, MNIST_LEN_INFO_IMAGE, patterns->data, info_buffer);
+    assert(info_buffer[0] == 2051);
+}
+
+void load_labels(unsigned char* labels, char* label_path, size_t num_samples) {
+    uint32_t info_buffer[MNIST_LEN_INFO_LABEL];
+
+    read_mnist_file(label_path, num_samples, 1, MNIST_LEN_INFO_LABEL, labels, info_buffer);
+    assert(info_buffer[0] == 2049);
+}
+
 #define BYTE_TO_BINARY_PATTERN "%c%c%c%c%c%c%c%c"
 #define BYTE_TO_BINARY(byte)  \
   ((byte) & 0x80 ? '1' : '0'), \
@@ -136,12 +150,17 @@ unsigned char thermometer_encode(unsigned char val, double mean, double std, siz
     return encodings[skew_index];
 }
 
-void binarize_sample2(bmatrix_t* result, bmatrix_t* dataset, size_t sample_it, size_t num_bits, double* mean, double* variance, double* skews, unsigned char* encodings) { 
+// Binarizes one sample with the per-pixel level table. The result is laid out bit-major: (num_bits, sample_size)
+static void binarize_sample_table(unsigned char* result, unsigned char* sample, unsigned char* levels, size_t sample_size, size_t num_bits) {
+    unsigned char codes[sample_size];
+    for(size_t offset_it = 0; offset_it < sample_size; ++offset_it)
+        codes[offset_it] = levels[offset_it * BINARIZER_LEVELS + sample[offset_it]];
+
+    // Branch-free and contiguous: vectorized by the compiler
     for(size_t bit_it = 0; bit_it < num_bits; ++bit_it) {
-        for(size_t offset_it = 0; offset_it < dataset->stride; ++offset_it) {
-            char packed_encoding = thermometer_encode(*MATRIX(*dataset, sample_it, offset_it), mean[offset_it], sqrt(variance[offset_it]), num_bits, skews, encodings);
-            *MATRIX(*result, sample_it, bit_it*dataset->stride + offset_it) = (packed_encoding >> bit_it) & 0x1;
-        }
+        unsigned char* bit_plane = result + bit_it * sample_size;
+        for(size_t offset_it = 0; offset_it < sample_size; ++offset_it)
+            bit_plane[offset_it] = (codes[offset_it] >> bit_it) & 0x1;
     }
 }
 
@@ -157,27 +176,145 @@ void binarize_sample(bmatrix_t* result, bmatrix_t* dataset, size_t sample_it, si
     }
 }
 
-void binarize_matrix(bmatrix_t* result, bmatrix_t* dataset, size_t sample_size, size_t num_samples, size_t num_bits) {
-    double skews[num_bits - 1];
-    for(size_t it = 1; it < num_bits; ++it) {
-        skews[it] = gauss_inv((((double) it)) / (((double) num_bits)));
-        // printf("skew: %lf\n", skews[it]);
-    }
+static void binarizer_alloc(binarizer_t* binarizer, size_t sample_size, size_t num_bits) {
+    assert(num_bits > 0 && num_bits <= 8);
+
+    binarizer->sample_size = sample_size;
+    binarizer->num_bits = num_bits;
+    binarizer->mean = calloc(sample_size, sizeof(*binarizer->mean));
+    binarizer->variance = calloc(sample_size, sizeof(*binarizer->variance));
+    binarizer->levels = calloc(sample_size * BINARIZER_LEVELS, sizeof(*binarizer->levels));
+}
 
-    unsigned char encodings[num_bits];
-    for(size_t it = 0; it <= num_bits; ++it) {
+// Fills the level table from the mean and variance of each pixel
+static void binarizer_fill_levels(binarizer_t* binarizer) {
+    const size_t num_bits = binarizer->num_bits;
+
+    // Thresholds at the (num_bits + 1)-quantiles of the standard normal distribution
+    double skews[num_bits];
+    for(size_t it = 0; it < num_bits; ++it)
+        skews[it] = gauss_inv(((double) (it + 1)) / ((double) (num_bits + 1)));
+
+    unsigned char encodings[num_bits + 1];
+    for(size_t it = 0; it <= num_bits; ++it)
         encodings[it] = (((unsigned char) 0xff) << it) & (((unsigned char) 0xff) >> (8 - num_bits));
-        // printf("encoding: "BYTE_TO_BINARY_PATTERN"\n", BYTE_TO_BINARY(encodings[it]));
+
+    for(size_t offset_it = 0; offset_it < binarizer->sample_size; ++offset_it) {
+        double std = sqrt(binarizer->variance[offset_it]);
+        for(size_t value = 0; value < BINARIZER_LEVELS; ++value)
+            binarizer->levels[offset_it * BINARIZER_LEVELS + value] = thermometer_encode(value, binarizer->mean[offset_it], std, num_bits, skews, encodings);
     }
+}
 
-    double mean[sample_size];
-    double variance[sample_size];
+void binarizer_init(binarizer_t* binarizer, bmatrix_t* dataset, size_t sample_size, size_t num_samples, size_t num_bits) {
+    binarizer_alloc(binarizer, sample_size, num_bits);
+    bmatrix_moments(binarizer->mean, binarizer->variance, dataset, sample_size, num_samples);
+    binarizer_fill_levels(binarizer);
+}
 
-    bmatrix_mean(mean, dataset, sample_size, num_samples);
-    bmatrix_variance(variance, dataset, sample_size, num_samples, mean);
+int binarizer_init_file(binarizer_t* binarizer, char* image_path, size_t sample_size, size_t num_bits) {
+    FILE* fd = fopen(image_path, "r");
+    if(fd == NULL) {
+        printf("Not able to read the file at path %s\n", image_path);
+        return 0;
+    }
 
-    for(size_t sample_it = 0; sample_it < num_samples; ++sample_it)
-        binarize_sample2(result, dataset, sample_it, num_bits, mean, variance, skews, encodings);
+    uint32_t info[MNIST_LEN_INFO_IMAGE];
+    if(fread(info, sizeof(uint32_t), MNIST_LEN_INFO_IMAGE, fd) != MNIST_LEN_INFO_IMAGE) {
+        printf("Truncated image file %s\n", image_path);
+        fclose(fd);
+        return 0;
+    }
+    for(size_t it = 0; it < MNIST_LEN_INFO_IMAGE; ++it) reverse_bytes(info + it);
+    assert(info[0] == 2051);
+    const size_t num_samples = info[1];
+
+    binarizer_alloc(binarizer, sample_size, num_bits);
+
+    // The moments of each chunk are merged into those of the file, so the whole file is never in memory
+    bmatrix_t chunk;
+    bmatrix_init(&chunk, BINARIZER_FILE_CHUNK_SAMPLES, sample_size);
+    double* chunk_mean = calloc(sample_size, sizeof(*chunk_mean));
+    double* chunk_m2 = calloc(sample_size, sizeof(*chunk_m2));
+    double* m2 = calloc(sample_size, sizeof(*m2));
+
+    size_t count = 0;
+    while(count < num_samples) {
+        size_t chunk_samples = num_samples - count < BINARIZER_FILE_CHUNK_SAMPLES ? num_samples - count : BINARIZER_FILE_CHUNK_SAMPLES;
+        chunk_samples = fread(chunk.data, sample_size, chunk_samples, fd);
+        if(chunk_samples == 0) break;
+
+        bmatrix_moments(chunk_mean, chunk_m2, &chunk, sample_size, chunk_samples);
+        for(size_t offset_it = 0; offset_it < sample_size; ++offset_it)
+            chunk_m2[offset_it] = chunk_samples > 1 ? chunk_m2[offset_it] * (chunk_samples - 1) : 0; // Variance back to squared deviations
+
+        moments_merge(count, binarizer->mean, m2, chunk_samples, chunk_mean, chunk_m2, sample_size);
+        count += chunk_samples;
+    }
+    fclose(fd);
+
+    for(size_t offset_it = 0; offset_it < sample_size; ++offset_it)
+        binarizer->variance[offset_it] = count > 1 ? m2[offset_it] / (count - 1) : 0;
+
+    free(chunk.data);
+    free(chunk_mean);
+    free(chunk_m2);
+    free(m2);
+
+    if(count < num_samples) {
+        printf("Truncated image file %s\n", image_path);
+        binarizer_free(binarizer);
+        return 0;
+    }
+
+    binarizer_fill_levels(binarizer);
+    return 1;
+}
+
+typedef struct {
+    binarizer_t* binarizer;
+    bmatrix_t* result;
+    bmatrix_t* dataset;
+} binarize_ctx_t;
+
+static void binarize_worker(void* arg, size_t thread_it, size_t begin, size_t end) {
+    (void) thread_it;
+    binarize_ctx_t* ctx = (binarize_ctx_t*) arg;
+    for(size_t sample_it = begin; sample_it < end; ++sample_it)
+        binarize_sample_table(MATRIX_AXIS1(*ctx->result, sample_it), MATRIX_AXIS1(*ctx->dataset, sample_it), ctx->binarizer->levels, ctx->binarizer->sample_size, ctx->binarizer->num_bits);
+}
+
+void binarizer_apply(binarizer_t* binarizer, bmatrix_t* result, bmatrix_t* dataset, size_t num_samples) {
+    size_t num_threads = parallel_num_threads();
+    if(num_threads > num_samples) num_threads = num_samples > 0 ? num_samples : 1;
+
+    binarize_ctx_t ctx = { .binarizer = binarizer, .result = result, .dataset = dataset };
+    parallel_for(num_samples, num_threads, binarize_worker, &ctx);
+}
+
+void binarizer_thresholds(binarizer_t* binarizer, int16_t* thresholds) {
+    // The encoding is a thermometer: bit b of a pixel stays set up to some value and is clear above it
+    for(size_t bit_it = 0; bit_it < binarizer->num_bits; ++bit_it) {
+        for(size_t offset_it = 0; offset_it < binarizer->sample_size; ++offset_it) {
+            int16_t threshold = -1;
+            for(size_t value = 0; value < BINARIZER_LEVELS; ++value)
+                if((binarizer->levels[offset_it * BINARIZER_LEVELS + value] >> bit_it) & 0x1) threshold = value;
+            thresholds[bit_it * binarizer->sample_size + offset_it] = threshold;
+        }
+    }
+}
+
+void binarizer_free(binarizer_t* binarizer) {
+    free(binarizer->mean);
+    free(binarizer->variance);
+    free(binarizer->levels);
+}
+
+void binarize_matrix(bmatrix_t* result, bmatrix_t* dataset, size_t sample_size, size_t num_samples, size_t num_bits) {
+    binarizer_t binarizer;
+    binarizer_init(&binarizer, dataset, sample_size, num_samples, num_bits);
+    binarizer_apply(&binarizer, result, dataset, num_samples);
+    binarizer_free(&binarizer);
 }
 
 void fill_input_random(unsigned char* input, size_t input_length) {
@@ -186,9 +323,25 @@ void fill_input_random(unsigned char* input, size_t input_length) {
     }
 }
 
+typedef struct {
+    bmatrix_t* result;
+    bmatrix_t* dataset;
+    size_t* order;
+    size_t num_elements;
+} reorder_ctx_t;
+
+static void reorder_worker(void* arg, size_t thread_it, size_t begin, size_t end) {
+    (void) thread_it;
+    reorder_ctx_t* ctx = (reorder_ctx_t*) arg;
+    for(size_t it = begin; it < end; ++it)
+        reorder_array(MATRIX_AXIS1(*ctx->result, it), MATRIX_AXIS1(*ctx->dataset, it), ctx->order, ctx->num_elements);
+}
+
 void reorder_dataset(bmatrix_t* result, bmatrix_t* dataset, size_t* order, size_t num_samples, size_t num_elements) {
-    for(size_t it = 0; it < num_samples; ++it) {
-        reorder_array(MATRIX_AXIS1(*result, it), MATRIX_AXIS1(*dataset, it), order, num_elements);
-    }
+    size_t num_threads = parallel_num_threads();
+    if(num_threads > num_samples) num_threads = num_samples > 0 ? num_samples : 1;
+
+    reorder_ctx_t ctx = { .result = result, .dataset = dataset, .order = order, .num_elements = num_elements };
+    parallel_for(num_samples, num_threads, reorder_worker, &ctx);
 }
 
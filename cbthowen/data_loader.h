@@ -10,6 +10,7 @@
 
 #include "tensor.h"
 #include "model.h"
+#include "parallel.h"
 
 // set appropriate path for data
 #define MNIST_TRAIN_IMAGE "./data/train-images-idx3-ubyte"
@@ -32,6 +33,31 @@ void load_mnist_file(bmatrix_t* patterns, unsigned char* labels, char* image_pat
 void load_mnist_train(bmatrix_t* patterns, unsigned char* labels, size_t num_samples);
 void load_mnist_test(bmatrix_t* patterns, unsigned char* labels, size_t num_samples);
 void load_infimnist(bmatrix_t* patterns, unsigned char* labels, size_t num_samples);
+// Reads the first num_samples images of an idx3 image file, one 8-bit pixel per byte
+void load_patterns(bmatrix_t* patterns, char* image_path, size_t num_samples);
+// Reads the first num_samples labels of an idx1 label file
+void load_labels(unsigned char* labels, char* label_path, size_t num_samples);
+
+#define BINARIZER_LEVELS 256 // one entry per 8-bit pixel value
+#define BINARIZER_FILE_CHUNK_SAMPLES 65536
+
+// Thermometer binarization derived from the statistics of a dataset
+typedef struct {
+    size_t sample_size;
+    size_t num_bits;
+    double* mean; // Of shape (sample_size,)
+    double* variance; // Of shape (sample_size,)
+    unsigned char* levels; // Of shape (sample_size, BINARIZER_LEVELS): packed encoding of each value of each pixel
+} binarizer_t;
+
+void binarizer_init(binarizer_t* binarizer, bmatrix_t* dataset, size_t sample_size, size_t num_samples, size_t num_bits);
+// Statistics of a whole idx3 image file, read in chunks of BINARIZER_FILE_CHUNK_SAMPLES samples: the thresholds do not
+// depend on the samples being evaluated. Returns 0 if the file is not readable
+int binarizer_init_file(binarizer_t* binarizer, char* image_path, size_t sample_size, size_t num_bits);
+void binarizer_apply(binarizer_t* binarizer, bmatrix_t* result, bmatrix_t* dataset, size_t num_samples);
+// Largest pixel value that sets each bit, -1 if none does. Of shape (num_bits, sample_size), like the binarized samples
+void binarizer_thresholds(binarizer_t* binarizer, int16_t* thresholds);
+void binarizer_free(binarizer_t* binarizer);
 
 void binarize_matrix(bmatrix_t* result, bmatrix_t* dataset, size_t sample_size, size_t num_samples, size_t num_bits);
 
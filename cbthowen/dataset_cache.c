@@ -0,0 +1,148 @@
+#include "dataset_cache.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// Number of samples moved per fread/fwrite call
+#define DATASET_CACHE_CHUNK_SAMPLES 4096
+
+static uint64_t fnv1a(uint64_t digest, const void* data, size_t len) {
+    const unsigned char* bytes = (const unsigned char*) data;
+    for(size_t it = 0; it < len; ++it) {
+        digest ^= bytes[it];
+        digest *= FNV_PRIME;
+    }
+    return digest;
+}
+
+static uint64_t fnv1a_u64(uint64_t digest, uint64_t value) {
+    return fnv1a(digest, &value, sizeof(value));
+}
+
+uint64_t dataset_cache_key(model_t* model, const char* dataset_path) {
+    uint64_t digest = FNV_OFFSET_BASIS;
+
+    digest = fnv1a_u64(digest, model->num_inputs_total);
+    digest = fnv1a_u64(digest, model->num_filters);
+    digest = fnv1a_u64(digest, model->filter_inputs);
+    digest = fnv1a_u64(digest, model->filter_hashes);
+    digest = fnv1a_u64(digest, model->filter_entries);
+
+    digest = fnv1a(digest, model->input_order, model->num_inputs_total * sizeof(*model->input_order));
+    digest = fnv1a(digest, model->hash_parameters.data, model->filter_hashes * model->hash_parameters.stride * sizeof(entry_t));
+
+    digest = fnv1a(digest, dataset_path, strlen(dataset_path));
+    struct stat st;
+    if(stat(dataset_path, &st) == 0) {
+        digest = fnv1a_u64(digest, (uint64_t) st.st_size);
+        digest = fnv1a_u64(digest, (uint64_t) st.st_mtime);
+    }
+
+    return digest;
+}
+
+void dataset_cache_path(char* path, size_t path_len, const char* cache_dir, uint64_t key) {
+    snprintf(path, path_len, "%s/%016llx.cache", cache_dir, (unsigned long long) key);
+}
+
+static size_t packed_sample_bytes(model_t* model) {
+    return (model->num_inputs_total + 7) / 8;
+}
+
+static void pack_sample(unsigned char* packed, element_t* sample, size_t len) {
+    memset(packed, 0, (len + 7) / 8);
+    for(size_t it = 0; it < len; ++it)
+        packed[it / 8] |= (sample[it] & 0x1) << (it % 8);
+}
+
+static void unpack_sample(element_t* sample, unsigned char* packed, size_t len) {
+    for(size_t it = 0; it < len; ++it)
+        sample[it] = (packed[it / 8] >> (it % 8)) & 0x1;
+}
+
+int dataset_cache_load(const char* path, uint64_t key, model_t* model, tensor3d_t* hashes, bmatrix_t* reordered, size_t num_samples) {
+    FILE* fd = fopen(path, "rb");
+    if(fd == NULL) return 0;
+
+    dataset_cache_header_t header;
+    int valid = fread(&header, sizeof(header), 1, fd) == 1
+        && header.magic == DATASET_CACHE_MAGIC
+        && header.key == key
+        && header.num_samples >= num_samples
+        && header.num_filters == model->num_filters
+        && header.filter_hashes == model->filter_hashes
+        && (reordered == NULL || header.packed_sample_bytes == packed_sample_bytes(model));
+
+    // Hashes of a prefix of samples are contiguous both on disk and in the tensor
+    const size_t hashes_per_sample = model->num_filters * model->filter_hashes;
+    for(size_t sample_it = 0; valid && sample_it < num_samples; sample_it += DATASET_CACHE_CHUNK_SAMPLES) {
+        size_t chunk = num_samples - sample_it < DATASET_CACHE_CHUNK_SAMPLES ? num_samples - sample_it : DATASET_CACHE_CHUNK_SAMPLES;
+        valid = fread(TENSOR3D_AXIS1(*hashes, sample_it), hashes_per_sample * sizeof(entry_t), chunk, fd) == chunk;
+    }
+
+    if(valid && reordered != NULL) {
+        const size_t packed_bytes = header.packed_sample_bytes;
+        long section = sizeof(header) + header.num_samples * hashes_per_sample * sizeof(entry_t);
+        valid = fseek(fd, section, SEEK_SET) == 0;
+
+        unsigned char* packed = malloc(packed_bytes * DATASET_CACHE_CHUNK_SAMPLES);
+        for(size_t sample_it = 0; valid && sample_it < num_samples; sample_it += DATASET_CACHE_CHUNK_SAMPLES) {
+            size_t chunk = num_samples - sample_it < DATASET_CACHE_CHUNK_SAMPLES ? num_samples - sample_it : DATASET_CACHE_CHUNK_SAMPLES;
+            valid = fread(packed, packed_bytes, chunk, fd) == chunk;
+            for(size_t it = 0; valid && it < chunk; ++it)
+                unpack_sample(MATRIX_AXIS1(*reordered, sample_it + it), packed + it * packed_bytes, model->num_inputs_total);
+        }
+        free(packed);
+    }
+
+    fclose(fd);
+    return valid;
+}
+
+int dataset_cache_store(const char* path, uint64_t key, model_t* model, tensor3d_t* hashes, bmatrix_t* reordered, size_t num_samples) {
+    char tmp_path[DATASET_CACHE_PATH_LEN];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE* fd = fopen(tmp_path, "wb");
+    if(fd == NULL) {
+        printf("Not able to write the cache file at path %s\n", tmp_path);
+        return 0;
+    }
+
+    dataset_cache_header_t header = {
+        .magic = DATASET_CACHE_MAGIC,
+        .key = key,
+        .num_samples = num_samples,
+        .num_filters = model->num_filters,
+        .filter_hashes = model->filter_hashes,
+        .packed_sample_bytes = reordered != NULL ? packed_sample_bytes(model) : 0
+    };
+    int valid = fwrite(&header, sizeof(header), 1, fd) == 1;
+
+    const size_t hashes_per_sample = model->num_filters * model->filter_hashes;
+    for(size_t sample_it = 0; valid && sample_it < num_samples; sample_it += DATASET_CACHE_CHUNK_SAMPLES) {
+        size_t chunk = num_samples - sample_it < DATASET_CACHE_CHUNK_SAMPLES ? num_samples - sample_it : DATASET_CACHE_CHUNK_SAMPLES;
+        valid = fwrite(TENSOR3D_AXIS1(*hashes, sample_it), hashes_per_sample * sizeof(entry_t), chunk, fd) == chunk;
+    }
+
+    if(valid && reordered != NULL) {
+        const size_t packed_bytes = header.packed_sample_bytes;
+        unsigned char* packed = malloc(packed_bytes * DATASET_CACHE_CHUNK_SAMPLES);
+        for(size_t sample_it = 0; valid && sample_it < num_samples; sample_it += DATASET_CACHE_CHUNK_SAMPLES) {
+            size_t chunk = num_samples - sample_it < DATASET_CACHE_CHUNK_SAMPLES ? num_samples - sample_it : DATASET_CACHE_CHUNK_SAMPLES;
+            for(size_t it = 0; it < chunk; ++it)
+                pack_sample(packed + it * packed_bytes, MATRIX_AXIS1(*reordered, sample_it + it), model->num_inputs_total);
+            valid = fwrite(packed, packed_bytes, chunk, fd) == chunk;
+        }
+        free(packed);
+    }
+
+    valid = (fclose(fd) == 0) && valid;
+    if(valid) valid = rename(tmp_path, path) == 0;
+    if(!valid) remove(tmp_path);
+
+    return valid;
+}
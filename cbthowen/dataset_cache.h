@@ -0,0 +1,76 @@
+#ifndef DATASET_CACHE_H
+#define DATASET_CACHE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "tensor.h"
+#include "model.h"
+
+#define DATASET_CACHE_MAGIC 0x3148534143544257 // "WBTCASH1" in little endian
+#define DATASET_CACHE_PATH_LEN 4096
+
+/**
+ * Layout of a cache file:
+ *  (1) a dataset_cache_header_t
+ *  (2) the hashes of all samples, of shape (#Samples, #Filters, #FilterHashes), entry_t each
+ *  (3) optionally, the reordered inputs bit-packed, of shape (#Samples, ceil(#Inputs / 8))
+ * Sections are stored back to back so that a prefix of samples can be streamed straight into a transfer buffer.
+ */
+typedef struct {
+    uint64_t magic;
+    uint64_t key;
+
+    uint64_t num_samples;
+    uint64_t num_filters;
+    uint64_t filter_hashes;
+
+    uint64_t packed_sample_bytes; // 0 when the reordered inputs are not stored
+} dataset_cache_header_t;
+
+/**
+ * @brief Digest identifying the preprocessed dataset: covers the model input order, the hash parameters,
+ * the model shape and the dataset identity (path, size and modification time of the file).
+ * The number of samples is not part of the key: a cache of N samples serves any request of at most N samples.
+ *
+ * @param model
+ * @param dataset_path
+ * @return uint64_t
+ */
+uint64_t dataset_cache_key(model_t* model, const char* dataset_path);
+
+/**
+ * @brief Builds the path of the cache file for the given key inside cache_dir
+ */
+void dataset_cache_path(char* path, size_t path_len, const char* cache_dir, uint64_t key);
+
+/**
+ * @brief Streams the hashes (and optionally the reordered inputs) of the first num_samples samples from a cache file.
+ *
+ * @param path
+ * @param key The key the file should have been stored with
+ * @param model
+ * @param hashes Tensor of shape (num_samples, #Filters, #FilterHashes), allocated by the caller
+ * @param reordered Matrix of shape (num_samples, #Inputs), allocated by the caller. Can be NULL.
+ * @param num_samples
+ * @return 1 on a hit, 0 if the file is missing, stale, too small or truncated
+ */
+int dataset_cache_load(const char* path, uint64_t key, model_t* model, tensor3d_t* hashes, bmatrix_t* reordered, size_t num_samples);
+
+/**
+ * @brief Writes the hashes (and optionally the reordered inputs) of num_samples samples to a cache file.
+ * The file is written next to its final location and renamed once complete, so readers never observe a partial cache.
+ *
+ * @param path
+ * @param key
+ * @param model
+ * @param hashes Tensor of shape (num_samples, #Filters, #FilterHashes)
+ * @param reordered Matrix of shape (num_samples, #Inputs). Can be NULL.
+ * @param num_samples
+ * @return 1 on success, 0 otherwise
+ */
+int dataset_cache_store(const char* path, uint64_t key, model_t* model, tensor3d_t* hashes, bmatrix_t* reordered, size_t num_samples);
+
+#endif
@@ -0,0 +1,37 @@
+#include "dataset_stream.h"
+
+int dataset_stream_open(dataset_stream_t* stream, const char* path) {
+    stream->fd = fopen(path, "rb");
+    if(stream->fd == NULL) {
+        printf("Not able to read the file at path %s\n", path);
+        return 0;
+    }
+
+    stream->next_sample = 0;
+    if(fread(&stream->num_samples_total, sizeof(size_t), 1, stream->fd) != 1
+        || fread(&stream->sample_size, sizeof(size_t), 1, stream->fd) != 1) {
+        printf("Not able to read the header of %s\n", path);
+        fclose(stream->fd);
+        stream->fd = NULL;
+        return 0;
+    }
+
+    return 1;
+}
+
+size_t dataset_stream_read(dataset_stream_t* stream, bmatrix_t* window, size_t max_samples) {
+    size_t remaining = stream->num_samples_total - stream->next_sample;
+    size_t num_samples = remaining < max_samples ? remaining : max_samples;
+    if(num_samples == 0) return 0;
+
+    assert(window->stride == stream->sample_size);
+    size_t read = fread(window->data, stream->sample_size, num_samples, stream->fd);
+    stream->next_sample += read;
+
+    return read;
+}
+
+void dataset_stream_close(dataset_stream_t* stream) {
+    if(stream->fd != NULL) fclose(stream->fd);
+    stream->fd = NULL;
+}
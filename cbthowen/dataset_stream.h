@@ -0,0 +1,39 @@
+#ifndef DATASET_STREAM_H
+#define DATASET_STREAM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "tensor.h"
+
+/**
+ * Sequential reader of a binarized dataset file, one window of samples at a time.
+ * The file layout is the one read_dataset_partial consumes: the number of samples and the sample size 
+ * (both size_t), followed by the samples stored row-major, one byte per element.
+ */
+typedef struct {
+    FILE* fd;
+    size_t num_samples_total;
+    size_t sample_size;
+    size_t next_sample;
+} dataset_stream_t;
+
+/**
+ * @brief Opens a dataset file and reads its header
+ * 
+ * @return 1 on success, 0 otherwise
+ */
+int dataset_stream_open(dataset_stream_t* stream, const char* path);
+
+/**
+ * @brief Reads the next window of at most max_samples samples into window (of shape (max_samples, sample_size))
+ * 
+ * @return The number of samples read, 0 once the whole dataset has been read
+ */
+size_t dataset_stream_read(dataset_stream_t* stream, bmatrix_t* window, size_t max_samples);
+
+void dataset_stream_close(dataset_stream_t* stream);
+
+#endif
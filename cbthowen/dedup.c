@@ -0,0 +1,157 @@
+#include "dedup.h"
+
+#include <string.h>
+
+// Finalizer of splitmix64, spreads the bits of a chunk (and its filter) over the table
+static inline uint64_t dedup_mix(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return key;
+}
+
+void batch_dedup_init(batch_dedup_t* dedup, model_t* model, size_t max_rows, size_t max_segment_samples) {
+    assert(model->filter_inputs <= 64 && "Filter chunks must fit in 64 bits!");
+
+    dedup->num_filters = model->num_filters;
+    dedup->filter_hashes = model->filter_hashes;
+    dedup->record_words = ((1 + model->filter_hashes + 1) / 2) * 2;
+    dedup->index_words = ((model->num_filters + 1) / 2) * 2;
+
+    dedup->num_records = 0;
+    dedup->records_capacity = max_segment_samples * model->num_filters;
+    dedup->records = (uint32_t*) malloc(dedup->records_capacity * dedup->record_words * sizeof(uint32_t));
+
+    dedup->index = (uint32_t*) calloc(max_rows * dedup->index_words, sizeof(uint32_t));
+    dedup->segment_first_record = (size_t*) calloc(max_rows, sizeof(size_t));
+
+    // At most half full
+    dedup->table_size = 1;
+    while(dedup->table_size < 2 * max_segment_samples * model->num_filters)
+        dedup->table_size <<= 1;
+    dedup->table_chunks = (uint64_t*) malloc(dedup->table_size * sizeof(uint64_t));
+    dedup->table_records = (uint32_t*) malloc(dedup->table_size * sizeof(uint32_t));
+    dedup->table_stamps = (uint32_t*) calloc(dedup->table_size, sizeof(uint32_t));
+    dedup->stamp = 0;
+}
+
+void batch_dedup_free(batch_dedup_t* dedup) {
+    free(dedup->records);
+    free(dedup->index);
+    free(dedup->segment_first_record);
+    free(dedup->table_chunks);
+    free(dedup->table_records);
+    free(dedup->table_stamps);
+}
+
+void batch_dedup_reset(batch_dedup_t* dedup) {
+    dedup->num_records = 0;
+}
+
+static void dedup_reserve_records(batch_dedup_t* dedup, size_t count) {
+    if(count <= dedup->records_capacity) return;
+    while(dedup->records_capacity < count)
+        dedup->records_capacity *= 2;
+    dedup->records = (uint32_t*) realloc(dedup->records, dedup->records_capacity * dedup->record_words * sizeof(uint32_t));
+}
+
+size_t batch_dedup_segment(batch_dedup_t* dedup, model_t* model, bmatrix_t* input_batch, size_t first_sample, size_t num_samples) {
+    const size_t first_record = dedup->num_records;
+    assert(num_samples * model->num_filters * 2 <= dedup->table_size && "Segment larger than the table!");
+    dedup_reserve_records(dedup, first_record + num_samples * model->num_filters);
+
+    // A new stamp empties the table, the slots are only cleared when the stamp wraps around
+    if(++dedup->stamp == 0) {
+        memset(dedup->table_stamps, 0, dedup->table_size * sizeof(uint32_t));
+        dedup->stamp = 1;
+    }
+    const size_t table_mask = dedup->table_size - 1;
+
+    for(size_t sample_it = first_sample; sample_it < first_sample + num_samples; ++sample_it) {
+        element_t* chunk = MATRIX_AXIS1(*input_batch, sample_it);
+        uint32_t* index_row = dedup->index + sample_it * dedup->index_words;
+        dedup->segment_first_record[sample_it] = first_record;
+
+        for(size_t filter_it = 0; filter_it < model->num_filters; ++filter_it, chunk += model->filter_inputs) {
+            uint64_t bits = 0;
+            for(size_t input_it = 0; input_it < model->filter_inputs; ++input_it)
+                bits |= (uint64_t) (chunk[input_it] != 0) << input_it;
+
+            size_t slot = dedup_mix(bits ^ ((uint64_t) filter_it << 56) ^ filter_it) & table_mask;
+            for(;;) {
+                if(dedup->table_stamps[slot] != dedup->stamp) {
+                    // First occurrence in the segment: hash the chunk into a new record
+                    uint32_t* record = dedup->records + dedup->num_records * dedup->record_words;
+                    record[0] = filter_it;
+                    for(size_t hash_it = 0; hash_it < model->filter_hashes; ++hash_it) {
+                        entry_t* parameters = MATRIX_AXIS1(model->hash_parameters, hash_it);
+                        entry_t hash = 0;
+                        for(uint64_t remaining = bits; remaining != 0; remaining &= remaining - 1)
+                            hash ^= parameters[__builtin_ctzll(remaining)];
+                        record[1 + hash_it] = hash;
+                    }
+                    for(size_t word_it = 1 + model->filter_hashes; word_it < dedup->record_words; ++word_it)
+                        record[word_it] = 0;
+
+                    dedup->table_stamps[slot] = dedup->stamp;
+                    dedup->table_chunks[slot] = bits;
+                    dedup->table_records[slot] = dedup->num_records - first_record;
+                    ++dedup->num_records;
+                    break;
+                }
+                if(dedup->table_chunks[slot] == bits && dedup->records[(first_record + dedup->table_records[slot]) * dedup->record_words] == filter_it)
+                    break;
+                slot = (slot + 1) & table_mask;
+            }
+            index_row[filter_it] = dedup->table_records[slot];
+        }
+    }
+
+    return first_record;
+}
+
+void batch_dedup_pad_records(batch_dedup_t* dedup, size_t count) {
+    dedup_reserve_records(dedup, dedup->num_records + count);
+}
+
+void batch_prediction_dedup(size_t* results, model_t* model, batch_dedup_t* dedup, size_t batch_size) {
+    assert(model->num_classes <= 32 && "Class masks hold at most 32 classes!");
+
+    uint32_t* masks = (uint32_t*) malloc(dedup->num_records * sizeof(uint32_t));
+    for(size_t record_it = 0; record_it < dedup->num_records; ++record_it) {
+        uint32_t* record = dedup->records + record_it * dedup->record_words;
+        uint32_t mask = 0;
+        for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it) {
+            entry_t resp = filter_reduction(TENSOR3D_AXIS2(model->data, discr_it, record[0]), record + 1, model->filter_hashes);
+            mask |= (uint32_t) (resp >= model->bleach) << discr_it;
+        }
+        masks[record_it] = mask;
+    }
+
+    entry_t popcounts[model->num_classes];
+    for(size_t sample_it = 0; sample_it < batch_size; ++sample_it) {
+        uint32_t* index_row = dedup->index + sample_it * dedup->index_words;
+        uint32_t* segment_masks = masks + dedup->segment_first_record[sample_it];
+
+        for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it)
+            popcounts[discr_it] = 0;
+        for(size_t filter_it = 0; filter_it < model->num_filters; ++filter_it)
+            for(uint32_t mask = segment_masks[index_row[filter_it]]; mask != 0; mask &= mask - 1)
+                ++popcounts[__builtin_ctz(mask)];
+
+        // Ties go to the last discriminator, as in model_predict_backend
+        size_t response_index = 0;
+        entry_t max_popcount = 0;
+        for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it) {
+            if(popcounts[discr_it] >= max_popcount) {
+                max_popcount = popcounts[discr_it];
+                response_index = discr_it;
+            }
+        }
+        results[sample_it] = response_index;
+    }
+
+    free(masks);
+}
@@ -0,0 +1,82 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "model.h"
+
+/**
+ * Batch-level deduplication of filter chunks. Many chunks repeat across the samples of a batch (background
+ * regions of MNIST), so each distinct (filter, chunk) pair is hashed once into a record, and samples store
+ * the index of the record of each of their filters. A record is then evaluated once for all classes.
+ *
+ * The batch is split in segments (one per DPU): records are only shared within a segment, so that the records
+ * of a segment and its index rows can be sent to a DPU on their own.
+ */
+typedef struct {
+    size_t num_filters;
+    size_t filter_hashes;
+    size_t record_words; // Words of a record: filter id, then its hashes, padded to 8 bytes
+    size_t index_words; // Words of an index row: one record index per filter, padded to 8 bytes
+
+    uint32_t* records; // (#Records, record_words)
+    size_t num_records;
+    size_t records_capacity;
+
+    uint32_t* index; // (max_rows, index_words), record indices relative to the first record of the segment
+    size_t* segment_first_record; // (max_rows) first record of the segment of each sample
+
+    // Open addressing table of the segment being built, slots of other segments are told apart by their stamp
+    uint64_t* table_chunks;
+    uint32_t* table_records;
+    uint32_t* table_stamps;
+    size_t table_size;
+    uint32_t stamp;
+} batch_dedup_t;
+
+/**
+ * @brief Allocates the index of max_rows samples and a table sized for segments of at most max_segment_samples
+ *
+ * @param dedup
+ * @param model Its filters must have at most 64 inputs
+ * @param max_rows
+ * @param max_segment_samples
+ */
+void batch_dedup_init(batch_dedup_t* dedup, model_t* model, size_t max_rows, size_t max_segment_samples);
+void batch_dedup_free(batch_dedup_t* dedup);
+
+// Drops the records of the previous batch
+void batch_dedup_reset(batch_dedup_t* dedup);
+
+/**
+ * @brief Deduplicates the samples [first_sample; first_sample + num_samples) of input_batch into a new segment
+ *
+ * @param dedup
+ * @param model
+ * @param input_batch of shape (batch_size, #elements_per_sample), reordered
+ * @param first_sample
+ * @param num_samples
+ * @return size_t The first record of the segment, its records run up to dedup->num_records
+ */
+size_t batch_dedup_segment(batch_dedup_t* dedup, model_t* model, bmatrix_t* input_batch, size_t first_sample, size_t num_samples);
+
+/**
+ * @brief Ensures that records can be read up to `count` records past the last one (transfers of the last segments)
+ */
+void batch_dedup_pad_records(batch_dedup_t* dedup, size_t count);
+
+/**
+ * @brief Performs inference on a deduplicated batch: each record is evaluated once into a mask of the
+ * responding classes, then each sample sums the masks of its filters
+ *
+ * @param results of shape (batch_size)
+ * @param model Its number of classes must not exceed 32
+ * @param dedup
+ * @param batch_size
+ */
+void batch_prediction_dedup(size_t* results, model_t* model, batch_dedup_t* dedup, size_t batch_size);
+
+#endif
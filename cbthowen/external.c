@@ -28,6 +28,11 @@ uint64_t predict(unsigned char* input) {
     return pred;
 }
 
+void save_packed_model(char* path, size_t counter_bytes) {
+    model_pack_counters(&global_model, counter_bytes);
+    write_packed_model(path, &global_model);
+}
+
 void test_write_read() {
     char* model_path = "/Users/xavier/Desktop/Cours/Ici/WNN/Cbthowen/model.dat";
     write_model(model_path, &global_model);
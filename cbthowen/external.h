@@ -8,6 +8,7 @@
 
 #include "model.h"
 #include "data_manager.h"
+#include "packed_model.h"
 
 extern model_t global_model;
 
@@ -21,4 +22,6 @@ void fill_model(uint64_t* data, size_t size);
 
 uint64_t predict(unsigned char* input);
 
+void save_packed_model(char* path, size_t counter_bytes);
+
 void test_write_read();
@@ -1,7 +1,6 @@
 #include "model.h"
 
-element_t* reorder_buffer;
-matrix_t hashes_buffer; // used in predict2
+#include <string.h>
 
 void reorder_array(element_t* result, element_t* input, size_t* order, size_t len) {
     for(size_t it = 0; it < len; ++it)
@@ -44,24 +43,45 @@ void model_init_buffers(model_t* model){
     randomize_input_order(model->input_order, model->num_inputs_total);
 
     tensor_init(&model->data, model->num_classes, model->num_filters, model->filter_entries);
+    model->counter_bytes = sizeof(entry_t);
+    model->packed_data = NULL;
+    model->mask_bytes = 0;
+    model->class_masks = NULL;
+    model->sparse_words_per_filter = 0;
+    model->sparse_words = NULL;
+    model->sparse_values = NULL;
+    model->sparse_num_values = 0;
     
     matrix_init(&model->hash_parameters, model->filter_hashes, model->filter_inputs);
     generate_h3_values(&model->hash_parameters, model->filter_hashes, model->filter_inputs, model->filter_entries);
 
-    reorder_buffer = calloc(model->num_inputs_total, sizeof(*reorder_buffer));
+    model->reorder_buffer = calloc(model->num_inputs_total, sizeof(*model->reorder_buffer));
 
     // used in predict2
-    matrix_init(&hashes_buffer, model->num_filters, model->filter_hashes);
+    matrix_init(&model->hashes_buffer, model->num_filters, model->filter_hashes);
+}
+
+void model_free(model_t* model) {
+    free(model->input_order);
+    free(model->hash_parameters.data);
+    free(model->data.data);
+    free(model->packed_data);
+    free(model->class_masks);
+    free(model->sparse_words);
+    free(model->sparse_values);
+    free(model->reorder_buffer);
+    free(model->hashes_buffer.data);
+    memset(model, 0, sizeof(*model));
 }
 
 // assumes input is already zero padded
 size_t model_predict(model_t* model, element_t* input) {
-    reorder_array(reorder_buffer, input, model->input_order, model->num_inputs_total);
+    reorder_array(model->reorder_buffer, input, model->input_order, model->num_inputs_total);
 
     size_t response_index = 0;
     uint64_t max_response = 0;
     for(size_t it = 0; it < model->num_classes; ++it) {
-        uint64_t resp = discriminator_predict(model, it, reorder_buffer);
+        uint64_t resp = discriminator_predict(model, it, model->reorder_buffer);
         if(resp >= max_response) {
             max_response = resp;
             response_index = it;
@@ -72,9 +92,9 @@ size_t model_predict(model_t* model, element_t* input) {
 }
 
 void model_train(model_t* model, element_t* input, uint64_t target) {    
-    reorder_array(reorder_buffer, input, model->input_order, model->num_inputs_total);
+    reorder_array(model->reorder_buffer, input, model->input_order, model->num_inputs_total);
 
-    discriminator_train(model, target, reorder_buffer);
+    discriminator_train(model, target, model->reorder_buffer);
 }
 
 uint64_t discriminator_predict(model_t* model, size_t discriminator_index, element_t* input) {
@@ -172,12 +192,12 @@ void perform_hashing(matrix_t resulting_hashes, model_t* model, element_t* input
 
 size_t model_predict2(model_t* model, element_t* input) {
     // Reorder
-    reorder_array(reorder_buffer, input, model->input_order, model->num_inputs_total);
+    reorder_array(model->reorder_buffer, input, model->input_order, model->num_inputs_total);
 
     // Hash
-    perform_hashing(hashes_buffer, model, reorder_buffer);
+    perform_hashing(model->hashes_buffer, model, model->reorder_buffer);
 
-    return model_predict_backend(model, &hashes_buffer);
+    return model_predict_backend(model, &model->hashes_buffer);
 }
 
 size_t model_predict_backend(model_t* model, matrix_t* hashes_buffer) {
@@ -205,3 +225,39 @@ size_t model_predict_backend(model_t* model, matrix_t* hashes_buffer) {
 
     return response_index;
 }
+
+size_t model_predict_backend_early_exit(model_t* model, matrix_t* hashes_buffer, size_t* probes) {
+    size_t num_probes = 0;
+    size_t response_index = 0;
+    entry_t max_popcount = 0;
+
+    for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it) {
+        entry_t popcount = 0;
+        for(size_t filter_it = 0; filter_it < model->num_filters; ++filter_it) {
+            // Ties go to the last discriminator, so it is only hopeless below the leader
+            if(popcount + (model->num_filters - filter_it) < max_popcount)
+                break;
+
+            entry_t* filter = TENSOR3D_AXIS2(model->data, discr_it, filter_it);
+            entry_t* hashes = MATRIX_AXIS1(*hashes_buffer, filter_it);
+            entry_t resp = 1;
+            for(size_t hash_it = 0; hash_it < model->filter_hashes; ++hash_it) {
+                num_probes++;
+                if(filter[hashes[hash_it]] < model->bleach) {
+                    resp = 0;
+                    break;
+                }
+            }
+            popcount += resp;
+        }
+
+        if(popcount >= max_popcount) {
+            max_popcount = popcount;
+            response_index = discr_it;
+        }
+    }
+
+    if(probes != NULL) *probes += num_probes;
+
+    return response_index;
+}
@@ -11,9 +11,6 @@
 
 typedef unsigned char element_t;
 
-extern element_t* reorder_buffer;
-extern matrix_t hashes_buffer;
-
 typedef struct {
     size_t pad_zeros;
     size_t num_inputs_total;
@@ -31,6 +28,21 @@ typedef struct {
     unsigned char bleach;
 
     tensor3d_t data; // of shape (#Discriminators, #Filters, #Entries)
+
+    size_t counter_bytes; // storage width of the counters in packed_data (1, 2 or 4 bytes)
+    void* packed_data; // saturated copy of data with counter_bytes per counter, NULL when the model is not packed
+
+    size_t mask_bytes; // storage width of the masks in class_masks (1, 2 or 4 bytes)
+    void* class_masks; // of shape (#Filters, #Entries): bit c is set if the counter of class c reaches the bleach, NULL until built
+
+    size_t sparse_words_per_filter; // Occupancy words of a filter in sparse_words
+    uint64_t* sparse_words; // of shape (#Discriminators, #Filters, #Words): occupancy bitmap (low half) and rank of the first nonzero counter (high half), NULL until built
+    void* sparse_values; // Nonzero counters in rank order, counter_bytes each
+    size_t sparse_num_values;
+
+    // Scratch of model_predict, model_train and model_predict2, sized for this model
+    element_t* reorder_buffer; // of shape (#Inputs)
+    matrix_t hashes_buffer; // of shape (#Filters, #FilterHashes)
 } model_t;
 
 void generate_h3_values(matrix_t* values, size_t num_hashes, size_t num_inputs, size_t num_entries);
@@ -55,6 +67,12 @@ void model_init(model_t* model, size_t num_inputs, size_t num_classes, size_t fi
  */
 void model_init_buffers(model_t* model);
 
+/**
+ * @brief Frees every buffer of the model (counters in all layouts, input order, hash parameters and scratch buffers)
+ * and clears it. An empty model is left as is.
+ */
+void model_free(model_t* model);
+
 /**
  * @brief Performs an inference with the provided input. Hashing is delegated to filters.
  * 
@@ -84,6 +102,17 @@ size_t model_predict2(model_t* model, element_t* input);
  */
 size_t model_predict_backend(model_t* model, matrix_t* hashes_buffer);
 
+/**
+ * @brief Same prediction as model_predict_backend, with early exits: a filter stops probing at the first 
+ * entry below the bleach, and a discriminator stops once its popcount cannot reach the current leader.
+ * 
+ * @param model 
+ * @param hashes_buffer 
+ * @param probes Incremented by the number of entries actually probed. Can be NULL.
+ * @return size_t 
+ */
+size_t model_predict_backend_early_exit(model_t* model, matrix_t* hashes_buffer, size_t* probes);
+
 
 /**
  * @brief Performs a training step (updating filter values) for all discriminators
@@ -124,6 +153,17 @@ void discriminator_train(model_t* model, size_t discriminator_index, element_t*
  */
 int filter_check_membership(model_t* model, size_t discriminator_index, size_t filter_index, element_t* input);
 
+/**
+ * @brief H3 hash of a boolean vector: XOR of the parameters of its set inputs
+ * 
+ * @param input Boolean vector of shape (#inputs)
+ * @param parameters Vector of shape (#inputs)
+ * @param num_inputs 
+ * @param num_hashes Unused
+ * @return entry_t 
+ */
+entry_t h3_hash(element_t* input, entry_t* parameters, size_t num_inputs, size_t num_hashes);
+
 /**
  * @brief Performs MIN reduction of the given filter for the given number of hashes
  * 
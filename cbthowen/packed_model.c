@@ -0,0 +1,148 @@
+#include "packed_model.h"
+
+#include <string.h>
+
+static size_t model_num_counters(model_t* model) {
+    return model->num_classes * model->num_filters * model->filter_entries;
+}
+
+void model_pack_counters(model_t* model, size_t counter_bytes) {
+    assert(counter_bytes == 1 || counter_bytes == 2 || counter_bytes == 4);
+
+    const size_t num_counters = model_num_counters(model);
+    const entry_t saturation = counter_bytes == 4 ? (entry_t) -1 : (((entry_t) 1) << (8 * counter_bytes)) - 1;
+
+    free(model->packed_data);
+    model->packed_data = NULL;
+    model->counter_bytes = counter_bytes;
+    if(counter_bytes == sizeof(entry_t)) return;
+
+    model->packed_data = calloc(num_counters, counter_bytes);
+    for(size_t it = 0; it < num_counters; ++it) {
+        entry_t counter = model->data.data[it] < saturation ? model->data.data[it] : saturation;
+        if(counter_bytes == 1) ((uint8_t*) model->packed_data)[it] = counter;
+        else ((uint16_t*) model->packed_data)[it] = counter;
+    }
+}
+
+void* model_counters(model_t* model) {
+    return model->packed_data != NULL ? model->packed_data : (void*) model->data.data;
+}
+
+size_t model_counters_size_bytes(model_t* model) {
+    size_t counter_bytes = model->packed_data != NULL ? model->counter_bytes : sizeof(entry_t);
+    return model_num_counters(model) * counter_bytes;
+}
+
+int is_packed_model_file(const char* path) {
+    FILE* fd = fopen(path, "rb");
+    if(fd == NULL) return 0;
+
+    uint64_t magic = 0;
+    int packed = fread(&magic, sizeof(magic), 1, fd) == 1 && magic == PACKED_MODEL_MAGIC;
+    fclose(fd);
+
+    return packed;
+}
+
+void write_packed_model(const char* path, model_t* model) {
+    FILE* fd = fopen(path, "wb");
+    if(fd == NULL) {
+        printf("Not able to write the file at path %s\n", path);
+        return;
+    }
+
+    uint64_t magic = PACKED_MODEL_MAGIC;
+    fwrite(&magic, sizeof(magic), 1, fd);
+
+    fwrite(&model->pad_zeros, sizeof(model->pad_zeros), 1, fd);
+    fwrite(&model->num_inputs_total, sizeof(model->num_inputs_total), 1, fd);
+    fwrite(&model->bits_per_input, sizeof(model->bits_per_input), 1, fd);
+    fwrite(&model->num_classes, sizeof(model->num_classes), 1, fd);
+    fwrite(&model->filter_inputs, sizeof(model->filter_inputs), 1, fd);
+    fwrite(&model->filter_entries, sizeof(model->filter_entries), 1, fd);
+    fwrite(&model->filter_hashes, sizeof(model->filter_hashes), 1, fd);
+    fwrite(&model->bleach, sizeof(model->bleach), 1, fd);
+
+    fwrite(model->input_order, sizeof(*model->input_order), model->num_inputs_total, fd);
+    fwrite(model->hash_parameters.data, sizeof(entry_t), model->filter_hashes * model->filter_inputs, fd);
+
+    unsigned char counter_bytes = model->packed_data != NULL ? model->counter_bytes : sizeof(entry_t);
+    fwrite(&counter_bytes, sizeof(counter_bytes), 1, fd);
+    fwrite(model_counters(model), counter_bytes, model_num_counters(model), fd);
+
+    fclose(fd);
+}
+
+int read_packed_model(const char* path, model_t* model) {
+    FILE* fd = fopen(path, "rb");
+    if(fd == NULL) {
+        printf("Not able to read the file at path %s\n", path);
+        return 0;
+    }
+
+    memset(model, 0, sizeof(*model));
+    uint64_t magic = 0;
+    int complete = fread(&magic, sizeof(magic), 1, fd) == 1 && magic == PACKED_MODEL_MAGIC;
+
+    complete = complete && fread(&model->pad_zeros, sizeof(model->pad_zeros), 1, fd) == 1;
+    complete = complete && fread(&model->num_inputs_total, sizeof(model->num_inputs_total), 1, fd) == 1;
+    complete = complete && fread(&model->bits_per_input, sizeof(model->bits_per_input), 1, fd) == 1;
+    complete = complete && fread(&model->num_classes, sizeof(model->num_classes), 1, fd) == 1;
+    complete = complete && fread(&model->filter_inputs, sizeof(model->filter_inputs), 1, fd) == 1;
+    complete = complete && fread(&model->filter_entries, sizeof(model->filter_entries), 1, fd) == 1;
+    complete = complete && fread(&model->filter_hashes, sizeof(model->filter_hashes), 1, fd) == 1;
+    complete = complete && fread(&model->bleach, sizeof(model->bleach), 1, fd) == 1;
+    if(!complete || model->filter_inputs == 0) {
+        printf("Truncated model header in %s\n", path);
+        fclose(fd);
+        return 0;
+    }
+
+    model->num_filters = model->num_inputs_total / model->filter_inputs;
+
+    model->input_order = calloc(model->num_inputs_total, sizeof(*model->input_order));
+    complete = fread(model->input_order, sizeof(*model->input_order), model->num_inputs_total, fd) == model->num_inputs_total;
+
+    matrix_init(&model->hash_parameters, model->filter_hashes, model->filter_inputs);
+    complete = complete && fread(model->hash_parameters.data, sizeof(entry_t), model->filter_hashes * model->filter_inputs, fd) == model->filter_hashes * model->filter_inputs;
+
+    unsigned char counter_bytes = 0;
+    complete = complete && fread(&counter_bytes, sizeof(counter_bytes), 1, fd) == 1 && (counter_bytes == 1 || counter_bytes == 2 || counter_bytes == 4);
+
+    const size_t num_counters = model_num_counters(model);
+    tensor_init(&model->data, model->num_classes, model->num_filters, model->filter_entries);
+    model->counter_bytes = counter_bytes;
+    if(counter_bytes == sizeof(entry_t)) {
+        complete = complete && fread(model->data.data, sizeof(entry_t), num_counters, fd) == num_counters;
+    } else if(complete) {
+        model->packed_data = calloc(num_counters, counter_bytes);
+        complete = fread(model->packed_data, counter_bytes, num_counters, fd) == num_counters;
+        for(size_t it = 0; it < num_counters; ++it)
+            model->data.data[it] = counter_bytes == 1 ? ((uint8_t*) model->packed_data)[it] : ((uint16_t*) model->packed_data)[it];
+    }
+
+    // Buffers used by model_predict and model_predict2
+    model->reorder_buffer = calloc(model->num_inputs_total, sizeof(*model->reorder_buffer));
+    matrix_init(&model->hashes_buffer, model->num_filters, model->filter_hashes);
+
+    fclose(fd);
+    if(!complete) {
+        printf("Truncated model in %s\n", path);
+        model_free(model);
+    }
+    return complete;
+}
+
+// Regular format (save_model of data_manager.h): header fields, input order, hash parameters, then the counters
+int model_file_holds(const char* path, model_t* model) {
+    FILE* fd = fopen(path, "rb");
+    if(fd == NULL) return 0;
+    fseek(fd, 0, SEEK_END);
+    const long file_bytes = ftell(fd);
+    fclose(fd);
+
+    const size_t min_bytes = 7 * sizeof(size_t) + sizeof(model->bleach) + model->num_inputs_total * sizeof(*model->input_order)
+        + model->filter_hashes * model->filter_inputs * sizeof(entry_t) + model_num_counters(model) * sizeof(entry_t);
+    return file_bytes >= 0 && (size_t) file_bytes >= min_bytes;
+}
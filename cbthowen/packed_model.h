@@ -0,0 +1,56 @@
+#ifndef PACKED_MODEL_H
+#define PACKED_MODEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "model.h"
+
+#define PACKED_MODEL_MAGIC 0x314b435048544257 // "WBTHPCK1" in little endian
+
+/**
+ * @brief Stores a saturated copy of the counters of the model with counter_bytes (1, 2 or 4) bytes per counter.
+ * Inference only compares counters to the bleach, an unsigned char, so saturating at 255 or 65535 never changes a prediction.
+ * 
+ * @param model An initialized model
+ * @param counter_bytes 
+ */
+void model_pack_counters(model_t* model, size_t counter_bytes);
+
+/**
+ * @brief Counters as they are stored on DPUs and on disk: packed_data if the model is packed, data otherwise
+ */
+void* model_counters(model_t* model);
+
+/**
+ * @brief Size of the counters returned by model_counters
+ */
+size_t model_counters_size_bytes(model_t* model);
+
+/**
+ * @brief Checks whether the file at path starts with PACKED_MODEL_MAGIC
+ */
+int is_packed_model_file(const char* path);
+
+/**
+ * @brief Writes the model with its packed counters. Layout: PACKED_MODEL_MAGIC, the header and parameters of
+ * the regular model format, counter_bytes, then the packed counters of shape (#Discriminators, #Filters, #Entries).
+ */
+void write_packed_model(const char* path, model_t* model);
+
+/**
+ * @brief Reads a model written by write_packed_model. Both packed_data and the (unpacked) data tensor are filled.
+ *
+ * @return 1 on success, 0 if the file is missing, not a packed model or truncated (the model is then empty)
+ */
+int read_packed_model(const char* path, model_t* model);
+
+/**
+ * @brief Checks that the file of a model read in the regular format is long enough for the model its header
+ * describes (read_model does not report truncated files)
+ */
+int model_file_holds(const char* path, model_t* model);
+
+#endif
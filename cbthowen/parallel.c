@@ -0,0 +1,78 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+#include "placement.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct {
+    parallel_fn_t fn;
+    void* ctx;
+    size_t thread_it;
+    size_t begin;
+    size_t end;
+    int node;
+} parallel_range_t;
+
+// Set per calling thread: loops run by other threads (e.g. the verifier) are not pinned
+static _Thread_local parallel_node_fn_t node_map_fn = NULL;
+static _Thread_local void* node_map_ctx = NULL;
+
+void parallel_set_node_map(parallel_node_fn_t node_fn, void* node_ctx) {
+    node_map_fn = node_fn;
+    node_map_ctx = node_ctx;
+}
+
+size_t parallel_num_threads() {
+    char* env = getenv(PARALLEL_THREADS_ENV);
+    if(env != NULL && atoi(env) > 0)
+        return atoi(env);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (size_t) cores : 1;
+}
+
+static void* parallel_worker(void* arg) {
+    parallel_range_t* range = (parallel_range_t*) arg;
+    placement_pin_thread(range->node);
+    range->fn(range->ctx, range->thread_it, range->begin, range->end);
+    return NULL;
+}
+
+void parallel_for(size_t num_items, size_t num_threads, parallel_fn_t fn, void* ctx) {
+    if(num_threads == 0) num_threads = 1;
+
+    parallel_range_t ranges[num_threads];
+    pthread_t threads[num_threads];
+    for(size_t it = 0; it < num_threads; ++it) {
+        ranges[it] = (parallel_range_t) {
+            .fn = fn,
+            .ctx = ctx,
+            .thread_it = it,
+            .begin = it * num_items / num_threads,
+            .end = (it + 1) * num_items / num_threads
+        };
+        ranges[it].node = node_map_fn != NULL && ranges[it].begin < ranges[it].end ? node_map_fn(node_map_ctx, ranges[it].begin) : -1;
+    }
+
+    // The calling thread gets its affinity back once its ranges are done
+    cpu_set_t caller_cpus;
+    const int restore = node_map_fn != NULL && pthread_getaffinity_np(pthread_self(), sizeof(caller_cpus), &caller_cpus) == 0;
+
+    for(size_t it = 1; it < num_threads; ++it) {
+        if(pthread_create(&threads[it], NULL, parallel_worker, &ranges[it]) != 0) {
+            // Could not spawn: process the range inline
+            parallel_worker(&ranges[it]);
+            threads[it] = pthread_self();
+        }
+    }
+
+    parallel_worker(&ranges[0]);
+    if(restore)
+        pthread_setaffinity_np(pthread_self(), sizeof(caller_cpus), &caller_cpus);
+
+    for(size_t it = 1; it < num_threads; ++it) {
+        if(!pthread_equal(threads[it], pthread_self()))
+            pthread_join(threads[it], NULL);
+    }
+}
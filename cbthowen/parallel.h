@@ -0,0 +1,47 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// Environment variable overriding the number of host worker threads
+#define PARALLEL_THREADS_ENV "CBTHOWEN_THREADS"
+
+/**
+ * @brief Work function of a parallel loop: processes items [begin; end) on worker thread_it
+ */
+typedef void (*parallel_fn_t)(void* ctx, size_t thread_it, size_t begin, size_t end);
+
+/**
+ * @brief NUMA node of the thread running the range that starts at item, -1 to leave the thread unpinned
+ */
+typedef int (*parallel_node_fn_t)(void* ctx, size_t item);
+
+/**
+ * @brief Number of host worker threads: CBTHOWEN_THREADS if set, the number of online cores otherwise
+ */
+size_t parallel_num_threads();
+
+/**
+ * @brief Splits [0; num_items) into num_threads contiguous ranges and runs fn on each range in its own thread.
+ * Range thread_it is always [thread_it * num_items / num_threads; (thread_it + 1) * num_items / num_threads).
+ * The calling thread processes the first range, and the call returns once every range is done.
+ * 
+ * @param num_items 
+ * @param num_threads 
+ * @param fn 
+ * @param ctx Passed untouched to fn
+ */
+void parallel_for(size_t num_items, size_t num_threads, parallel_fn_t fn, void* ctx);
+
+/**
+ * @brief Pins the threads of the next parallel loops of the calling thread to the node of their first item
+ * (see placement_pin_thread), so that each range runs next to its memory. The calling thread keeps its affinity.
+ *
+ * @param node_fn NULL to stop pinning
+ * @param node_ctx Passed untouched to node_fn
+ */
+void parallel_set_node_map(parallel_node_fn_t node_fn, void* node_ctx);
+
+#endif
@@ -0,0 +1,74 @@
+#define _GNU_SOURCE
+#include "placement.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// From linux/mempolicy.h, which is not always installed
+#define PLACEMENT_MPOL_PREFERRED 1
+#define PLACEMENT_MPOL_MF_MOVE (1 << 1)
+
+// Parses a sysfs list such as "0-23,48-71", calls fn on each element
+static int read_sysfs_list(const char* path, void (*fn)(void* ctx, int element), void* ctx) {
+    FILE* fd = fopen(path, "r");
+    if(fd == NULL) return -1;
+
+    char line[4096];
+    char* read = fgets(line, sizeof(line), fd);
+    fclose(fd);
+    if(read == NULL) return -1;
+
+    for(char* range = strtok(line, ",\n"); range != NULL; range = strtok(NULL, ",\n")) {
+        int first, last;
+        const int fields = sscanf(range, "%d-%d", &first, &last);
+        if(fields < 1) continue;
+        if(fields == 1) last = first;
+        for(int element = first; element <= last; ++element)
+            fn(ctx, element);
+    }
+    return 0;
+}
+
+static void count_node(void* ctx, int element) {
+    int* num_nodes = (int*) ctx;
+    if(element + 1 > *num_nodes) *num_nodes = element + 1;
+}
+
+static void add_cpu(void* ctx, int element) {
+    if(element < CPU_SETSIZE)
+        CPU_SET(element, (cpu_set_t*) ctx);
+}
+
+int placement_num_nodes() {
+    int num_nodes = 0;
+    if(read_sysfs_list("/sys/devices/system/node/online", count_node, &num_nodes) != 0 || num_nodes < 1)
+        return 1;
+    return num_nodes < PLACEMENT_MAX_NODES ? num_nodes : PLACEMENT_MAX_NODES;
+}
+
+int placement_bind_range(void* addr, size_t bytes, int node) {
+    if(node < 0 || node >= PLACEMENT_MAX_NODES || bytes == 0 || placement_num_nodes() <= 1) return 0;
+
+    // mbind works on whole pages: the pages shared with a neighbouring range go to the last bound one
+    const uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+    const uintptr_t first = (uintptr_t) addr / page_size * page_size;
+    const uintptr_t last = ((uintptr_t) addr + bytes + page_size - 1) / page_size * page_size;
+
+    unsigned long node_mask = 1ul << node;
+    return syscall(SYS_mbind, first, last - first, PLACEMENT_MPOL_PREFERRED, &node_mask, (unsigned long) PLACEMENT_MAX_NODES + 1, PLACEMENT_MPOL_MF_MOVE) == 0 ? 0 : -1;
+}
+
+int placement_pin_thread(int node) {
+    if(node < 0 || placement_num_nodes() <= 1) return 0;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if(read_sysfs_list(path, add_cpu, &cpus) != 0 || CPU_COUNT(&cpus) == 0) return -1;
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0 ? 0 : -1;
+}
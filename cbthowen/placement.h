@@ -0,0 +1,36 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * NUMA placement of host memory and threads, over the Linux syscalls and sysfs rather than libnuma.
+ * On a single-node machine, or without the sysfs entries, every call is a no-op that reports success.
+ */
+
+#define PLACEMENT_MAX_NODES 64
+
+/**
+ * @brief Number of NUMA nodes of the machine, 1 if it cannot be read
+ */
+int placement_num_nodes();
+
+/**
+ * @brief Moves the pages overlapping [addr; addr + bytes) to node, and prefers node for the ones not faulted in yet
+ *
+ * @param node Nothing is moved if negative
+ * @return 0 on success (or if there is nothing to do), -1 otherwise
+ */
+int placement_bind_range(void* addr, size_t bytes, int node);
+
+/**
+ * @brief Restricts the calling thread to the cores of node
+ *
+ * @param node The thread is left as is if negative
+ * @return 0 on success (or if there is nothing to do), -1 otherwise
+ */
+int placement_pin_thread(int node);
+
+#endif
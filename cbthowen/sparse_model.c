@@ -0,0 +1,99 @@
+#include "sparse_model.h"
+
+static inline uint32_t sparse_value_at(model_t* model, size_t rank) {
+    if(model->counter_bytes == 1) return ((uint8_t*) model->sparse_values)[rank];
+    if(model->counter_bytes == 2) return ((uint16_t*) model->sparse_values)[rank];
+    return ((uint32_t*) model->sparse_values)[rank];
+}
+
+static inline uint32_t sparse_counter(model_t* model, size_t discr_it, size_t filter_it, size_t entry_it) {
+    const uint64_t word = model->sparse_words[(discr_it * model->num_filters + filter_it) * model->sparse_words_per_filter + entry_it / SPARSE_WORD_ENTRIES];
+    const uint32_t occupancy = (uint32_t) word;
+    const uint32_t bit = 1u << (entry_it % SPARSE_WORD_ENTRIES);
+    if((occupancy & bit) == 0) return 0;
+    return sparse_value_at(model, (word >> 32) + __builtin_popcount(occupancy & (bit - 1)));
+}
+
+void model_build_sparse(model_t* model) {
+    const entry_t saturation = model->counter_bytes == 4 ? (entry_t) -1 : (((entry_t) 1) << (8 * model->counter_bytes)) - 1;
+    const size_t num_counters = model->num_classes * model->num_filters * model->filter_entries;
+
+    size_t num_values = 0;
+    for(size_t it = 0; it < num_counters; ++it)
+        num_values += model->data.data[it] != 0;
+    assert(num_values <= UINT32_MAX && "Too many nonzero counters for the sparse layout!");
+
+    model->sparse_words_per_filter = (model->filter_entries + SPARSE_WORD_ENTRIES - 1) / SPARSE_WORD_ENTRIES;
+    model->sparse_num_values = num_values;
+    free(model->sparse_words);
+    free(model->sparse_values);
+    model->sparse_words = calloc(model->num_classes * model->num_filters * model->sparse_words_per_filter, sizeof(*model->sparse_words));
+    model->sparse_values = calloc(num_values > 0 ? num_values : 1, model->counter_bytes);
+
+    size_t rank = 0;
+    for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it) {
+        for(size_t filter_it = 0; filter_it < model->num_filters; ++filter_it) {
+            entry_t* filter = TENSOR3D_AXIS2(model->data, discr_it, filter_it);
+            uint64_t* words = model->sparse_words + (discr_it * model->num_filters + filter_it) * model->sparse_words_per_filter;
+
+            for(size_t entry_it = 0; entry_it < model->filter_entries; ++entry_it) {
+                if(entry_it % SPARSE_WORD_ENTRIES == 0)
+                    words[entry_it / SPARSE_WORD_ENTRIES] = (uint64_t) rank << 32;
+                if(filter[entry_it] == 0) continue;
+
+                words[entry_it / SPARSE_WORD_ENTRIES] |= 1u << (entry_it % SPARSE_WORD_ENTRIES);
+                entry_t counter = filter[entry_it] < saturation ? filter[entry_it] : saturation;
+                if(model->counter_bytes == 1) ((uint8_t*) model->sparse_values)[rank] = counter;
+                else if(model->counter_bytes == 2) ((uint16_t*) model->sparse_values)[rank] = counter;
+                else ((uint32_t*) model->sparse_values)[rank] = counter;
+                ++rank;
+            }
+        }
+    }
+}
+
+size_t sparse_words_size_bytes(model_t* model) {
+    return model->num_classes * model->num_filters * model->sparse_words_per_filter * sizeof(*model->sparse_words);
+}
+
+size_t sparse_values_size_bytes(model_t* model) {
+    return model->sparse_num_values * model->counter_bytes;
+}
+
+size_t model_predict_backend_sparse(model_t* model, matrix_t* hashes_buffer) {
+    // Calculate popcounts for each discriminators
+    entry_t popcounts[model->num_classes];
+    for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it)
+        popcounts[discr_it] = 0;
+
+    for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it) {
+        for(size_t filter_it = 0; filter_it < model->num_filters; ++filter_it) {
+            entry_t* hashes = MATRIX_AXIS1(*hashes_buffer, filter_it);
+            // The filter responds if every hashed counter reaches the bleach
+            size_t hash_it = 0;
+            while(hash_it < model->filter_hashes && sparse_counter(model, discr_it, filter_it, hashes[hash_it]) >= model->bleach)
+                ++hash_it;
+            popcounts[discr_it] += hash_it == model->filter_hashes;
+        }
+    }
+
+    // Pick the argmax of popcounts, ties go to the last discriminator
+    size_t response_index = 0;
+    entry_t max_popcount = 0;
+    for(size_t discr_it = 0; discr_it < model->num_classes; ++discr_it) {
+        if(popcounts[discr_it] >= max_popcount) {
+            max_popcount = popcounts[discr_it];
+            response_index = discr_it;
+        }
+    }
+
+    return response_index;
+}
+
+void batch_prediction_hashed_sparse(size_t* results, model_t* model, tensor3d_t* hashes, size_t batch_size) {
+    matrix_t sample_hashes = { .stride = model->filter_hashes, .data=NULL };
+    for(size_t it = 0; it < batch_size; ++it) {
+        sample_hashes.data = TENSOR3D_AXIS1(*hashes, it);
+        results[it] = model_predict_backend_sparse(model, &sample_hashes);
+    }
+}
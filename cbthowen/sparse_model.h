@@ -0,0 +1,51 @@
+#ifndef SPARSE_MODEL_H
+#define SPARSE_MODEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "model.h"
+#include "../support/common.h" // SPARSE_WORD_ENTRIES, shared with the DPUs
+
+/**
+ * @brief Derives the sparse layout of the counters: for each (discriminator, filter), one word per SPARSE_WORD_ENTRIES
+ * entries holds their occupancy bitmap (low half) and the rank of their first nonzero counter (high half). The nonzero
+ * counters are stored back to back in rank order, on counter_bytes bytes and saturated as in model_pack_counters.
+ * A counter is read with the word of its entry, then the counter at rank + popcount of the lower bits, if its bit is set.
+ *
+ * @param model An initialized model with at most 2^32 nonzero counters
+ */
+void model_build_sparse(model_t* model);
+
+/**
+ * @brief Size of sparse_words, of shape (#Discriminators, #Filters, #Words)
+ */
+size_t sparse_words_size_bytes(model_t* model);
+
+/**
+ * @brief Size of sparse_values
+ */
+size_t sparse_values_size_bytes(model_t* model);
+
+/**
+ * @brief Same prediction as model_predict_backend from the sparse layout (see model_build_sparse)
+ *
+ * @param model A model with its sparse layout built
+ * @param hashes_buffer
+ * @return size_t
+ */
+size_t model_predict_backend_sparse(model_t* model, matrix_t* hashes_buffer);
+
+/**
+ * @brief Same as batch_prediction_hashed, from the sparse layout
+ *
+ * @param results of shape (batch_size)
+ * @param model
+ * @param hashes of shape (batch_size, #num_filters, #filter_hashes)
+ * @param batch_size
+ */
+void batch_prediction_hashed_sparse(size_t* results, model_t* model, tensor3d_t* hashes, size_t batch_size);
+
+#endif
@@ -1,4 +1,5 @@
 #include "tensor.h"
+#include "parallel.h"
 
 void tensor_init(tensor3d_t* t, size_t shape1, size_t shape2, size_t shape3) {
     t->stride1 = shape2 * shape3;
@@ -7,12 +8,25 @@ void tensor_init(tensor3d_t* t, size_t shape1, size_t shape2, size_t shape3) {
     t->data = (entry_t*) calloc(shape1 * shape2 * shape3, sizeof(*t->data));
 }
 
+void tensor_init_arena(tensor3d_t* t, size_t shape1, size_t shape2, size_t shape3, arena_t* arena) {
+    t->stride1 = shape2 * shape3;
+    t->stride2 = shape3;
+
+    t->data = (entry_t*) arena_alloc(arena, shape1 * shape2 * shape3 * sizeof(*t->data));
+}
+
 void matrix_init(matrix_t* m, size_t rows, size_t cols) {
     m->stride = cols;
 
     m->data = (entry_t*) calloc(rows * cols, sizeof(*m->data));
 }
 
+void matrix_init_arena(matrix_t* m, size_t rows, size_t cols, arena_t* arena) {
+    m->stride = cols;
+
+    m->data = (entry_t*) arena_alloc(arena, rows * cols * sizeof(*m->data));
+}
+
 void matrix_print(matrix_t* m, size_t rows, size_t cols) {
     for(size_t i = 0; i < rows; ++i) {
         for(size_t j = 0; j < cols; ++j)
@@ -27,6 +41,12 @@ void bmatrix_init(bmatrix_t* m, size_t rows, size_t cols) {
     m->data = (unsigned char*) calloc(rows * cols, sizeof(*m->data));
 }
 
+void bmatrix_init_arena(bmatrix_t* m, size_t rows, size_t cols, arena_t* arena) {
+    m->stride = cols;
+
+    m->data = (unsigned char*) arena_alloc(arena, rows * cols * sizeof(*m->data));
+}
+
 void bmatrix_mean(double* mean, bmatrix_t* dataset, size_t sample_size, size_t num_samples) {
     for(size_t offset_it = 0; offset_it < sample_size; ++offset_it) 
         mean[offset_it] = 0;
@@ -54,3 +74,103 @@ void bmatrix_variance(double* variance, bmatrix_t* dataset, size_t sample_size,
     for(size_t offset_it = 0; offset_it < sample_size; ++offset_it) 
         variance[offset_it] /= (num_samples - 1);
 }
+
+// Samples per block of exact integer sums: 2^16 * 255^2 still fits in the 53 bits of a double
+#define MOMENTS_BLOCK_SAMPLES 65536
+
+typedef struct {
+    bmatrix_t* dataset;
+    size_t sample_size;
+    size_t* count; // of shape (#Threads)
+    double* mean; // of shape (#Threads, sample_size)
+    double* m2; // of shape (#Threads, sample_size)
+} moments_ctx_t;
+
+void moments_merge(size_t count_a, double* mean_a, double* m2_a, size_t count_b, double* mean_b, double* m2_b, size_t sample_size) {
+    if(count_b == 0) return;
+    double count = (double) (count_a + count_b);
+    for(size_t offset_it = 0; offset_it < sample_size; ++offset_it) {
+        double delta = mean_b[offset_it] - mean_a[offset_it];
+        mean_a[offset_it] += delta * count_b / count;
+        m2_a[offset_it] += m2_b[offset_it] + delta * delta * ((double) count_a) * count_b / count;
+    }
+}
+
+static void moments_worker(void* arg, size_t thread_it, size_t begin, size_t end) {
+    moments_ctx_t* ctx = (moments_ctx_t*) arg;
+    const size_t sample_size = ctx->sample_size;
+
+    double* mean = ctx->mean + thread_it * sample_size;
+    double* m2 = ctx->m2 + thread_it * sample_size;
+    size_t count = 0;
+
+    uint64_t* sum = calloc(sample_size, sizeof(*sum));
+    uint64_t* sum_sq = calloc(sample_size, sizeof(*sum_sq));
+    double* block_mean = calloc(sample_size, sizeof(*block_mean));
+    double* block_m2 = calloc(sample_size, sizeof(*block_m2));
+
+    for(size_t offset_it = 0; offset_it < sample_size; ++offset_it)
+        mean[offset_it] = m2[offset_it] = 0;
+
+    for(size_t block_it = begin; block_it < end; block_it += MOMENTS_BLOCK_SAMPLES) {
+        size_t block_end = end - block_it < MOMENTS_BLOCK_SAMPLES ? end : block_it + MOMENTS_BLOCK_SAMPLES;
+
+        for(size_t offset_it = 0; offset_it < sample_size; ++offset_it)
+            sum[offset_it] = sum_sq[offset_it] = 0;
+
+        for(size_t sample_it = block_it; sample_it < block_end; ++sample_it) {
+            unsigned char* sample = MATRIX_AXIS1(*ctx->dataset, sample_it);
+            for(size_t offset_it = 0; offset_it < sample_size; ++offset_it) {
+                uint64_t value = sample[offset_it];
+                sum[offset_it] += value;
+                sum_sq[offset_it] += value * value;
+            }
+        }
+
+        size_t block_count = block_end - block_it;
+        for(size_t offset_it = 0; offset_it < sample_size; ++offset_it) {
+            block_mean[offset_it] = ((double) sum[offset_it]) / block_count;
+            block_m2[offset_it] = ((double) sum_sq[offset_it]) - ((double) sum[offset_it]) * block_mean[offset_it];
+        }
+
+        moments_merge(count, mean, m2, block_count, block_mean, block_m2, sample_size);
+        count += block_count;
+    }
+
+    ctx->count[thread_it] = count;
+
+    free(sum);
+    free(sum_sq);
+    free(block_mean);
+    free(block_m2);
+}
+
+void bmatrix_moments(double* mean, double* variance, bmatrix_t* dataset, size_t sample_size, size_t num_samples) {
+    size_t num_threads = parallel_num_threads();
+    if(num_threads > num_samples) num_threads = num_samples > 0 ? num_samples : 1;
+
+    moments_ctx_t ctx = {
+        .dataset = dataset,
+        .sample_size = sample_size,
+        .count = calloc(num_threads, sizeof(size_t)),
+        .mean = calloc(num_threads * sample_size, sizeof(double)),
+        .m2 = calloc(num_threads * sample_size, sizeof(double))
+    };
+
+    parallel_for(num_samples, num_threads, moments_worker, &ctx);
+
+    size_t count = ctx.count[0];
+    for(size_t thread_it = 1; thread_it < num_threads; ++thread_it) {
+        moments_merge(count, ctx.mean, ctx.m2, ctx.count[thread_it], ctx.mean + thread_it * sample_size, ctx.m2 + thread_it * sample_size, sample_size);
+        count += ctx.count[thread_it];
+    }
+
+    for(size_t offset_it = 0; offset_it < sample_size; ++offset_it) {
+        mean[offset_it] = ctx.mean[offset_it];
+        variance[offset_it] = ctx.m2[offset_it] / (num_samples - 1);
+    }
+
+    free(ctx.count);
+    free(ctx.mean);
+    free(ctx.m2);
+}
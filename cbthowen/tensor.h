@@ -6,6 +6,7 @@
 #include <stdio.h>
 
 #include "math.h"
+#include "arena.h"
 
 typedef uint32_t entry_t;
 
@@ -27,6 +28,8 @@ typedef struct {
 #define TENSOR3D_(t, index) (TENSOR3D(t, index.axis1, index.axis2, index.axis2))
 
 void tensor_init(tensor3d_t* t, size_t shape1, size_t shape2, size_t shape3);
+// Same as tensor_init, carved out of the arena: aligned, zeroed only if the arena pages are fresh
+void tensor_init_arena(tensor3d_t* t, size_t shape1, size_t shape2, size_t shape3, arena_t* arena);
 
 typedef struct {
     size_t axis1;
@@ -43,6 +46,7 @@ typedef struct {
 #define MATRIX_(t, index) (MATRIX(t, index.axis1, index.axis2))
 
 void matrix_init(matrix_t* m, size_t rows, size_t cols);
+void matrix_init_arena(matrix_t* m, size_t rows, size_t cols, arena_t* arena);
 void matrix_print(matrix_t* m, size_t rows, size_t cols);
 
 typedef struct {
@@ -51,8 +55,13 @@ typedef struct {
 } bmatrix_t;
 
 void bmatrix_init(bmatrix_t* m, size_t rows, size_t cols);
+void bmatrix_init_arena(bmatrix_t* m, size_t rows, size_t cols, arena_t* arena);
 
 void bmatrix_mean(double* mean, bmatrix_t* dataset, size_t sample_size, size_t num_samples);
 void bmatrix_variance(double* variance, bmatrix_t* dataset, size_t sample_size, size_t num_samples, double* mean);
+// Mean and variance in a single pass: equivalent to bmatrix_mean followed by bmatrix_variance
+void bmatrix_moments(double* mean, double* variance, bmatrix_t* dataset, size_t sample_size, size_t num_samples);
+// Chan et al. parallel update: merges the (count_b, mean_b, m2_b) moments into (count_a, mean_a, m2_a), m2 being the sum of squared deviations
+void moments_merge(size_t count_a, double* mean_a, double* m2_a, size_t count_b, double* mean_b, double* m2_b, size_t sample_size);
 
 #endif
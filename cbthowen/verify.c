@@ -0,0 +1,121 @@
+#include "verify.h"
+#include "parallel.h"
+
+void verifier_init(verifier_t* verifier, model_t* model, size_t max_samples, size_t sample_size, size_t max_mismatches) {
+    *verifier = (verifier_t) {
+        .model = model,
+        .max_samples = max_samples,
+        .sample_size = sample_size,
+        .max_mismatches = max_mismatches,
+        .num_threads = parallel_num_threads()
+    };
+    verifier->samples = (size_t*) malloc(max_samples * sizeof(*verifier->samples));
+    verifier->expected = (size_t*) malloc(max_samples * sizeof(*verifier->expected));
+}
+
+void verifier_free(verifier_t* verifier) {
+    assert(!verifier->running && "Batch still being verified!");
+    free(verifier->samples);
+    free(verifier->expected);
+    verifier->samples = NULL;
+    verifier->expected = NULL;
+}
+
+static void verifier_reference_range(void* ctx, size_t thread_it, size_t begin, size_t end) {
+    (void) thread_it;
+    verifier_t* verifier = (verifier_t*) ctx;
+    model_t* model = verifier->model;
+
+    if(verifier->hashes != NULL) {
+        matrix_t sample_hashes = { .stride = model->filter_hashes, .data = NULL };
+        for(size_t it = begin; it < end; ++it) {
+            sample_hashes.data = TENSOR3D_AXIS1(*verifier->hashes, verifier->samples[it]);
+            verifier->expected[it] = model_predict_backend(model, &sample_hashes);
+        }
+        return;
+    }
+
+    // model_predict2 shares the buffers of the model between threads: each range reorders and hashes in its own
+    element_t* reordered = (element_t*) malloc(model->num_inputs_total * sizeof(*reordered));
+    matrix_t sample_hashes;
+    matrix_init(&sample_hashes, model->num_filters, model->filter_hashes);
+    for(size_t it = begin; it < end; ++it) {
+        reorder_array(reordered, MATRIX_AXIS1(*verifier->inputs, verifier->samples[it]), model->input_order, model->num_inputs_total);
+        perform_hashing(sample_hashes, model, reordered);
+        verifier->expected[it] = model_predict_backend(model, &sample_hashes);
+    }
+    free(sample_hashes.data);
+    free(reordered);
+}
+
+static void* verifier_reference(void* arg) {
+    verifier_t* verifier = (verifier_t*) arg;
+    parallel_for(verifier->num_checked, verifier->num_threads, verifier_reference_range, verifier);
+    return NULL;
+}
+
+void verifier_start(verifier_t* verifier, tensor3d_t* hashes, bmatrix_t* inputs, size_t num_samples) {
+    assert(!verifier->running && "Previous batch not checked!");
+    assert(num_samples <= verifier->max_samples && "Batch too large for the verifier!");
+
+    verifier->hashes = hashes;
+    verifier->inputs = inputs;
+    verifier->num_samples = num_samples;
+    verifier->num_checked = 0;
+    if(verifier->stopped)
+        return;
+
+    // Selection sampling: keeps sample_size samples, each subset being equally likely, in increasing order
+    const size_t wanted = verifier->sample_size == 0 || verifier->sample_size > num_samples ? num_samples : verifier->sample_size;
+    for(size_t it = 0; it < num_samples && verifier->num_checked < wanted; ++it) {
+        if(wanted == num_samples || (size_t) unif_rand(num_samples - it - 1) < wanted - verifier->num_checked)
+            verifier->samples[verifier->num_checked++] = it;
+    }
+
+    if(pthread_create(&verifier->thread, NULL, verifier_reference, verifier) == 0)
+        verifier->running = true;
+    else
+        verifier_reference(verifier); // Could not spawn: compute the references inline
+}
+
+size_t verifier_check(verifier_t* verifier, uint64_t* predictions) {
+    if(verifier->running) {
+        pthread_join(verifier->thread, NULL);
+        verifier->running = false;
+    }
+
+    size_t mismatches = 0;
+    size_t it = 0;
+    for(; it < verifier->num_checked && !verifier->stopped; ++it) {
+        const size_t sample = verifier->samples[it];
+        if(predictions[sample] == verifier->expected[it])
+            continue;
+
+        if(verifier->total_mismatches < VERIFY_REPORTED_MISMATCHES) {
+            verifier->mismatches[verifier->total_mismatches] = (verify_mismatch_t) {
+                .sample = verifier->total_samples + sample,
+                .expected = verifier->expected[it],
+                .actual = predictions[sample]
+            };
+        }
+        ++mismatches;
+        ++verifier->total_mismatches;
+        verifier->stopped = verifier->max_mismatches > 0 && verifier->total_mismatches >= verifier->max_mismatches;
+    }
+
+    verifier->total_checked += it;
+    verifier->total_samples += verifier->num_samples;
+    return mismatches;
+}
+
+void verifier_report(verifier_t* verifier) {
+    printf("verify, %zu, %zu, %zu%s\n", verifier->total_checked, verifier->total_samples, verifier->total_mismatches,
+        verifier->stopped ? ", stopped" : "");
+
+    const size_t reported = verifier->total_mismatches < VERIFY_REPORTED_MISMATCHES ? verifier->total_mismatches : VERIFY_REPORTED_MISMATCHES;
+    for(size_t it = 0; it < reported; ++it) {
+        printf("Sample %zu> %zu -- %zu_ \n", verifier->mismatches[it].sample, verifier->mismatches[it].actual, verifier->mismatches[it].expected);
+    }
+    if(verifier->total_mismatches > reported)
+        printf("... %zu more\n", verifier->total_mismatches - reported);
+}
@@ -0,0 +1,91 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "model.h"
+
+// Mismatches kept for the report, the others are only counted
+#define VERIFY_REPORTED_MISMATCHES 8
+
+typedef struct {
+    size_t sample; // Index of the sample over all the verified batches
+    size_t expected;
+    size_t actual;
+} verify_mismatch_t;
+
+/**
+ * Checks the predictions of successive batches against the host reference. The reference predictions of a
+ * batch are computed by worker threads in the background (see verifier_start), typically while the DPUs
+ * work on the same batch, on a random subset of the batch or on all of it. Verification stops once
+ * max_mismatches mismatches were found.
+ */
+typedef struct {
+    model_t* model;
+    size_t max_samples; // Largest batch
+    size_t sample_size; // Samples checked per batch, 0 to check all of them
+    size_t max_mismatches; // 0 for no limit
+    size_t num_threads;
+
+    // Batch in flight
+    size_t* samples; // (max_samples) checked samples of the batch, in increasing order
+    size_t* expected; // (max_samples) reference prediction of each checked sample
+    size_t num_checked;
+    size_t num_samples;
+    tensor3d_t* hashes; // Hashes of the batch, NULL to hash inputs
+    bmatrix_t* inputs; // Binarized batch, not reordered
+    pthread_t thread;
+    bool running;
+
+    // Report over all batches
+    size_t total_samples;
+    size_t total_checked;
+    size_t total_mismatches;
+    bool stopped;
+    verify_mismatch_t mismatches[VERIFY_REPORTED_MISMATCHES];
+} verifier_t;
+
+/**
+ * @brief
+ *
+ * @param verifier
+ * @param model
+ * @param max_samples Largest batch to be verified
+ * @param sample_size Samples checked per batch, 0 to check all of them
+ * @param max_mismatches Mismatches after which verification stops, 0 for no limit
+ */
+void verifier_init(verifier_t* verifier, model_t* model, size_t max_samples, size_t sample_size, size_t max_mismatches);
+void verifier_free(verifier_t* verifier);
+
+/**
+ * @brief Draws the samples checked in the batch and starts computing their reference predictions in the background.
+ * The batch must not change until verifier_check returns. Does nothing once verification stopped.
+ *
+ * @param verifier
+ * @param hashes of shape (num_samples, #num_filters, #filter_hashes), NULL to hash inputs instead
+ * @param inputs of shape (num_samples, #elements_per_sample), used when hashes is NULL
+ * @param num_samples
+ */
+void verifier_start(verifier_t* verifier, tensor3d_t* hashes, bmatrix_t* inputs, size_t num_samples);
+
+/**
+ * @brief Waits for the reference predictions of the batch and compares them with predictions.
+ * Stops at the mismatch limit.
+ *
+ * @param verifier
+ * @param predictions of shape (num_samples)
+ * @return size_t Mismatches found in the batch
+ */
+size_t verifier_check(verifier_t* verifier, uint64_t* predictions);
+
+/**
+ * @brief Prints the samples checked, the mismatches and the first mismatches found
+ */
+void verifier_report(verifier_t* verifier);
+
+#endif
@@ -9,6 +9,8 @@
 #include <alloc.h>
 #include <perfcounter.h>
 #include <barrier.h>
+#include <mutex.h>
+#include <sem.h>
 
 #include "../support/common.h"
 #include "../support/cyclecount.h"
@@ -16,14 +18,20 @@
 // Input and output argumentsd
 __host dpu_params_t DPU_INPUT_ARGUMENTS;
 __host dpu_results_t DPU_RESULTS[NR_TASKLETS];
-
-#define MODEL_ENTRY_SIZE_B (sizeof(uint32_t))
-#define MODEL_FILTER_SIZE_B(p) ((p).filter_entries * MODEL_ENTRY_SIZE_B)
+__host dpu_probe_stats_t DPU_PROBE_STATS[NR_TASKLETS];
+__host dpu_stage_stats_t DPU_STAGE_STATS[NR_TASKLETS];
+__host uint32_t DPU_HASH_PARAMETERS[MAX_HASH_PARAMETERS]; // of shape (#FilterHashes, #FilterInputs) for each model
+__host dpu_model_entry_t DPU_MODEL_DIRECTORY[MAX_MODELS];
+__host uint32_t DPU_BLEACH_SWEEP[NR_TASKLETS][SWEEP_BLEACH_VALUES]; // Samples correctly classified at each bleach (kernel_bleach_sweep)
+__host uint32_t DPU_CONFUSION[CONFUSION_MAX_CLASSES * CONFUSION_MAX_CLASSES]; // (label, prediction) counts of the batch (kernel_confusion)
+
+#define MODEL_ENTRY_SIZE_B(p) ((p).entry_bytes)
+#define MODEL_FILTER_SIZE_B(p) ((p).filter_entries * MODEL_ENTRY_SIZE_B(p))
 #define MODEL_DISCR_SIZE_B(p) ((p).num_filters * MODEL_FILTER_SIZE_B(p))
 
 #define MODEL_DISCR_ADDR(p, base, discr) ((base) + (discr) * MODEL_DISCR_SIZE_B(p))
 #define MODEL_FILTER_ADDR(p, base, discr, filter) (MODEL_DISCR_ADDR(p, base, discr) + (filter) * MODEL_FILTER_SIZE_B(p))
-#define MODEL_ENTRY_ADDR(p, base, discr, filter, entry) (MODEL_FILTER_ADDR(p, base, discr, filter) + (entry) * MODEL_ENTRY_SIZE_B)
+#define MODEL_ENTRY_ADDR(p, base, discr, filter, entry) (MODEL_FILTER_ADDR(p, base, discr, filter) + (entry) * MODEL_ENTRY_SIZE_B(p))
 
 // All hashes from a single sample are stored in WRAM
 #define HASHES_BLOCK_SIZE(p) ((p).filter_hashes * (p).num_filters)
@@ -35,16 +43,69 @@ __host dpu_results_t DPU_RESULTS[NR_TASKLETS];
 
 #define PREDICTION_ADDR(p, base, sample) ((base) + (sample) * sizeof(uint64_t))
 
+// Class masks of a model, of shape (#Filters, #Entries)
+#define MASK_ENTRY_ADDR(p, base, mask_bytes, filter, entry) ((base) + ((filter) * (p).filter_entries + (entry)) * (mask_bytes))
+#define MASK_MAX_PLANES 32
+
+// Reordered binarized samples, one byte per input
+#define INPUT_SAMPLE_ADDR(base, sample_bytes, sample) ((base) + (sample) * (sample_bytes))
+#define MRAM_READ_MAX_B 2048
+
 // Barrier
 BARRIER_INIT(my_barrier, NR_TASKLETS);
 
+// Extracts the counter at byte offset `offset` of an 8-byte MRAM line, for 1, 2 or 4-byte counters
+static inline uint32_t model_entry_from_line(uint8_t* line, uint32_t offset, uint32_t entry_bytes) {
+    if(entry_bytes == 1) return line[offset];
+    if(entry_bytes == 2) return ((uint16_t*) line)[offset >> 1];
+    return ((uint32_t*) line)[offset >> 2];
+}
+
+// Minimum over the probes of a filter of a class, the response of the filter being (min >= bleach)
+static inline uint32_t filter_min_entry(uint32_t* hashes_filter_buffer, uint8_t* filter_buffer, dpu_model_params_t* p, uint32_t mram_base_addr_model,
+                                        unsigned int discriminator_it, unsigned int filter_it) {
+    uint32_t min = -1;
+    for(size_t hash_it = 0; hash_it < p->filter_hashes; ++hash_it) {
+        uint32_t model_entry_addr = MODEL_ENTRY_ADDR(*p, mram_base_addr_model, discriminator_it, filter_it, hashes_filter_buffer[hash_it]);
+        uint32_t aligned_addr = ROUND_DOWN_TO_MULTIPLE_OF_8(model_entry_addr);
+
+        mram_read(aligned_addr, filter_buffer, 8);
+        uint32_t entry = model_entry_from_line(filter_buffer, model_entry_addr - aligned_addr, p->entry_bytes);
+        if(entry <= min) min = entry;
+    }
+    return min;
+}
+
+// Index of the highest popcount, the last one on ties (as main_kernel1)
+static inline uint64_t argmax_popcounts(uint32_t* popcounts, uint32_t num_classes) {
+    uint32_t max_pcount = 0;
+    uint64_t argmax_pcount = 0;
+    for(unsigned int discriminator_it = 0; discriminator_it < num_classes; ++discriminator_it) {
+        if(popcounts[discriminator_it] >= max_pcount) {
+            max_pcount = popcounts[discriminator_it];
+            argmax_pcount = discriminator_it;
+        }
+    }
+    return argmax_pcount;
+}
+
 extern int main_kernel1(void);
 extern int print_kernel(void);
-int (*kernels[2])(void) = {main_kernel1, print_kernel};
+extern int early_exit_kernel(void);
+extern int coalesced_kernel(void);
+extern int pipeline_kernel(void);
+extern int retired_kernel(void);
+extern int dedup_kernel(void);
+extern int class_masks_kernel(void);
+extern int bleach_sweep_kernel(void);
+extern int confusion_kernel(void);
+extern int thermometer_kernel(void);
+extern int sparse_kernel(void);
+extern int filter_parallel_kernel(void);
+int (*kernels[nr_kernels])(void) = {main_kernel1, print_kernel, early_exit_kernel, coalesced_kernel, pipeline_kernel, retired_kernel, dedup_kernel, class_masks_kernel, bleach_sweep_kernel, confusion_kernel, thermometer_kernel, sparse_kernel, filter_parallel_kernel};
 int main(void) { 
     // Kernel
-    return main_kernel1();
-    // return kernels[DPU_INPUT_ARGUMENTS.kernel](); 
+    return kernels[DPU_INPUT_ARGUMENTS.kernel](); 
 }
 
 
@@ -78,7 +139,8 @@ int main_kernel1() {
     uint32_t input_transfer_size_dpu_bytes = DPU_INPUT_ARGUMENTS.input_transfer_size_bytes; // Transfer input size per DPU in bytes
     uint32_t nr_inputs = DPU_INPUT_ARGUMENTS.nr_inputs; // Number of inputs per DPU
 
-    dpu_model_params_t model_params = DPU_INPUT_ARGUMENTS.model_params;
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
 
 #if PRINT
     printf("model size: %u bytes\n", model_size_dpu_bytes);
@@ -87,12 +149,12 @@ int main_kernel1() {
     printf("model params: %u %u %u %u %u %u\n", model_params.num_classes, model_params.num_filters, model_params.filter_inputs, model_params.filter_entries, model_params.filter_hashes, model_params.bleach);
 #endif
 
-    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER);
-    uint32_t mram_base_addr_inputs = (uint32_t) (mram_base_addr_model + model_size_dpu_bytes);
+    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
     uint32_t mram_base_addr_predictions = (uint32_t) (mram_base_addr_inputs + input_transfer_size_dpu_bytes);
 
-    // Each tasklet only needs to store one filter element in mram
-    uint32_t* filter_buffer = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(sizeof(*filter_buffer)));
+    // Each tasklet only needs to store one MRAM line (holding the probed filter element) in wram
+    uint8_t* filter_buffer = (uint8_t*) mem_alloc(8);
     // Each tasklet needs to store the hashes for a single sample for now
     uint32_t* hashes_buffer = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
 
@@ -118,24 +180,7 @@ int main_kernel1() {
 
                 // (filter_reduction(filter_buffer, filter_hashes, model_params.filter_hashes)
 
-                uint32_t min = -1;
-                for(size_t hash_it = 0; hash_it < model_params.filter_hashes; ++hash_it) {
-                    uint32_t hash = hashes_filter_buffer[hash_it];
-
-                    uint32_t model_entry_addr = MODEL_ENTRY_ADDR(model_params, mram_base_addr_model, discriminator_it, filter_it, hash);
-                    uint32_t aligned_addr = ROUND_DOWN_TO_MULTIPLE_OF_8(model_entry_addr);
-                    uint32_t offset = (model_entry_addr - aligned_addr) / sizeof(*filter_buffer);
-                    
-                    mram_read(aligned_addr, filter_buffer, ROUND_UP_TO_MULTIPLE_OF_8(sizeof(*filter_buffer)));
-// #if PRINT
-//                     printf("%u. Hash %u: %u\n", tasklet_id, hash_it, hash);
-//                     printf("%u. Model entry address: %u (%u)\n", tasklet_id, aligned_addr, offset);
-//                     printf("%u. Model entry: %u (%u)\n", tasklet_id, filter_buffer[offset], filter_buffer[1-offset]);
-// #endif
-                    uint32_t entry = filter_buffer[offset];
-                    if(entry <= min) min = entry;
-                }
-
+                uint32_t min = filter_min_entry(hashes_filter_buffer, filter_buffer, &model_params, mram_base_addr_model, discriminator_it, filter_it);
                 popcounts[discriminator_it] += (min >= model_params.bleach);
             }
         }
@@ -167,6 +212,1058 @@ int main_kernel1() {
     return 0;
 }
 
+// early_exit_kernel: same predictions as main_kernel1 with fewer probes.
+// A filter stops probing at the first entry below the bleach (its minimum can only be lower), and a
+// discriminator stops once its popcount cannot reach the leader's even if all remaining filters respond.
+int early_exit_kernel() {
+    unsigned int tasklet_id = me();
+#if PRINT
+    printf("tasklet_id = %u\n", tasklet_id);
+#endif
+    if (tasklet_id == 0) { 
+        mem_reset(); // Reset the heap
+#ifdef CYCLES
+        perfcounter_config(COUNT_CYCLES, true); // Initialize once the cycle counter
+#elif INSTRUCTIONS
+        perfcounter_config(COUNT_INSTRUCTIONS, true); // Initialize once the instruction counter
+#endif
+    }
+
+    // Barrier
+    barrier_wait(&my_barrier);
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    perfcounter_count count;
+    dpu_results_t *result = &DPU_RESULTS[tasklet_id];
+    result->count = 0;
+    counter_start(&count); // START TIMER
+#endif
+    dpu_probe_stats_t *probe_stats = &DPU_PROBE_STATS[tasklet_id];
+    probe_stats->probes = 0;
+    probe_stats->skipped_probes = 0;
+
+    uint32_t model_size_dpu_bytes = DPU_INPUT_ARGUMENTS.model_size_bytes;
+    uint32_t input_transfer_size_dpu_bytes = DPU_INPUT_ARGUMENTS.input_transfer_size_bytes;
+    uint32_t nr_inputs = DPU_INPUT_ARGUMENTS.nr_inputs;
+
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
+
+    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
+    uint32_t mram_base_addr_predictions = (uint32_t) (mram_base_addr_inputs + input_transfer_size_dpu_bytes);
+
+    uint8_t* filter_buffer = (uint8_t*) mem_alloc(8);
+    uint32_t* hashes_buffer = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
+
+    const uint32_t probes_per_sample = model_params.num_classes * model_params.num_filters * model_params.filter_hashes;
+
+    for(unsigned int sample_it = tasklet_id; sample_it < nr_inputs; sample_it += NR_TASKLETS) {
+
+        mram_read(HASHES_SAMPLE_ADDR(model_params, mram_base_addr_inputs, sample_it), hashes_buffer, ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
+
+        uint32_t probes = 0;
+        uint32_t max_pcount = 0;
+        uint64_t argmax_pcount = 0;
+        for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) {
+            uint32_t popcount = 0;
+            for(unsigned int filter_it = 0; filter_it < model_params.num_filters; ++filter_it) {
+                // Ties go to the last discriminator, so it is only hopeless below the leader
+                if(popcount + (model_params.num_filters - filter_it) < max_pcount)
+                    break;
+
+                uint32_t* hashes_filter_buffer = HASHES_FILTER_PTR(model_params, hashes_buffer, filter_it);
+                uint32_t response = 1;
+                for(size_t hash_it = 0; hash_it < model_params.filter_hashes; ++hash_it) {
+                    uint32_t model_entry_addr = MODEL_ENTRY_ADDR(model_params, mram_base_addr_model, discriminator_it, filter_it, hashes_filter_buffer[hash_it]);
+                    uint32_t aligned_addr = ROUND_DOWN_TO_MULTIPLE_OF_8(model_entry_addr);
+
+                    mram_read(aligned_addr, filter_buffer, 8);
+                    probes++;
+
+                    if(model_entry_from_line(filter_buffer, model_entry_addr - aligned_addr, model_params.entry_bytes) < model_params.bleach) {
+                        response = 0;
+                        break;
+                    }
+                }
+                popcount += response;
+            }
+#if PRINT
+            printf("%u. Popcount %u: %u\n", tasklet_id, discriminator_it, popcount);
+#endif
+            if(popcount >= max_pcount) {
+                max_pcount = popcount;
+                argmax_pcount = discriminator_it;
+            }
+        }
+        mram_write(&argmax_pcount, PREDICTION_ADDR(model_params, mram_base_addr_predictions, sample_it), sizeof(argmax_pcount));
+
+        probe_stats->probes += probes;
+        probe_stats->skipped_probes += probes_per_sample - probes;
+    }
+
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    result->count += counter_stop(&count); // STOP TIMER
+#endif
+	
+    return 0;
+}
+
+// A probe key packs the hashed entry index (upper 24 bits) with the probe index in the batch (lower 8 bits),
+// so that sorting keys sorts probes by MRAM address within a filter
+#define PROBE_KEY(entry, probe) (((entry) << 8) | (probe))
+#define PROBE_KEY_ENTRY(key) ((key) >> 8)
+#define PROBE_KEY_PROBE(key) ((key) & 0xff)
+
+static void sort_probe_keys(uint32_t* keys, uint32_t len) {
+    for(uint32_t i = 1; i < len; ++i) {
+        uint32_t key = keys[i];
+        uint32_t j = i;
+        for(; j > 0 && keys[j - 1] > key; --j)
+            keys[j] = keys[j - 1];
+        keys[j] = key;
+    }
+}
+
+// coalesced_kernel: each tasklet processes probe_batch samples at once. For every filter, the probes of
+// all samples of the batch are sorted by entry, and each MRAM window of COALESCE_WINDOW_B bytes holding 
+// at least one probed entry is fetched with a single DMA, for every discriminator.
+int coalesced_kernel() {
+    unsigned int tasklet_id = me();
+#if PRINT
+    printf("tasklet_id = %u\n", tasklet_id);
+#endif
+    if (tasklet_id == 0) { 
+        mem_reset(); // Reset the heap
+#ifdef CYCLES
+        perfcounter_config(COUNT_CYCLES, true); // Initialize once the cycle counter
+#elif INSTRUCTIONS
+        perfcounter_config(COUNT_INSTRUCTIONS, true); // Initialize once the instruction counter
+#endif
+    }
+
+    // Barrier
+    barrier_wait(&my_barrier);
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    perfcounter_count count;
+    dpu_results_t *result = &DPU_RESULTS[tasklet_id];
+    result->count = 0;
+    counter_start(&count); // START TIMER
+#endif
+    dpu_probe_stats_t *probe_stats = &DPU_PROBE_STATS[tasklet_id];
+    probe_stats->probes = 0;
+    probe_stats->skipped_probes = 0;
+
+    uint32_t model_size_dpu_bytes = DPU_INPUT_ARGUMENTS.model_size_bytes;
+    uint32_t input_transfer_size_dpu_bytes = DPU_INPUT_ARGUMENTS.input_transfer_size_bytes;
+    uint32_t nr_inputs = DPU_INPUT_ARGUMENTS.nr_inputs;
+    uint32_t probe_batch = DPU_INPUT_ARGUMENTS.probe_batch;
+
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
+    const uint32_t entry_bytes = model_params.entry_bytes;
+    const uint32_t filter_hashes = model_params.filter_hashes;
+
+    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
+    uint32_t mram_base_addr_predictions = (uint32_t) (mram_base_addr_inputs + input_transfer_size_dpu_bytes);
+
+    const uint32_t hashes_block_b = ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params));
+    uint8_t* window_buffer = (uint8_t*) mem_alloc(COALESCE_WINDOW_B);
+    uint8_t* hashes_buffer = (uint8_t*) mem_alloc(probe_batch * hashes_block_b);
+    uint32_t* keys = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(probe_batch * filter_hashes * sizeof(uint32_t)));
+    uint32_t* mins = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(probe_batch * sizeof(uint32_t)));
+    uint32_t* popcounts = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(probe_batch * model_params.num_classes * sizeof(uint32_t)));
+
+    for(unsigned int batch_start = tasklet_id * probe_batch; batch_start < nr_inputs; batch_start += NR_TASKLETS * probe_batch) {
+        uint32_t batch_size = nr_inputs - batch_start < probe_batch ? nr_inputs - batch_start : probe_batch;
+        uint32_t num_probes = batch_size * filter_hashes;
+
+        for(uint32_t batch_it = 0; batch_it < batch_size; ++batch_it)
+            mram_read(HASHES_SAMPLE_ADDR(model_params, mram_base_addr_inputs, batch_start + batch_it), hashes_buffer + batch_it * hashes_block_b, hashes_block_b);
+
+        for(uint32_t it = 0; it < batch_size * model_params.num_classes; ++it)
+            popcounts[it] = 0;
+
+        for(unsigned int filter_it = 0; filter_it < model_params.num_filters; ++filter_it) {
+            // The hashes of a filter are the same for every discriminator: sort them once
+            for(uint32_t batch_it = 0; batch_it < batch_size; ++batch_it) {
+                uint32_t* hashes_filter_buffer = HASHES_FILTER_PTR(model_params, (uint32_t*) (hashes_buffer + batch_it * hashes_block_b), filter_it);
+                for(uint32_t hash_it = 0; hash_it < filter_hashes; ++hash_it)
+                    keys[batch_it * filter_hashes + hash_it] = PROBE_KEY(hashes_filter_buffer[hash_it], batch_it * filter_hashes + hash_it);
+            }
+            sort_probe_keys(keys, num_probes);
+
+            for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) {
+                uint32_t filter_addr = MODEL_FILTER_ADDR(model_params, mram_base_addr_model, discriminator_it, filter_it);
+
+                for(uint32_t batch_it = 0; batch_it < batch_size; ++batch_it)
+                    mins[batch_it] = -1;
+
+                uint32_t probe_it = 0;
+                while(probe_it < num_probes) {
+                    uint32_t window_addr = ROUND_DOWN_TO_MULTIPLE_OF_8(filter_addr + PROBE_KEY_ENTRY(keys[probe_it]) * entry_bytes);
+
+                    // Extend the window over all sorted probes it covers
+                    uint32_t window_end = probe_it;
+                    uint32_t last_addr = window_addr;
+                    while(window_end < num_probes) {
+                        uint32_t addr = filter_addr + PROBE_KEY_ENTRY(keys[window_end]) * entry_bytes;
+                        if(addr + entry_bytes > window_addr + COALESCE_WINDOW_B) break;
+                        last_addr = addr;
+                        window_end++;
+                    }
+
+                    mram_read(window_addr, window_buffer, ROUND_UP_TO_MULTIPLE_OF_8(last_addr + entry_bytes - window_addr));
+                    probe_stats->probes++;
+
+                    for(; probe_it < window_end; ++probe_it) {
+                        uint32_t addr = filter_addr + PROBE_KEY_ENTRY(keys[probe_it]) * entry_bytes;
+                        uint32_t entry = model_entry_from_line(window_buffer, addr - window_addr, entry_bytes);
+                        uint32_t batch_it = PROBE_KEY_PROBE(keys[probe_it]) / filter_hashes;
+                        if(entry <= mins[batch_it]) mins[batch_it] = entry;
+                    }
+                }
+                probe_stats->skipped_probes += num_probes;
+
+                for(uint32_t batch_it = 0; batch_it < batch_size; ++batch_it)
+                    popcounts[batch_it * model_params.num_classes + discriminator_it] += (mins[batch_it] >= model_params.bleach);
+            }
+        }
+
+        for(uint32_t batch_it = 0; batch_it < batch_size; ++batch_it) {
+            uint32_t max_pcount = 0;
+            uint64_t argmax_pcount = 0;
+            for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) {
+                if(popcounts[batch_it * model_params.num_classes + discriminator_it] >= max_pcount) {
+                    max_pcount = popcounts[batch_it * model_params.num_classes + discriminator_it];
+                    argmax_pcount = discriminator_it;
+                }
+            }
+            mram_write(&argmax_pcount, PREDICTION_ADDR(model_params, mram_base_addr_predictions, batch_start + batch_it), sizeof(argmax_pcount));
+        }
+    }
+    // Probes that were served by a DMA of another probe
+    probe_stats->skipped_probes -= probe_stats->probes;
+
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    result->count += counter_stop(&count); // STOP TIMER
+#endif
+	
+    return 0;
+}
+
+// Reads size bytes from MRAM in DMAs of at most MRAM_READ_MAX_B bytes (size is a multiple of 8)
+static void mram_read_large(uint32_t addr, uint8_t* buffer, uint32_t size) {
+    for(uint32_t offset = 0; offset < size; offset += MRAM_READ_MAX_B)
+        mram_read(addr + offset, buffer + offset, size - offset < MRAM_READ_MAX_B ? size - offset : MRAM_READ_MAX_B);
+}
+
+// H3 hashes of every filter chunk of a reordered binarized input, of shape (#Filters, #FilterHashes)
+static void hash_input(uint32_t* hashes, uint8_t* input, uint32_t* hash_parameters, dpu_model_params_t* p) {
+    uint8_t* chunk = input;
+    for(uint32_t filter_it = 0; filter_it < p->num_filters; ++filter_it) {
+        for(uint32_t hash_it = 0; hash_it < p->filter_hashes; ++hash_it) {
+            uint32_t* parameters = hash_parameters + hash_it * p->filter_inputs;
+            uint32_t result = 0;
+            for(uint32_t input_it = 0; input_it < p->filter_inputs; ++input_it)
+                if(chunk[input_it]) result ^= parameters[input_it];
+            *HASHES_ENTRY_PTR(*p, hashes, filter_it, hash_it) = result;
+        }
+        chunk += p->filter_inputs;
+    }
+}
+
+// kernel_pipeline ring: a slot goes FREE -> HASHING -> FULL -> PROBING -> FREE.
+// ring_free and ring_full count the slots that are FREE and FULL and not yet claimed.
+#define SLOT_FREE 0
+#define SLOT_HASHING 1
+#define SLOT_FULL 2
+#define SLOT_PROBING 3
+
+SEMAPHORE_INIT(ring_free, 0);
+SEMAPHORE_INIT(ring_full, 0);
+MUTEX_INIT(ring_mutex);
+uint8_t ring_state[PIPELINE_MAX_SLOTS];
+uint32_t ring_sample[PIPELINE_MAX_SLOTS];
+uint32_t* ring_hashes;
+uint32_t ring_claimed; // Samples claimed by probing tasklets
+
+// Claims a slot in state from (the caller holds a semaphore token guaranteeing one exists)
+static uint32_t ring_acquire(uint8_t from, uint8_t to) {
+    mutex_lock(ring_mutex);
+    uint32_t slot = 0;
+    while(ring_state[slot] != from) slot++;
+    ring_state[slot] = to;
+    mutex_unlock(ring_mutex);
+    return slot;
+}
+
+static void ring_release(uint32_t slot, uint8_t to) {
+    mutex_lock(ring_mutex);
+    ring_state[slot] = to;
+    mutex_unlock(ring_mutex);
+}
+
+// pipeline_kernel: the first hash_tasklets tasklets hash reordered inputs into a WRAM ring of ring_slots slots,
+// the other tasklets probe the filters of hashed samples as soon as they are ready, then reduce them to a prediction.
+int pipeline_kernel() {
+    unsigned int tasklet_id = me();
+
+    uint32_t model_size_dpu_bytes = DPU_INPUT_ARGUMENTS.model_size_bytes;
+    uint32_t input_transfer_size_dpu_bytes = DPU_INPUT_ARGUMENTS.input_transfer_size_bytes;
+    uint32_t nr_inputs = DPU_INPUT_ARGUMENTS.nr_inputs;
+    uint32_t input_sample_bytes = DPU_INPUT_ARGUMENTS.input_sample_bytes;
+    uint32_t hash_tasklets = DPU_INPUT_ARGUMENTS.hash_tasklets;
+    uint32_t ring_slots = DPU_INPUT_ARGUMENTS.ring_slots;
+
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
+    const uint32_t hashes_block_b = ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params));
+
+    if (tasklet_id == 0) { 
+        mem_reset(); // Reset the heap
+#ifdef CYCLES
+        perfcounter_config(COUNT_CYCLES, true); // Initialize once the cycle counter
+#elif INSTRUCTIONS
+        perfcounter_config(COUNT_INSTRUCTIONS, true); // Initialize once the instruction counter
+#else
+        perfcounter_config(COUNT_CYCLES, true); // Stage occupancy is measured in cycles
+#endif
+        ring_hashes = (uint32_t*) mem_alloc(ring_slots * hashes_block_b);
+        ring_claimed = 0;
+        for(uint32_t slot = 0; slot < ring_slots; ++slot) {
+            ring_state[slot] = SLOT_FREE;
+            sem_give(&ring_free);
+        }
+    }
+
+    // Barrier
+    barrier_wait(&my_barrier);
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    perfcounter_count count;
+    dpu_results_t *result = &DPU_RESULTS[tasklet_id];
+    result->count = 0;
+    counter_start(&count); // START TIMER
+#endif
+    dpu_stage_stats_t *stage_stats = &DPU_STAGE_STATS[tasklet_id];
+    stage_stats->role = tasklet_id < hash_tasklets ? PIPELINE_ROLE_HASH : PIPELINE_ROLE_PROBE;
+    stage_stats->items = 0;
+    stage_stats->busy = 0;
+    stage_stats->wait = 0;
+
+    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
+    uint32_t mram_base_addr_predictions = (uint32_t) (mram_base_addr_inputs + input_transfer_size_dpu_bytes);
+
+    perfcounter_t stage_start = perfcounter_get();
+    if(tasklet_id < hash_tasklets) {
+        uint8_t* input_buffer = (uint8_t*) mem_alloc(input_sample_bytes);
+
+        for(unsigned int sample_it = tasklet_id; sample_it < nr_inputs; sample_it += hash_tasklets) {
+            mram_read_large(INPUT_SAMPLE_ADDR(mram_base_addr_inputs, input_sample_bytes, sample_it), input_buffer, input_sample_bytes);
+
+            perfcounter_t wait_start = perfcounter_get();
+            sem_take(&ring_free);
+            uint32_t slot = ring_acquire(SLOT_FREE, SLOT_HASHING);
+            stage_stats->wait += perfcounter_get() - wait_start;
+
+            hash_input((uint32_t*) ((uint8_t*) ring_hashes + slot * hashes_block_b), input_buffer, DPU_HASH_PARAMETERS + model_entry->hash_parameters_offset, &model_params);
+            ring_sample[slot] = sample_it;
+
+            ring_release(slot, SLOT_FULL);
+            sem_give(&ring_full);
+            stage_stats->items++;
+        }
+    } else {
+        uint8_t* filter_buffer = (uint8_t*) mem_alloc(8);
+        uint32_t* popcounts = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(sizeof(uint32_t) * model_params.num_classes));
+
+        while(1) {
+            // Claim one of the nr_inputs samples before waiting, so that every token taken is given
+            mutex_lock(ring_mutex);
+            uint32_t claimed = ring_claimed < nr_inputs;
+            ring_claimed += claimed;
+            mutex_unlock(ring_mutex);
+            if(!claimed) break;
+
+            perfcounter_t wait_start = perfcounter_get();
+            sem_take(&ring_full);
+            uint32_t slot = ring_acquire(SLOT_FULL, SLOT_PROBING);
+            stage_stats->wait += perfcounter_get() - wait_start;
+
+            uint32_t* hashes_buffer = (uint32_t*) ((uint8_t*) ring_hashes + slot * hashes_block_b);
+            uint32_t sample_it = ring_sample[slot];
+
+            for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) 
+                popcounts[discriminator_it] = 0;
+
+            for(unsigned int filter_it = 0; filter_it < model_params.num_filters; ++filter_it) {
+                uint32_t* hashes_filter_buffer = HASHES_FILTER_PTR(model_params, hashes_buffer, filter_it);
+                for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) {
+                    uint32_t min = filter_min_entry(hashes_filter_buffer, filter_buffer, &model_params, mram_base_addr_model, discriminator_it, filter_it);
+                    popcounts[discriminator_it] += (min >= model_params.bleach);
+                }
+            }
+
+            ring_release(slot, SLOT_FREE);
+            sem_give(&ring_free);
+
+            uint64_t argmax_pcount = argmax_popcounts(popcounts, model_params.num_classes);
+            mram_write(&argmax_pcount, PREDICTION_ADDR(model_params, mram_base_addr_predictions, sample_it), sizeof(argmax_pcount));
+            stage_stats->items++;
+        }
+    }
+    stage_stats->busy = perfcounter_get() - stage_start - stage_stats->wait;
+
+    // Leave the semaphores empty for the next launch
+    barrier_wait(&my_barrier);
+    if(tasklet_id == 0) {
+        for(uint32_t slot = 0; slot < ring_slots; ++slot)
+            sem_take(&ring_free);
+    }
+
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    result->count += counter_stop(&count); // STOP TIMER
+#endif
+	
+    return 0;
+}
+
+// retired_kernel: slot of a kernel id the binary no longer implements (see KERNEL_VALID). The host rejects these ids,
+// a launch with one only returns a nonzero status without touching MRAM.
+int retired_kernel() {
+    return 1;
+}
+
+// Prediction of a sample from its hashes in WRAM (as main_kernel1). Unless NULL, minima gets the histogram of the
+// filter minima of each class, of shape (#Classes, SWEEP_BLEACH_VALUES) (kernel_bleach_sweep).
+static uint64_t predict_hashed_sample(uint32_t* hashes_buffer, uint8_t* filter_buffer, uint32_t* popcounts, uint8_t* minima, dpu_model_params_t* p, uint32_t mram_base_addr_model) {
+    for(unsigned int discriminator_it = 0; discriminator_it < p->num_classes; ++discriminator_it) 
+        popcounts[discriminator_it] = 0;
+    if(minima != NULL)
+        for(unsigned int it = 0; it < p->num_classes * SWEEP_BLEACH_VALUES; ++it)
+            minima[it] = 0;
+
+    for(unsigned int filter_it = 0; filter_it < p->num_filters; ++filter_it) {
+        uint32_t* hashes_filter_buffer = HASHES_FILTER_PTR(*p, hashes_buffer, filter_it);
+        for(unsigned int discriminator_it = 0; discriminator_it < p->num_classes; ++discriminator_it) {
+            uint32_t min = filter_min_entry(hashes_filter_buffer, filter_buffer, p, mram_base_addr_model, discriminator_it, filter_it);
+            popcounts[discriminator_it] += (min >= p->bleach);
+            // Minima past the sweep respond at every swept bleach
+            if(minima != NULL)
+                ++minima[discriminator_it * SWEEP_BLEACH_VALUES + (min < SWEEP_BLEACH_VALUES - 1 ? min : SWEEP_BLEACH_VALUES - 1)];
+        }
+    }
+
+    return argmax_popcounts(popcounts, p->num_classes);
+}
+
+// dedup_kernel: the host sends the unique (filter, hash tuple) records of the batch of the DPU and, for each
+// sample, the index of the record of each filter. Each record is evaluated once for all classes into a class
+// mask written over its filter id, then a sample only gathers one mask per filter.
+int dedup_kernel() {
+    unsigned int tasklet_id = me();
+#if PRINT
+    printf("tasklet_id = %u\n", tasklet_id);
+#endif
+    if (tasklet_id == 0) { 
+        mem_reset(); // Reset the heap
+#ifdef CYCLES
+        perfcounter_config(COUNT_CYCLES, true); // Initialize once the cycle counter
+#elif INSTRUCTIONS
+        perfcounter_config(COUNT_INSTRUCTIONS, true); // Initialize once the instruction counter
+#endif
+    }
+
+    // Barrier
+    barrier_wait(&my_barrier);
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    perfcounter_count count;
+    dpu_results_t *result = &DPU_RESULTS[tasklet_id];
+    result->count = 0;
+    counter_start(&count); // START TIMER
+#endif
+
+    uint32_t model_size_dpu_bytes = DPU_INPUT_ARGUMENTS.model_size_bytes;
+    uint32_t input_transfer_size_dpu_bytes = DPU_INPUT_ARGUMENTS.input_transfer_size_bytes;
+    uint32_t nr_inputs = DPU_INPUT_ARGUMENTS.nr_inputs;
+    uint32_t nr_records = DPU_INPUT_ARGUMENTS.dedup_records;
+
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
+
+    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
+    uint32_t mram_base_addr_records = mram_base_addr_inputs + DPU_INPUT_ARGUMENTS.dedup_records_offset;
+    uint32_t mram_base_addr_predictions = (uint32_t) (mram_base_addr_inputs + input_transfer_size_dpu_bytes);
+
+    const uint32_t record_size_b = DEDUP_RECORD_SIZE_B(model_params);
+    const uint32_t index_size_b = DEDUP_INDEX_SIZE_B(model_params);
+
+    uint8_t* filter_buffer = (uint8_t*) mem_alloc(8);
+    uint32_t* record_buffer = (uint32_t*) mem_alloc(record_size_b);
+    uint32_t* index_buffer = (uint32_t*) mem_alloc(index_size_b);
+    uint32_t* popcounts = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(sizeof(uint32_t) * model_params.num_classes));
+
+    // Class masks of the records
+    for(unsigned int record_it = tasklet_id; record_it < nr_records; record_it += NR_TASKLETS) {
+        uint32_t record_addr = mram_base_addr_records + record_it * record_size_b;
+        mram_read(record_addr, record_buffer, record_size_b);
+
+        uint32_t filter_it = record_buffer[0];
+        uint32_t mask = 0;
+        for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) {
+            uint32_t min = filter_min_entry(record_buffer + 1, filter_buffer, &model_params, mram_base_addr_model, discriminator_it, filter_it);
+            mask |= (uint32_t) (min >= model_params.bleach) << discriminator_it;
+        }
+
+        record_buffer[0] = mask;
+        mram_write(record_buffer, record_addr, 8);
+    }
+
+    // Every mask is written before any sample gathers them
+    barrier_wait(&my_barrier);
+
+    for(unsigned int sample_it = tasklet_id; sample_it < nr_inputs; sample_it += NR_TASKLETS) {
+        mram_read_large(mram_base_addr_inputs + sample_it * index_size_b, (uint8_t*) index_buffer, index_size_b);
+
+        for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) 
+            popcounts[discriminator_it] = 0;
+
+        for(unsigned int filter_it = 0; filter_it < model_params.num_filters; ++filter_it) {
+            mram_read(mram_base_addr_records + index_buffer[filter_it] * record_size_b, filter_buffer, 8);
+            for(uint32_t mask = ((uint32_t*) filter_buffer)[0]; mask != 0; mask &= mask - 1)
+                ++popcounts[__builtin_ctz(mask)];
+        }
+
+        uint64_t argmax_pcount = argmax_popcounts(popcounts, model_params.num_classes);
+        mram_write(&argmax_pcount, PREDICTION_ADDR(model_params, mram_base_addr_predictions, sample_it), sizeof(argmax_pcount));
+    }
+
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    result->count += counter_stop(&count); // STOP TIMER
+#endif
+	
+    return 0;
+}
+
+// class_masks_kernel: same predictions as main_kernel1 from the class masks of the model. The response of a
+// filter for all classes is the AND of the masks of its hashes, so it costs filter_hashes probes instead of
+// num_classes * filter_hashes. Responses are summed in bit-sliced counters (bit c of plane k is bit k of the
+// popcount of class c).
+int class_masks_kernel() {
+    unsigned int tasklet_id = me();
+#if PRINT
+    printf("tasklet_id = %u\n", tasklet_id);
+#endif
+    if (tasklet_id == 0) { 
+        mem_reset(); // Reset the heap
+#ifdef CYCLES
+        perfcounter_config(COUNT_CYCLES, true); // Initialize once the cycle counter
+#elif INSTRUCTIONS
+        perfcounter_config(COUNT_INSTRUCTIONS, true); // Initialize once the instruction counter
+#endif
+    }
+
+    // Barrier
+    barrier_wait(&my_barrier);
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    perfcounter_count count;
+    dpu_results_t *result = &DPU_RESULTS[tasklet_id];
+    result->count = 0;
+    counter_start(&count); // START TIMER
+#endif
+
+    uint32_t model_size_dpu_bytes = DPU_INPUT_ARGUMENTS.model_size_bytes;
+    uint32_t input_transfer_size_dpu_bytes = DPU_INPUT_ARGUMENTS.input_transfer_size_bytes;
+    uint32_t nr_inputs = DPU_INPUT_ARGUMENTS.nr_inputs;
+
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
+    uint32_t mask_bytes = model_entry->mask_bytes;
+
+    uint32_t mram_base_addr_masks = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->masks_offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
+    uint32_t mram_base_addr_predictions = (uint32_t) (mram_base_addr_inputs + input_transfer_size_dpu_bytes);
+
+    uint8_t* mask_buffer = (uint8_t*) mem_alloc(8);
+    uint32_t* hashes_buffer = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
+    uint32_t* planes = (uint32_t*) mem_alloc(MASK_MAX_PLANES * sizeof(uint32_t));
+
+    for(unsigned int sample_it = tasklet_id; sample_it < nr_inputs; sample_it += NR_TASKLETS) {
+
+        mram_read(HASHES_SAMPLE_ADDR(model_params, mram_base_addr_inputs, sample_it), hashes_buffer, ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
+
+        uint32_t num_planes = 0;
+        for(unsigned int filter_it = 0; filter_it < model_params.num_filters; ++filter_it) {
+            uint32_t* hashes_filter_buffer = HASHES_FILTER_PTR(model_params, hashes_buffer, filter_it);
+
+            uint32_t responses = -1;
+            for(size_t hash_it = 0; hash_it < model_params.filter_hashes; ++hash_it) {
+                uint32_t mask_addr = MASK_ENTRY_ADDR(model_params, mram_base_addr_masks, mask_bytes, filter_it, hashes_filter_buffer[hash_it]);
+                uint32_t aligned_addr = ROUND_DOWN_TO_MULTIPLE_OF_8(mask_addr);
+
+                mram_read(aligned_addr, mask_buffer, 8);
+                responses &= model_entry_from_line(mask_buffer, mask_addr - aligned_addr, mask_bytes);
+            }
+
+            // Ripple-carry addition of one bit per class
+            for(uint32_t plane_it = 0; responses != 0; ++plane_it) {
+                if(plane_it == num_planes) planes[num_planes++] = 0;
+                uint32_t carry = planes[plane_it] & responses;
+                planes[plane_it] ^= responses;
+                responses = carry;
+            }
+        }
+
+        uint32_t max_pcount = 0;
+        uint64_t argmax_pcount = 0;
+        for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) {
+            uint32_t pcount = 0;
+            for(uint32_t plane_it = 0; plane_it < num_planes; ++plane_it)
+                pcount |= ((planes[plane_it] >> discriminator_it) & 1) << plane_it;
+
+            if(pcount >= max_pcount) {
+                max_pcount = pcount;
+                argmax_pcount = discriminator_it;
+            }
+        }
+        mram_write(&argmax_pcount, PREDICTION_ADDR(model_params, mram_base_addr_predictions, sample_it), sizeof(argmax_pcount));
+    }
+
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    result->count += counter_stop(&count); // STOP TIMER
+#endif
+	
+    return 0;
+}
+
+// bleach_sweep_kernel: predictions at the bleach of the model as main_kernel1, and for labeled samples the number of
+// correct predictions at every bleach in [0; SWEEP_BLEACH_VALUES) from the same probes. Each filter minimum of
+// each class lands in a histogram; summing it from the top gives the popcounts of the class at every bleach.
+int bleach_sweep_kernel() {
+    unsigned int tasklet_id = me();
+#if PRINT
+    printf("tasklet_id = %u\n", tasklet_id);
+#endif
+    if (tasklet_id == 0) { 
+        mem_reset(); // Reset the heap
+#ifdef CYCLES
+        perfcounter_config(COUNT_CYCLES, true); // Initialize once the cycle counter
+#elif INSTRUCTIONS
+        perfcounter_config(COUNT_INSTRUCTIONS, true); // Initialize once the instruction counter
+#endif
+    }
+
+    // Barrier
+    barrier_wait(&my_barrier);
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    perfcounter_count count;
+    dpu_results_t *result = &DPU_RESULTS[tasklet_id];
+    result->count = 0;
+    counter_start(&count); // START TIMER
+#endif
+
+    uint32_t model_size_dpu_bytes = DPU_INPUT_ARGUMENTS.model_size_bytes;
+    uint32_t input_transfer_size_dpu_bytes = DPU_INPUT_ARGUMENTS.input_transfer_size_bytes;
+    uint32_t nr_inputs = DPU_INPUT_ARGUMENTS.nr_inputs;
+
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
+
+    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
+    uint32_t mram_base_addr_labels = mram_base_addr_inputs + DPU_INPUT_ARGUMENTS.labels_offset_bytes;
+    uint32_t mram_base_addr_predictions = (uint32_t) (mram_base_addr_inputs + input_transfer_size_dpu_bytes);
+
+    uint8_t* filter_buffer = (uint8_t*) mem_alloc(8);
+    uint8_t* label_buffer = (uint8_t*) mem_alloc(8);
+    uint32_t* hashes_buffer = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
+    uint32_t* popcounts = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(sizeof(uint32_t) * model_params.num_classes));
+    uint8_t* minima = (uint8_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(model_params.num_classes * SWEEP_BLEACH_VALUES)); // (#Classes, SWEEP_BLEACH_VALUES)
+
+    uint32_t* correct = DPU_BLEACH_SWEEP[tasklet_id];
+    for(unsigned int bleach_it = 0; bleach_it < SWEEP_BLEACH_VALUES; ++bleach_it)
+        correct[bleach_it] = 0;
+
+    for(unsigned int sample_it = tasklet_id; sample_it < nr_inputs; sample_it += NR_TASKLETS) {
+
+        mram_read(HASHES_SAMPLE_ADDR(model_params, mram_base_addr_inputs, sample_it), hashes_buffer, ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
+
+        uint64_t argmax_pcount = predict_hashed_sample(hashes_buffer, filter_buffer, popcounts, minima, &model_params, mram_base_addr_model);
+        mram_write(&argmax_pcount, PREDICTION_ADDR(model_params, mram_base_addr_predictions, sample_it), sizeof(argmax_pcount));
+
+        uint32_t label_addr = mram_base_addr_labels + sample_it;
+        mram_read(ROUND_DOWN_TO_MULTIPLE_OF_8(label_addr), label_buffer, 8);
+        uint32_t label = label_buffer[label_addr - ROUND_DOWN_TO_MULTIPLE_OF_8(label_addr)];
+
+        // Popcounts at bleach b: filters whose minimum is at least b, from the highest bleach down
+        for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) 
+            popcounts[discriminator_it] = 0;
+        for(int bleach_it = SWEEP_BLEACH_VALUES - 1; bleach_it >= 0; --bleach_it) {
+            for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it)
+                popcounts[discriminator_it] += minima[discriminator_it * SWEEP_BLEACH_VALUES + bleach_it];
+            correct[bleach_it] += (argmax_popcounts(popcounts, model_params.num_classes) == label);
+        }
+    }
+
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    result->count += counter_stop(&count); // STOP TIMER
+#endif
+	
+    return 0;
+}
+
+MUTEX_INIT(confusion_mutex);
+
+// confusion_kernel: evaluates labeled samples without sending their predictions back. Each tasklet counts
+// (label, prediction) pairs in its own matrix, then adds it to DPU_CONFUSION.
+int confusion_kernel() {
+    unsigned int tasklet_id = me();
+#if PRINT
+    printf("tasklet_id = %u\n", tasklet_id);
+#endif
+    if (tasklet_id == 0) { 
+        mem_reset(); // Reset the heap
+        for(unsigned int it = 0; it < CONFUSION_MAX_CLASSES * CONFUSION_MAX_CLASSES; ++it)
+            DPU_CONFUSION[it] = 0;
+#ifdef CYCLES
+        perfcounter_config(COUNT_CYCLES, true); // Initialize once the cycle counter
+#elif INSTRUCTIONS
+        perfcounter_config(COUNT_INSTRUCTIONS, true); // Initialize once the instruction counter
+#endif
+    }
+
+    // Barrier
+    barrier_wait(&my_barrier);
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    perfcounter_count count;
+    dpu_results_t *result = &DPU_RESULTS[tasklet_id];
+    result->count = 0;
+    counter_start(&count); // START TIMER
+#endif
+
+    uint32_t model_size_dpu_bytes = DPU_INPUT_ARGUMENTS.model_size_bytes;
+    uint32_t nr_inputs = DPU_INPUT_ARGUMENTS.nr_inputs;
+
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
+    const uint32_t num_classes = model_params.num_classes;
+
+    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
+    uint32_t mram_base_addr_labels = mram_base_addr_inputs + DPU_INPUT_ARGUMENTS.labels_offset_bytes;
+
+    uint8_t* filter_buffer = (uint8_t*) mem_alloc(8);
+    uint8_t* label_buffer = (uint8_t*) mem_alloc(8);
+    uint32_t* hashes_buffer = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
+    uint32_t* popcounts = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(sizeof(uint32_t) * num_classes));
+    uint32_t* confusion = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(sizeof(uint32_t) * num_classes * num_classes)); // (label, prediction)
+
+    for(unsigned int it = 0; it < num_classes * num_classes; ++it)
+        confusion[it] = 0;
+
+    for(unsigned int sample_it = tasklet_id; sample_it < nr_inputs; sample_it += NR_TASKLETS) {
+        mram_read(HASHES_SAMPLE_ADDR(model_params, mram_base_addr_inputs, sample_it), hashes_buffer, ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
+        uint64_t prediction = predict_hashed_sample(hashes_buffer, filter_buffer, popcounts, NULL, &model_params, mram_base_addr_model);
+
+        uint32_t label_addr = mram_base_addr_labels + sample_it;
+        mram_read(ROUND_DOWN_TO_MULTIPLE_OF_8(label_addr), label_buffer, 8);
+        uint32_t label = label_buffer[label_addr - ROUND_DOWN_TO_MULTIPLE_OF_8(label_addr)];
+
+        // Labels out of range are ignored rather than written out of the matrix
+        if(label < num_classes)
+            ++confusion[label * num_classes + prediction];
+    }
+
+    mutex_lock(confusion_mutex);
+    for(uint32_t label_it = 0; label_it < num_classes; ++label_it)
+        for(uint32_t prediction_it = 0; prediction_it < num_classes; ++prediction_it)
+            DPU_CONFUSION[label_it * CONFUSION_MAX_CLASSES + prediction_it] += confusion[label_it * num_classes + prediction_it];
+    mutex_unlock(confusion_mutex);
+
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    result->count += counter_stop(&count); // STOP TIMER
+#endif
+	
+    return 0;
+}
+
+// thermometer_kernel: evaluates raw 8-bit samples. The inputs of the model are binarized and reordered on the fly
+// from the thermometer table (see dpu_thermometer_input_t), read in blocks of whole filters, then hashed.
+int thermometer_kernel() {
+    unsigned int tasklet_id = me();
+#if PRINT
+    printf("tasklet_id = %u\n", tasklet_id);
+#endif
+    if (tasklet_id == 0) { 
+        mem_reset(); // Reset the heap
+#ifdef CYCLES
+        perfcounter_config(COUNT_CYCLES, true); // Initialize once the cycle counter
+#elif INSTRUCTIONS
+        perfcounter_config(COUNT_INSTRUCTIONS, true); // Initialize once the instruction counter
+#endif
+    }
+
+    // Barrier
+    barrier_wait(&my_barrier);
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    perfcounter_count count;
+    dpu_results_t *result = &DPU_RESULTS[tasklet_id];
+    result->count = 0;
+    counter_start(&count); // START TIMER
+#endif
+
+    uint32_t model_size_dpu_bytes = DPU_INPUT_ARGUMENTS.model_size_bytes;
+    uint32_t input_transfer_size_dpu_bytes = DPU_INPUT_ARGUMENTS.input_transfer_size_bytes;
+    uint32_t input_sample_bytes = DPU_INPUT_ARGUMENTS.input_sample_bytes;
+    uint32_t nr_inputs = DPU_INPUT_ARGUMENTS.nr_inputs;
+
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
+    uint32_t* hash_parameters = DPU_HASH_PARAMETERS + model_entry->hash_parameters_offset;
+    const uint32_t filter_inputs = model_params.filter_inputs;
+
+    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->offset_bytes;
+    uint32_t mram_base_addr_table = (uint32_t) (DPU_MRAM_HEAP_POINTER) + DPU_INPUT_ARGUMENTS.thermometer_offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
+    uint32_t mram_base_addr_predictions = (uint32_t) (mram_base_addr_inputs + input_transfer_size_dpu_bytes);
+
+    // A block of the table may start 4 bytes past an 8-byte boundary
+    const uint32_t filters_per_block = (THERMOMETER_BLOCK_B - 8) / (filter_inputs * sizeof(dpu_thermometer_input_t));
+
+    uint8_t* filter_buffer = (uint8_t*) mem_alloc(8);
+    uint8_t* pixels = (uint8_t*) mem_alloc(input_sample_bytes);
+    uint8_t* table_buffer = (uint8_t*) mem_alloc(THERMOMETER_BLOCK_B);
+    uint32_t* hashes_buffer = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
+    uint32_t* popcounts = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(sizeof(uint32_t) * model_params.num_classes));
+
+    for(unsigned int sample_it = tasklet_id; sample_it < nr_inputs; sample_it += NR_TASKLETS) {
+        mram_read_large(INPUT_SAMPLE_ADDR(mram_base_addr_inputs, input_sample_bytes, sample_it), pixels, input_sample_bytes);
+
+        for(uint32_t block_filter = 0; block_filter < model_params.num_filters; block_filter += filters_per_block) {
+            uint32_t block_filters = model_params.num_filters - block_filter < filters_per_block ? model_params.num_filters - block_filter : filters_per_block;
+            uint32_t block_addr = mram_base_addr_table + block_filter * filter_inputs * sizeof(dpu_thermometer_input_t);
+            uint32_t aligned_addr = ROUND_DOWN_TO_MULTIPLE_OF_8(block_addr);
+            mram_read(aligned_addr, table_buffer, ROUND_UP_TO_MULTIPLE_OF_8(block_addr - aligned_addr + block_filters * filter_inputs * sizeof(dpu_thermometer_input_t)));
+            dpu_thermometer_input_t* inputs = (dpu_thermometer_input_t*) (table_buffer + (block_addr - aligned_addr));
+
+            for(uint32_t filter_it = block_filter; filter_it < block_filter + block_filters; ++filter_it) {
+                uint32_t* hashes_filter_buffer = HASHES_FILTER_PTR(model_params, hashes_buffer, filter_it);
+                for(uint32_t hash_it = 0; hash_it < model_params.filter_hashes; ++hash_it)
+                    hashes_filter_buffer[hash_it] = 0;
+
+                for(uint32_t input_it = 0; input_it < filter_inputs; ++input_it, ++inputs) {
+                    if((int16_t) pixels[inputs->pixel] > inputs->threshold) continue;
+                    for(uint32_t hash_it = 0; hash_it < model_params.filter_hashes; ++hash_it)
+                        hashes_filter_buffer[hash_it] ^= hash_parameters[hash_it * filter_inputs + input_it];
+                }
+            }
+        }
+
+        uint64_t prediction = predict_hashed_sample(hashes_buffer, filter_buffer, popcounts, NULL, &model_params, mram_base_addr_model);
+        mram_write(&prediction, PREDICTION_ADDR(model_params, mram_base_addr_predictions, sample_it), sizeof(prediction));
+    }
+
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    result->count += counter_stop(&count); // STOP TIMER
+#endif
+	
+    return 0;
+}
+
+// Counter `entry` of a filter in the sparse layout (see dpu_model_entry_t): the occupancy word of the entry first,
+// then its nonzero counter if its bit is set. line holds one MRAM line.
+static inline uint32_t sparse_entry(uint8_t* line, uint32_t words_addr, uint32_t values_addr, uint32_t entry_bytes, uint32_t entry) {
+    mram_read(words_addr + (entry / SPARSE_WORD_ENTRIES) * sizeof(uint64_t), line, 8);
+    uint32_t occupancy = ((uint32_t*) line)[0];
+    uint32_t bit = 1u << (entry % SPARSE_WORD_ENTRIES);
+    if((occupancy & bit) == 0) return 0;
+
+    uint32_t value_addr = values_addr + (((uint32_t*) line)[1] + __builtin_popcount(occupancy & (bit - 1))) * entry_bytes;
+    uint32_t aligned_addr = ROUND_DOWN_TO_MULTIPLE_OF_8(value_addr);
+    mram_read(aligned_addr, line, 8);
+    return model_entry_from_line(line, value_addr - aligned_addr, entry_bytes);
+}
+
+// sparse_kernel: same predictions as main_kernel1 from the sparse layout of the model, for tables that only fit
+// in MRAM compressed. A zero counter costs one DMA, and a filter stops probing at its first counter below the bleach.
+int sparse_kernel() {
+    unsigned int tasklet_id = me();
+#if PRINT
+    printf("tasklet_id = %u\n", tasklet_id);
+#endif
+    if (tasklet_id == 0) { 
+        mem_reset(); // Reset the heap
+#ifdef CYCLES
+        perfcounter_config(COUNT_CYCLES, true); // Initialize once the cycle counter
+#elif INSTRUCTIONS
+        perfcounter_config(COUNT_INSTRUCTIONS, true); // Initialize once the instruction counter
+#endif
+    }
+
+    // Barrier
+    barrier_wait(&my_barrier);
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    perfcounter_count count;
+    dpu_results_t *result = &DPU_RESULTS[tasklet_id];
+    result->count = 0;
+    counter_start(&count); // START TIMER
+#endif
+
+    uint32_t model_size_dpu_bytes = DPU_INPUT_ARGUMENTS.model_size_bytes;
+    uint32_t input_transfer_size_dpu_bytes = DPU_INPUT_ARGUMENTS.input_transfer_size_bytes;
+    uint32_t nr_inputs = DPU_INPUT_ARGUMENTS.nr_inputs;
+
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
+    const uint32_t words_per_filter = model_entry->sparse_words_per_filter;
+
+    uint32_t mram_base_addr_words = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->offset_bytes;
+    uint32_t mram_base_addr_values = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->sparse_values_offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
+    uint32_t mram_base_addr_predictions = (uint32_t) (mram_base_addr_inputs + input_transfer_size_dpu_bytes);
+
+    uint8_t* line = (uint8_t*) mem_alloc(8);
+    uint32_t* hashes_buffer = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
+    uint32_t* popcounts = (uint32_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(sizeof(uint32_t) * model_params.num_classes));
+
+    for(unsigned int sample_it = tasklet_id; sample_it < nr_inputs; sample_it += NR_TASKLETS) {
+        mram_read(HASHES_SAMPLE_ADDR(model_params, mram_base_addr_inputs, sample_it), hashes_buffer, ROUND_UP_TO_MULTIPLE_OF_8(HASHES_BLOCK_SIZE_B(model_params)));
+
+        for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) 
+            popcounts[discriminator_it] = 0;
+
+        for(unsigned int filter_it = 0; filter_it < model_params.num_filters; ++filter_it) {
+            uint32_t* hashes_filter_buffer = HASHES_FILTER_PTR(model_params, hashes_buffer, filter_it);
+            for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) {
+                uint32_t words_addr = mram_base_addr_words + (discriminator_it * model_params.num_filters + filter_it) * words_per_filter * sizeof(uint64_t);
+
+                uint32_t hash_it = 0;
+                while(hash_it < model_params.filter_hashes
+                    && sparse_entry(line, words_addr, mram_base_addr_values, model_params.entry_bytes, hashes_filter_buffer[hash_it]) >= model_params.bleach)
+                    ++hash_it;
+
+                popcounts[discriminator_it] += (hash_it == model_params.filter_hashes);
+            }
+        }
+
+        uint32_t max_pcount = 0;
+        uint64_t argmax_pcount = 0;
+        for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) {
+            if(popcounts[discriminator_it] >= max_pcount) {
+                max_pcount = popcounts[discriminator_it];
+                argmax_pcount = discriminator_it;
+            }
+        }
+        mram_write(&argmax_pcount, PREDICTION_ADDR(model_params, mram_base_addr_predictions, sample_it), sizeof(argmax_pcount));
+    }
+
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    result->count += counter_stop(&count); // STOP TIMER
+#endif
+	
+    return 0;
+}
+
+// kernel_filter_parallel: popcounts of the tasklets for the samples of both parities, of shape (2, NR_TASKLETS, #Classes)
+uint32_t* filter_partials;
+
+// filter_parallel_kernel: same predictions as main_kernel1, with all tasklets on each sample in turn. Tasklet t probes
+// the filters [t * F / NR_TASKLETS; (t + 1) * F / NR_TASKLETS) of every class, then tasklet 0 adds the partial popcounts
+// up behind a barrier. Partials alternate between two buffers, so a barrier per sample is enough.
+int filter_parallel_kernel() {
+    unsigned int tasklet_id = me();
+#if PRINT
+    printf("tasklet_id = %u\n", tasklet_id);
+#endif
+
+    uint32_t model_size_dpu_bytes = DPU_INPUT_ARGUMENTS.model_size_bytes;
+    uint32_t input_transfer_size_dpu_bytes = DPU_INPUT_ARGUMENTS.input_transfer_size_bytes;
+    uint32_t nr_inputs = DPU_INPUT_ARGUMENTS.nr_inputs;
+
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
+    const uint32_t partials_stride = ROUND_UP_TO_MULTIPLE_OF_8(model_params.num_classes * sizeof(uint32_t)) / sizeof(uint32_t);
+
+    if (tasklet_id == 0) { 
+        mem_reset(); // Reset the heap
+#ifdef CYCLES
+        perfcounter_config(COUNT_CYCLES, true); // Initialize once the cycle counter
+#elif INSTRUCTIONS
+        perfcounter_config(COUNT_INSTRUCTIONS, true); // Initialize once the instruction counter
+#endif
+        filter_partials = (uint32_t*) mem_alloc(2 * NR_TASKLETS * partials_stride * sizeof(uint32_t));
+    }
+
+    // Barrier
+    barrier_wait(&my_barrier);
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    perfcounter_count count;
+    dpu_results_t *result = &DPU_RESULTS[tasklet_id];
+    result->count = 0;
+    counter_start(&count); // START TIMER
+#endif
+
+    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
+    uint32_t mram_base_addr_predictions = (uint32_t) (mram_base_addr_inputs + input_transfer_size_dpu_bytes);
+
+    // Filters of the tasklet, and their hashes (a range may start 4 bytes past an 8-byte boundary)
+    const uint32_t first_filter = tasklet_id * model_params.num_filters / NR_TASKLETS;
+    const uint32_t last_filter = (tasklet_id + 1) * model_params.num_filters / NR_TASKLETS;
+    const uint32_t range_hashes_b = (last_filter - first_filter) * model_params.filter_hashes * sizeof(uint32_t);
+    const uint32_t max_range_hashes_b = divceil(model_params.num_filters, NR_TASKLETS) * model_params.filter_hashes * sizeof(uint32_t);
+
+    uint8_t* filter_buffer = (uint8_t*) mem_alloc(8);
+    uint8_t* hashes_range = (uint8_t*) mem_alloc(ROUND_UP_TO_MULTIPLE_OF_8(max_range_hashes_b + 4));
+
+    for(unsigned int sample_it = 0; sample_it < nr_inputs; ++sample_it) {
+        uint32_t* partials = filter_partials + ((sample_it & 1) * NR_TASKLETS + tasklet_id) * partials_stride;
+        for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) 
+            partials[discriminator_it] = 0;
+
+        if(range_hashes_b > 0) {
+            uint32_t range_addr = HASHES_SAMPLE_ADDR(model_params, mram_base_addr_inputs, sample_it) + first_filter * model_params.filter_hashes * sizeof(uint32_t);
+            uint32_t aligned_addr = ROUND_DOWN_TO_MULTIPLE_OF_8(range_addr);
+            mram_read_large(aligned_addr, hashes_range, ROUND_UP_TO_MULTIPLE_OF_8(range_addr - aligned_addr + range_hashes_b));
+            uint32_t* hashes_filter_buffer = (uint32_t*) (hashes_range + (range_addr - aligned_addr));
+
+            for(unsigned int filter_it = first_filter; filter_it < last_filter; ++filter_it, hashes_filter_buffer += model_params.filter_hashes) {
+                for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) {
+                    uint32_t min = filter_min_entry(hashes_filter_buffer, filter_buffer, &model_params, mram_base_addr_model, discriminator_it, filter_it);
+                    partials[discriminator_it] += (min >= model_params.bleach);
+                }
+            }
+        }
+
+        // The partials of this parity are complete; those of the other parity were reduced before this barrier
+        barrier_wait(&my_barrier);
+        if(tasklet_id == 0) {
+            uint32_t* sample_partials = filter_partials + (sample_it & 1) * NR_TASKLETS * partials_stride;
+            uint32_t max_pcount = 0;
+            uint64_t argmax_pcount = 0;
+            for(unsigned int discriminator_it = 0; discriminator_it < model_params.num_classes; ++discriminator_it) {
+                uint32_t popcount = 0;
+                for(unsigned int tasklet_it = 0; tasklet_it < NR_TASKLETS; ++tasklet_it)
+                    popcount += sample_partials[tasklet_it * partials_stride + discriminator_it];
+                if(popcount >= max_pcount) {
+                    max_pcount = popcount;
+                    argmax_pcount = discriminator_it;
+                }
+            }
+            mram_write(&argmax_pcount, PREDICTION_ADDR(model_params, mram_base_addr_predictions, sample_it), sizeof(argmax_pcount));
+        }
+    }
+
+#if defined(CYCLES) || defined(INSTRUCTIONS)
+    result->count += counter_stop(&count); // STOP TIMER
+#endif
+	
+    return 0;
+}
+
+
 
 
 
@@ -237,7 +1334,8 @@ int print_kernel() {
     uint32_t model_size_dpu_bytes = DPU_INPUT_ARGUMENTS.model_size_bytes; // Transfer input size per DPU in bytes
     uint32_t input_size_dpu_bytes = DPU_INPUT_ARGUMENTS.input_size_bytes; // Input size per DPU in bytes
 
-    dpu_model_params_t model_params = DPU_INPUT_ARGUMENTS.model_params;
+    dpu_model_entry_t* model_entry = &DPU_MODEL_DIRECTORY[DPU_INPUT_ARGUMENTS.model_id];
+    dpu_model_params_t model_params = model_entry->params;
 
 #if PRINT
     printf("model size: %u bytes\n", model_size_dpu_bytes);
@@ -245,8 +1343,8 @@ int print_kernel() {
     printf("model params: %u %u %u %u %u %u\n", model_params.num_classes, model_params.num_filters, model_params.filter_inputs, model_params.filter_entries, model_params.filter_hashes, model_params.bleach);
 #endif
 
-    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER);
-    uint32_t mram_base_addr_inputs = (uint32_t) (mram_base_addr_model + model_size_dpu_bytes);
+    uint32_t mram_base_addr_model = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_entry->offset_bytes;
+    uint32_t mram_base_addr_inputs = (uint32_t) (DPU_MRAM_HEAP_POINTER) + model_size_dpu_bytes;
 
     printf("Addresses. Model %u. Hashes %u.\n", mram_base_addr_model, mram_base_addr_inputs);
 
@@ -259,8 +1357,8 @@ int print_kernel() {
         printf("Discriminator %zu.\n\n", discriminator_it);
         for(unsigned int filter_it = 0; filter_it < 1; ++filter_it) {
             for(unsigned int block_it = 0; block_it < OLD_MODEL_BLOCKS_PER_FILTER; ++block_it) {
-                printf("Reading at addr %u, block size %u\n", OLD_MODEL_BLOCK_ADDR(model_params, mram_base_addr_model, discriminator_it, filter_it, block_it), MODEL_BLOCK_SIZE_B(model_params));
-                mram_read(OLD_MODEL_BLOCK_ADDR(model_params, mram_base_addr_model, discriminator_it, filter_it, block_it), filter_buffer + MODEL_BLOCK_SIZE(model_params) * block_it, MODEL_BLOCK_SIZE_B(model_params));
+                printf("Reading at addr %u, block size %u\n", OLD_MODEL_BLOCK_ADDR(model_params, mram_base_addr_model, discriminator_it, filter_it, block_it), OLD_MODEL_BLOCK_SIZE_B(model_params));
+                mram_read(OLD_MODEL_BLOCK_ADDR(model_params, mram_base_addr_model, discriminator_it, filter_it, block_it), filter_buffer + OLD_MODEL_BLOCK_SIZE(model_params) * block_it, OLD_MODEL_BLOCK_SIZE_B(model_params));
             }
             printf("Filter %zu.\n", filter_it);
             for(unsigned int entry_it = 0; entry_it < model_params.filter_entries; ++entry_it) {
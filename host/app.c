@@ -21,6 +21,19 @@
 #include "../cbthowen/data_manager.h"
 #include "../cbthowen/data_loader.h"
 #include "../cbthowen/batch.h"
+#include "../cbthowen/dataset_cache.h"
+#include "../cbthowen/dataset_stream.h"
+#include "../cbthowen/packed_model.h"
+#include "../cbthowen/dedup.h"
+#include "../cbthowen/class_masks.h"
+#include "../cbthowen/sparse_model.h"
+#include "../cbthowen/verify.h"
+#include "../cbthowen/placement.h"
+#include "../cbthowen/parallel.h"
+#include "server.h"
+#include "tuner.h"
+#include "capacity.h"
+#include "rank_numa.h"
 
 // Define the DPU Binary path as DPU_BINARY here
 #ifndef DPU_BINARY
@@ -32,6 +45,21 @@
 #define MODEL_PATH "./model.dat"
 #endif
 
+// Define the binarized dataset path as DATASET_PATH here
+#ifndef DATASET_PATH
+#define DATASET_PATH "../data/binarized8m.dat"
+#endif
+
+// Define the raw 8-bit samples of the dataset as RAW_DATASET_PATH here (thermometer kernel)
+#ifndef RAW_DATASET_PATH
+#define RAW_DATASET_PATH "../data/mnist8m-patterns-idx3-ubyte"
+#endif
+
+// Define the labels of the dataset as LABELS_PATH here (bleach sweep, confusion matrix)
+#ifndef LABELS_PATH
+#define LABELS_PATH "../data/mnist8m-labels-idx1-ubyte"
+#endif
+
 #ifndef NR_DPUS
 #define NR_DPUS 1
 #endif
@@ -44,32 +72,269 @@
 
 // Pointer declarations
 static tensor3d_t hashes; // (#SAMPLES, #FILTERS, #FILTER_HASHES)
+static batch_dedup_t dedup; // Unique filter chunks of the batch, one segment per DPU (kernel_dedup)
+static unsigned char* labels; // (#SAMPLES) (KERNEL_CONSUMES_LABELS)
 static uint64_t* predictions; // (#SAMPLES)
 static uint64_t* predictions_host; // (#SAMPLES)
-static model_t model; // WNN model
+static model_t model; // WNN model the batches are evaluated with, one of models
+static model_t models[MAX_MODELS]; // Models resident in the MRAM model table
+static unsigned int num_models;
+static dpu_model_entry_t model_directory[MAX_MODELS];
 
 void log_input_args(dpu_params_t input_arguments, size_t it) {
     printf("(%zu: %d) ", it, input_arguments.nr_inputs);
 }
 
-void transfer_data_to_dpus(struct dpu_set_t dpu_set, 
+dpu_model_params_t get_dpu_model_params(model_t* model) {
+    return (dpu_model_params_t) {
+        .num_classes = model->num_classes,
+        .num_filters = model->num_filters,
+        .filter_inputs = model->filter_inputs,
+        .filter_entries = model->filter_entries,
+        .filter_hashes = model->filter_hashes,
+        .bleach = model->bleach,
+        .entry_bytes = model->packed_data != NULL ? model->counter_bytes : sizeof(entry_t)
+    };
+}
+
+// Largest batch of samples whose probe buffers (see coalesced_kernel) fit in the WRAM heap share of a tasklet
+unsigned int coalesced_probe_batch(model_t* model) {
+    const unsigned int tasklet_budget = WRAM_HEAP_BUDGET_B / NR_TASKLETS - COALESCE_WINDOW_B;
+    const unsigned int bytes_per_sample = ROUND_UP_TO_MULTIPLE_OF_8(model->num_filters * model->filter_hashes * sizeof(entry_t))
+        + model->filter_hashes * sizeof(uint32_t) + sizeof(uint32_t) + model->num_classes * sizeof(uint32_t);
+
+    unsigned int probe_batch = tasklet_budget / bytes_per_sample;
+    if(probe_batch > COALESCE_MAX_PROBES / model->filter_hashes)
+        probe_batch = COALESCE_MAX_PROBES / model->filter_hashes;
+
+    return probe_batch > 0 ? probe_batch : 1;
+}
+
+// Splits the WRAM heap of the pipeline kernel: input buffers of the hashing tasklets and probe buffers of the 
+// probing tasklets come first, the remainder holds as many ring slots as fit (at most PIPELINE_MAX_SLOTS)
+unsigned int pipeline_ring_slots(model_t* model, unsigned int hash_tasklets, unsigned int input_sample_bytes) {
+    const unsigned int hashes_block_b = ROUND_UP_TO_MULTIPLE_OF_8(model->num_filters * model->filter_hashes * sizeof(uint32_t));
+    const unsigned int probe_buffers_b = 8 + ROUND_UP_TO_MULTIPLE_OF_8(model->num_classes * sizeof(uint32_t));
+    const unsigned int used_b = hash_tasklets * input_sample_bytes + (NR_TASKLETS - hash_tasklets) * probe_buffers_b;
+
+    unsigned int ring_slots = used_b < WRAM_HEAP_BUDGET_B ? (WRAM_HEAP_BUDGET_B - used_b) / hashes_block_b : 0;
+    if(ring_slots > PIPELINE_MAX_SLOTS) ring_slots = PIPELINE_MAX_SLOTS;
+    assert(ring_slots > 0 && "Pipeline buffers do not fit in WRAM!");
+
+    return ring_slots;
+}
+
+void push_input_arguments(struct dpu_set_t dpu_set, dpu_params_t* input_params) {
+    unsigned int each_dpu = 0;
+    struct dpu_set_t dpu;
+
+    DPU_FOREACH(dpu_set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &input_params[each_dpu]));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(input_params[0]), DPU_XFER_DEFAULT));
+}
+
+// Loads a model file, either packed or full, with counters of counter_bytes bytes.
+// With sparse, the DPUs get the sparse layout of the counters instead of the dense one (kernel_sparse).
+// With class_masks, the DPUs also get the class masks of the model (kernel_class_masks), if it has few enough classes.
+void load_model(const char* path, model_t* model, unsigned int counter_bytes, bool sparse, bool class_masks) {
+    if(is_packed_model_file(path)) {
+        if(!read_packed_model(path, model)) exit(1); // Reported by read_packed_model
+    }
+    else
+        read_model(path, model);
+
+    // Narrow counters are derived from the full counters unless the file already stores that width
+    if(model->packed_data == NULL || model->counter_bytes != counter_bytes)
+        model_pack_counters(model, counter_bytes);
+
+    // Inference-only layout for the bleach of the model (kernel_class_masks)
+    model->class_masks = NULL;
+    if(class_masks && model->num_classes <= CLASS_MASKS_MAX_CLASSES)
+        model_build_class_masks(model);
+
+    model->sparse_words = NULL;
+    model->sparse_values = NULL;
+    if(sparse) {
+        model_build_sparse(model);
+        const size_t sparse_bytes = sparse_words_size_bytes(model) + sparse_values_size_bytes(model);
+        printf("sparse, %s, %zu, %zu, %.2f%%\n", path, model_counters_size_bytes(model), sparse_bytes,
+            100.0 * model->sparse_num_values / (model->num_classes * model->num_filters * model->filter_entries));
+    }
+}
+
+// Lays the models out back to back in MRAM, each followed by its class masks (and their hash parameters in WRAM),
+// returns the size of the table. Models with a sparse layout only get their occupancy words and nonzero counters.
+unsigned int build_model_directory() {
+    unsigned int offset_bytes = 0;
+    unsigned int hash_parameters_offset = 0;
+    for(unsigned int model_it = 0; model_it < num_models; ++model_it) {
+        model_t* table_model = &models[model_it];
+        if(table_model->sparse_words != NULL) {
+            const size_t words_bytes = sparse_words_size_bytes(table_model);
+            const size_t values_bytes = ROUND_UP_TO_MULTIPLE_OF_8(sparse_values_size_bytes(table_model));
+            assert(offset_bytes + words_bytes + values_bytes <= UINT32_MAX && "Sparse model table too large!");
+            model_directory[model_it] = (dpu_model_entry_t) {
+                .offset_bytes = offset_bytes,
+                .size_bytes = words_bytes + values_bytes,
+                .hash_parameters_offset = hash_parameters_offset,
+                .sparse_words_per_filter = table_model->sparse_words_per_filter,
+                .sparse_values_offset_bytes = offset_bytes + words_bytes,
+                .params = get_dpu_model_params(table_model)
+            };
+            offset_bytes += words_bytes + values_bytes;
+            hash_parameters_offset += table_model->filter_hashes * table_model->filter_inputs;
+            continue;
+        }
+        model_directory[model_it] = (dpu_model_entry_t) {
+            .offset_bytes = offset_bytes,
+            .size_bytes = ROUND_UP_TO_MULTIPLE_OF_8(model_counters_size_bytes(table_model)),
+            .hash_parameters_offset = hash_parameters_offset,
+            .masks_offset_bytes = offset_bytes + ROUND_UP_TO_MULTIPLE_OF_8(model_counters_size_bytes(table_model)),
+            .mask_bytes = table_model->class_masks != NULL ? table_model->mask_bytes : 0,
+            .params = get_dpu_model_params(table_model)
+        };
+        offset_bytes += model_directory[model_it].size_bytes;
+        if(table_model->class_masks != NULL)
+            offset_bytes += ROUND_UP_TO_MULTIPLE_OF_8(class_masks_size_bytes(table_model));
+        hash_parameters_offset += models[model_it].filter_hashes * models[model_it].filter_inputs;
+    }
+    return offset_bytes;
+}
+
+// Class masks are sent in 8-byte multiples, the padding of the last line is zeroed
+void broadcast_class_masks_to_dpus(struct dpu_set_t dpu_set, model_t* table_model, unsigned int masks_offset_bytes) {
+    const size_t masks_bytes = class_masks_size_bytes(table_model);
+    const size_t aligned_bytes = ROUND_DOWN_TO_MULTIPLE_OF_8(masks_bytes);
+
+    if(aligned_bytes > 0)
+        DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, masks_offset_bytes, table_model->class_masks, aligned_bytes, DPU_XFER_DEFAULT));
+    if(aligned_bytes < masks_bytes) {
+        uint8_t line[8] = { 0 };
+        memcpy(line, (uint8_t*) table_model->class_masks + aligned_bytes, masks_bytes - aligned_bytes);
+        DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, masks_offset_bytes + aligned_bytes, line, sizeof(line), DPU_XFER_DEFAULT));
+    }
+}
+
+// Occupancy words, then the nonzero counters padded to 8 bytes
+void broadcast_sparse_model_to_dpus(struct dpu_set_t dpu_set, model_t* table_model, dpu_model_entry_t* entry) {
+    const size_t values_bytes = sparse_values_size_bytes(table_model);
+    const size_t padded_bytes = ROUND_UP_TO_MULTIPLE_OF_8(values_bytes);
+
+    DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, entry->offset_bytes, table_model->sparse_words, sparse_words_size_bytes(table_model), DPU_XFER_DEFAULT));
+    if(padded_bytes == 0) return;
+    uint8_t* values = (uint8_t*) calloc(padded_bytes, 1);
+    memcpy(values, table_model->sparse_values, values_bytes);
+    DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, entry->sparse_values_offset_bytes, values, padded_bytes, DPU_XFER_DEFAULT));
+    free(values);
+}
+
+// Broadcasts every model of the table and its directory, once: batches then select a model by id
+void broadcast_model_to_dpus(struct dpu_set_t dpu_set) {
+    printf("Broadcast model table (%u models)\n", num_models);
+
+    for(unsigned int model_it = 0; model_it < num_models; ++model_it) {
+        if(models[model_it].sparse_words != NULL) {
+            broadcast_sparse_model_to_dpus(dpu_set, &models[model_it], &model_directory[model_it]);
+            continue;
+        }
+        DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, model_directory[model_it].offset_bytes, 
+            model_counters(&models[model_it]), model_directory[model_it].size_bytes, DPU_XFER_DEFAULT));
+        if(models[model_it].class_masks != NULL)
+            broadcast_class_masks_to_dpus(dpu_set, &models[model_it], model_directory[model_it].masks_offset_bytes);
+    }
+    DPU_ASSERT(dpu_broadcast_to(dpu_set, "DPU_MODEL_DIRECTORY", 0, model_directory, sizeof(model_directory), DPU_XFER_DEFAULT));
+}
+
+void push_hashes_to_dpus(struct dpu_set_t dpu_set, 
     unsigned int nr_dpus, 
     dpu_params_t* input_params, 
+    tensor3d_t* input_hashes,
     unsigned int dpu_model_transfer_size_bytes,
     unsigned int dpu_input_transfer_size_bytes) {
 
     unsigned int each_dpu = 0;
     struct dpu_set_t dpu;
 
-    printf("Broadcast model \n");
+#if PRINT
+    printf("Parallel hashes push \n");
+#endif
 
-    DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, 0, model.data.data, dpu_model_transfer_size_bytes, DPU_XFER_DEFAULT));
+    unsigned int sample_it = 0;
+    DPU_FOREACH(dpu_set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, TENSOR3D_AXIS1(*input_hashes, sample_it)));
+        sample_it += input_params[each_dpu].nr_inputs;
+    }
+    DPU_ASSERT(
+        dpu_push_xfer(dpu_set, 
+            DPU_XFER_TO_DPU, 
+            DPU_MRAM_HEAP_POINTER_NAME, 
+            dpu_model_transfer_size_bytes,
+            dpu_input_transfer_size_bytes, 
+            DPU_XFER_DEFAULT)
+    );
+}
 
-    printf("Parallel hashes push \n");
+// Hash parameters of the models of the table, for kernels hashing the inputs on the DPUs
+void broadcast_hash_parameters_to_dpus(struct dpu_set_t dpu_set) {
+    const dpu_model_entry_t* last = &model_directory[num_models - 1];
+    const size_t num_parameters = last->hash_parameters_offset + last->params.filter_hashes * last->params.filter_inputs;
+    assert(num_parameters <= MAX_HASH_PARAMETERS && "Hash parameters do not fit in WRAM!");
+
+    uint32_t* parameters = (uint32_t*) calloc(ROUND_UP_TO_MULTIPLE_OF_8(num_parameters * sizeof(uint32_t)), 1);
+    for(unsigned int model_it = 0; model_it < num_models; ++model_it) {
+        model_t* table_model = &models[model_it];
+        uint32_t* model_parameters = parameters + model_directory[model_it].hash_parameters_offset;
+        for(size_t hash_it = 0; hash_it < table_model->filter_hashes; ++hash_it)
+            for(size_t input_it = 0; input_it < table_model->filter_inputs; ++input_it)
+                model_parameters[hash_it * table_model->filter_inputs + input_it] = *MATRIX(table_model->hash_parameters, hash_it, input_it);
+    }
+
+    DPU_ASSERT(dpu_broadcast_to(dpu_set, "DPU_HASH_PARAMETERS", 0, parameters, ROUND_UP_TO_MULTIPLE_OF_8(num_parameters * sizeof(uint32_t)), DPU_XFER_DEFAULT));
+    free(parameters);
+}
+
+// Thermometer table of the selected model for kernel_thermometer: the (pixel, threshold) pair of each input of the
+// model, in the input order of the model, so that the DPUs binarize and reorder raw samples in one pass
+void broadcast_thermometer_table_to_dpus(struct dpu_set_t dpu_set, binarizer_t* binarizer, unsigned int offset_bytes) {
+    const size_t num_thresholds = binarizer->num_bits * binarizer->sample_size;
+    const size_t table_bytes = ROUND_UP_TO_MULTIPLE_OF_8(model.num_inputs_total * sizeof(dpu_thermometer_input_t));
+    int16_t* thresholds = (int16_t*) malloc(num_thresholds * sizeof(*thresholds));
+    binarizer_thresholds(binarizer, thresholds);
+
+    dpu_thermometer_input_t* table = (dpu_thermometer_input_t*) calloc(table_bytes, 1);
+    for(size_t input_it = 0; input_it < model.num_inputs_total; ++input_it) {
+        const size_t input = model.input_order[input_it];
+        // Padding inputs of the model are never set
+        table[input_it] = input < num_thresholds
+            ? (dpu_thermometer_input_t) { .pixel = input % binarizer->sample_size, .threshold = thresholds[input] }
+            : (dpu_thermometer_input_t) { .pixel = 0, .threshold = -1 };
+    }
+
+    DPU_ASSERT(dpu_broadcast_to(dpu_set, DPU_MRAM_HEAP_POINTER_NAME, offset_bytes, table, table_bytes, DPU_XFER_DEFAULT));
+    free(table);
+    free(thresholds);
+}
+
+// Reordered binarized inputs (rows of input_reordered are contiguous and a multiple of 8 bytes)
+void push_inputs_to_dpus(struct dpu_set_t dpu_set, 
+    unsigned int nr_dpus, 
+    dpu_params_t* input_params, 
+    bmatrix_t* input_reordered,
+    unsigned int dpu_model_transfer_size_bytes,
+    unsigned int dpu_input_transfer_size_bytes) {
+
+    unsigned int each_dpu = 0;
+    struct dpu_set_t dpu;
+
+    assert(input_reordered->stride == input_params[0].input_sample_bytes && "Input rows must be 8-byte aligned!");
+#if PRINT
+    printf("Parallel inputs push \n");
+#endif
 
     unsigned int sample_it = 0;
     DPU_FOREACH(dpu_set, dpu, each_dpu) {
-        DPU_ASSERT(dpu_prepare_xfer(dpu, TENSOR3D_AXIS1(hashes, sample_it)));
+        DPU_ASSERT(dpu_prepare_xfer(dpu, MATRIX_AXIS1(*input_reordered, sample_it)));
         sample_it += input_params[each_dpu].nr_inputs;
     }
     DPU_ASSERT(
@@ -82,9 +347,112 @@ void transfer_data_to_dpus(struct dpu_set_t dpu_set,
     );
 }
 
+// Index rows of the samples of each DPU, then the records of its segment (see batch_dedup_t)
+void push_dedup_to_dpus(struct dpu_set_t dpu_set, 
+    unsigned int nr_dpus, 
+    dpu_params_t* input_params, 
+    batch_dedup_t* input_dedup,
+    unsigned int dpu_model_transfer_size_bytes,
+    unsigned int dpu_input_transfer_size_bytes) {
+
+    unsigned int each_dpu = 0;
+    struct dpu_set_t dpu;
+    const unsigned int index_transfer_size_bytes = input_params[0].dedup_records_offset;
+
+#if PRINT
+    printf("Parallel dedup push \n");
+#endif
+
+    unsigned int sample_it = 0;
+    DPU_FOREACH(dpu_set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, input_dedup->index + sample_it * input_dedup->index_words));
+        sample_it += input_params[each_dpu].nr_inputs;
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, dpu_model_transfer_size_bytes,
+        index_transfer_size_bytes, DPU_XFER_DEFAULT));
+
+    sample_it = 0;
+    DPU_FOREACH(dpu_set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, input_dedup->records + input_dedup->segment_first_record[sample_it] * input_dedup->record_words));
+        sample_it += input_params[each_dpu].nr_inputs;
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, dpu_model_transfer_size_bytes + index_transfer_size_bytes,
+        dpu_input_transfer_size_bytes - index_transfer_size_bytes, DPU_XFER_DEFAULT));
+}
+
+// Labels of the samples of each DPU, after their hashes (KERNEL_CONSUMES_LABELS)
+void push_labels_to_dpus(struct dpu_set_t dpu_set, 
+    unsigned int nr_dpus, 
+    dpu_params_t* input_params, 
+    unsigned char* input_labels,
+    unsigned int dpu_model_transfer_size_bytes,
+    unsigned int dpu_input_transfer_size_bytes) {
+
+    unsigned int each_dpu = 0;
+    struct dpu_set_t dpu;
+    const unsigned int labels_offset_bytes = input_params[0].labels_offset_bytes;
+
+    unsigned int sample_it = 0;
+    DPU_FOREACH(dpu_set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &input_labels[sample_it]));
+        sample_it += input_params[each_dpu].nr_inputs;
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, dpu_model_transfer_size_bytes + labels_offset_bytes,
+        dpu_input_transfer_size_bytes - labels_offset_bytes, DPU_XFER_DEFAULT));
+}
+
+// Deduplicates the batch in one segment per DPU into dedup_records (#DPUs), returns the largest segment
+unsigned int dedup_batch_per_dpu(bmatrix_t* input_reordered, unsigned int nr_dpus, unsigned int num_samples, uint32_t* dedup_records) {
+    unsigned int max_records = 0;
+    unsigned int sample_it = 0;
+
+    batch_dedup_reset(&dedup);
+    for(unsigned int dpu_it = 0; dpu_it < nr_dpus; ++dpu_it) {
+        const unsigned int dpu_num_samples = NUM_SAMPLES(nr_dpus, num_samples, dpu_it);
+        const size_t first_record = batch_dedup_segment(&dedup, &model, input_reordered, sample_it, dpu_num_samples);
+        dedup_records[dpu_it] = dedup.num_records - first_record;
+        if(dedup_records[dpu_it] > max_records) max_records = dedup_records[dpu_it];
+        sample_it += dpu_num_samples;
+    }
+    // Samples past num_samples still need a segment (transfers of the last DPUs read a full share)
+    for(; sample_it < num_samples + divceil(num_samples, nr_dpus); ++sample_it)
+        dedup.segment_first_record[sample_it] = dedup.num_records;
+    batch_dedup_pad_records(&dedup, max_records);
+
+    return max_records;
+}
+
+// The model table is resident (see broadcast_model_to_dpus): only the samples of the launch, from first_sample on, are transferred
+void transfer_data_to_dpus(struct dpu_set_t dpu_set, 
+    unsigned int nr_dpus, 
+    dpu_params_t* input_params, 
+    bmatrix_t* input_reordered,
+    unsigned int first_sample,
+    unsigned int dpu_model_transfer_size_bytes,
+    unsigned int dpu_input_transfer_size_bytes) {
+
+    bmatrix_t launch_reordered = { .stride = input_reordered->stride, .data = MATRIX_AXIS1(*input_reordered, first_sample) };
+    tensor3d_t launch_hashes = { .stride1 = hashes.stride1, .stride2 = hashes.stride2, .data = TENSOR3D_AXIS1(hashes, first_sample) };
+
+    // kernel_thermometer: input_reordered holds the raw pixels of the samples
+    if(KERNEL_CONSUMES_INPUTS(input_params[0].kernel) || KERNEL_CONSUMES_PIXELS(input_params[0].kernel))
+        push_inputs_to_dpus(dpu_set, nr_dpus, input_params, &launch_reordered, dpu_model_transfer_size_bytes, dpu_input_transfer_size_bytes);
+    else if(input_params[0].kernel == kernel_dedup) {
+        assert(first_sample == 0 && "The dedup kernel needs the batch in one launch!");
+        push_dedup_to_dpus(dpu_set, nr_dpus, input_params, &dedup, dpu_model_transfer_size_bytes, dpu_input_transfer_size_bytes);
+    }
+    else if(KERNEL_CONSUMES_LABELS(input_params[0].kernel)) {
+        push_hashes_to_dpus(dpu_set, nr_dpus, input_params, &launch_hashes, dpu_model_transfer_size_bytes, input_params[0].labels_offset_bytes);
+        push_labels_to_dpus(dpu_set, nr_dpus, input_params, labels + first_sample, dpu_model_transfer_size_bytes, dpu_input_transfer_size_bytes);
+    }
+    else
+        push_hashes_to_dpus(dpu_set, nr_dpus, input_params, &launch_hashes, dpu_model_transfer_size_bytes, dpu_input_transfer_size_bytes);
+}
+
 void retrieve_data_from_dpus(struct dpu_set_t dpu_set, 
     unsigned int nr_dpus, 
     dpu_params_t* input_params, 
+    uint64_t* output_predictions,
     unsigned int dpu_model_transfer_size_bytes,
     unsigned int dpu_input_transfer_size_bytes,
     unsigned int dpu_output_transfer_size_bytes) {
@@ -92,11 +460,13 @@ void retrieve_data_from_dpus(struct dpu_set_t dpu_set,
     unsigned int each_dpu = 0;
     struct dpu_set_t dpu;
 
+#if PRINT
     printf("Prediction pull \n");
+#endif
 
     unsigned int pred_it = 0;
     DPU_FOREACH(dpu_set, dpu, each_dpu) {
-        DPU_ASSERT(dpu_prepare_xfer(dpu, &predictions[pred_it]));
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &output_predictions[pred_it]));
         pred_it += input_params[each_dpu].nr_inputs;
     }
 
@@ -110,6 +480,608 @@ void retrieve_data_from_dpus(struct dpu_set_t dpu_set,
     );
 }
 
+// Adds the correct predictions at each bleach of all tasklets of all DPUs to correct
+void retrieve_bleach_sweep(struct dpu_set_t dpu_set, unsigned int nr_dpus, uint64_t* correct) {
+    unsigned int each_dpu = 0;
+    struct dpu_set_t dpu;
+
+    uint32_t (*sweeps)[NR_TASKLETS][SWEEP_BLEACH_VALUES] = malloc(nr_dpus * sizeof(*sweeps));
+    DPU_FOREACH(dpu_set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, sweeps[each_dpu]));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, "DPU_BLEACH_SWEEP", 0, sizeof(*sweeps), DPU_XFER_DEFAULT));
+
+    for(unsigned int dpu_it = 0; dpu_it < nr_dpus; ++dpu_it)
+        for(unsigned int tasklet_it = 0; tasklet_it < NR_TASKLETS; ++tasklet_it)
+            for(unsigned int bleach_it = 0; bleach_it < SWEEP_BLEACH_VALUES; ++bleach_it)
+                correct[bleach_it] += sweeps[dpu_it][tasklet_it][bleach_it];
+    free(sweeps);
+}
+
+// Adds the confusion matrices of all DPUs to matrix, of shape (#Classes, #Classes)
+void retrieve_confusion(struct dpu_set_t dpu_set, unsigned int nr_dpus, unsigned int num_classes, uint64_t* matrix) {
+    unsigned int each_dpu = 0;
+    struct dpu_set_t dpu;
+
+    uint32_t (*confusions)[CONFUSION_MAX_CLASSES * CONFUSION_MAX_CLASSES] = malloc(nr_dpus * sizeof(*confusions));
+    DPU_FOREACH(dpu_set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, confusions[each_dpu]));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, "DPU_CONFUSION", 0, sizeof(*confusions), DPU_XFER_DEFAULT));
+
+    for(unsigned int dpu_it = 0; dpu_it < nr_dpus; ++dpu_it)
+        for(unsigned int label_it = 0; label_it < num_classes; ++label_it)
+            for(unsigned int prediction_it = 0; prediction_it < num_classes; ++prediction_it)
+                matrix[label_it * num_classes + prediction_it] += confusions[dpu_it][label_it * CONFUSION_MAX_CLASSES + prediction_it];
+    free(confusions);
+}
+
+// Adds the probe counters of all tasklets of all DPUs to total
+void retrieve_probe_stats(struct dpu_set_t dpu_set, unsigned int nr_dpus, dpu_probe_stats_t* total) {
+    unsigned int each_dpu = 0;
+    struct dpu_set_t dpu;
+
+    dpu_probe_stats_t* stats = (dpu_probe_stats_t*) malloc(nr_dpus * NR_TASKLETS * sizeof(dpu_probe_stats_t));
+    DPU_FOREACH(dpu_set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &stats[each_dpu * NR_TASKLETS]));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, "DPU_PROBE_STATS", 0, NR_TASKLETS * sizeof(dpu_probe_stats_t), DPU_XFER_DEFAULT));
+
+    for(unsigned int it = 0; it < nr_dpus * NR_TASKLETS; ++it) {
+        total->probes += stats[it].probes;
+        total->skipped_probes += stats[it].skipped_probes;
+    }
+    free(stats);
+}
+
+// Per-role totals of the pipeline kernel stage counters over all tasklets of all DPUs
+void retrieve_stage_stats(struct dpu_set_t dpu_set, unsigned int nr_dpus, dpu_stage_stats_t* totals) {
+    unsigned int each_dpu = 0;
+    struct dpu_set_t dpu;
+
+    dpu_stage_stats_t* stats = (dpu_stage_stats_t*) malloc(nr_dpus * NR_TASKLETS * sizeof(dpu_stage_stats_t));
+    DPU_FOREACH(dpu_set, dpu, each_dpu) {
+        DPU_ASSERT(dpu_prepare_xfer(dpu, &stats[each_dpu * NR_TASKLETS]));
+    }
+    DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, "DPU_STAGE_STATS", 0, NR_TASKLETS * sizeof(dpu_stage_stats_t), DPU_XFER_DEFAULT));
+
+    for(unsigned int it = 0; it < nr_dpus * NR_TASKLETS; ++it) {
+        dpu_stage_stats_t* total = &totals[stats[it].role];
+        total->items += stats[it].items;
+        total->busy += stats[it].busy;
+        total->wait += stats[it].wait;
+    }
+    free(stats);
+}
+
+// Flags of the arena backing the host buffers: its pages are faulted in at setup, outside of the timed regions
+static int host_arena_flags(struct Params* p) {
+    return ARENA_PREFAULT | (p->huge_pages ? ARENA_HUGE_PAGES : 0);
+}
+
+// Arena bytes of the buffers of rows samples: binarized and reordered inputs, hashes and both prediction arrays
+static size_t host_sample_buffers_bytes(size_t rows, size_t input_size) {
+    return 2 * ARENA_SIZE(rows * input_size)
+        + ARENA_SIZE(rows * model.num_filters * model.filter_hashes * sizeof(entry_t))
+        + 2 * ARENA_SIZE(rows * sizeof(uint64_t));
+}
+
+// One window of the streaming mode: every buffer is sized for window_max samples and reused across windows
+typedef struct {
+    size_t num_samples;
+    bmatrix_t binarized; // (#WINDOW_SAMPLES, #INPUTS)
+    bmatrix_t reordered; // (#WINDOW_SAMPLES, #INPUTS)
+    tensor3d_t hashes; // (#WINDOW_SAMPLES, #FILTERS, #FILTER_HASHES), empty when the DPUs hash
+    uint64_t* predictions; // (#WINDOW_SAMPLES)
+} stream_window_t;
+
+// Bytes of one window sample: binarized and reordered inputs, hashes when the host hashes, and the prediction
+static size_t stream_window_sample_bytes(size_t input_size, bool hashes) {
+    return 2 * input_size + (hashes ? model.num_filters * model.filter_hashes * sizeof(entry_t) : 0) + sizeof(uint64_t);
+}
+
+// Arena bytes of one window of window_max samples, as carved by stream_window_init
+static size_t stream_window_bytes(size_t window_max, size_t input_size, bool hashes) {
+    return 2 * ARENA_SIZE(window_max * input_size)
+        + (hashes ? ARENA_SIZE(window_max * model.num_filters * model.filter_hashes * sizeof(entry_t)) : 0)
+        + ARENA_SIZE(window_max * sizeof(uint64_t));
+}
+
+// The hashes tensor is left empty when the DPUs hash the inputs themselves
+static void stream_window_init(stream_window_t* window, size_t window_max, size_t input_size, bool hashes, arena_t* arena) {
+    window->num_samples = 0;
+    bmatrix_init_arena(&window->binarized, window_max, input_size, arena);
+    bmatrix_init_arena(&window->reordered, window_max, input_size, arena);
+    window->hashes = (tensor3d_t) { 0 };
+    if(hashes)
+        tensor_init_arena(&window->hashes, window_max, model.num_filters, model.filter_hashes, arena);
+    window->predictions = (uint64_t *) arena_alloc(arena, window_max * sizeof(*window->predictions));
+}
+
+// Reads and preprocesses the next window. Returns the number of samples in the window.
+static size_t stream_window_fill(stream_window_t* window, dataset_stream_t* stream, size_t max_samples, size_t input_size, bool hash, Timer* timer, size_t window_it) {
+    start(timer, 0, window_it);
+    window->num_samples = dataset_stream_read(stream, &window->binarized, max_samples);
+    reorder_dataset(&window->reordered, &window->binarized, model.input_order, window->num_samples, input_size);
+    stop(timer, 0);
+
+    // Kernels consuming inputs hash them on the DPUs
+    start(timer, 1, window_it);
+    if(hash)
+        batch_hashing(&window->hashes, &model, &window->reordered, window->num_samples);
+    stop(timer, 1);
+
+    return window->num_samples;
+}
+
+/**
+ * @brief Out-of-core execution: the dataset is read, preprocessed, dispatched and written back in windows
+ * whose host buffers fit in p->stream_mem_mb. Two windows are alternated so that the host prepares 
+ * the next window while the DPUs process the current one.
+ */
+static void run_streaming(struct dpu_set_t dpu_set, uint32_t nr_of_dpus, struct Params* p) {
+    Timer timer;
+
+    dataset_stream_t stream;
+    if(!dataset_stream_open(&stream, DATASET_PATH)) return;
+
+    const size_t input_size = MNIST_IM_SIZE * model.bits_per_input;
+    assert(stream.sample_size == input_size);
+
+    size_t num_samples = stream.num_samples_total;
+    if(p->num_samples > 0 && p->num_samples < num_samples)
+        num_samples = p->num_samples;
+    stream.num_samples_total = num_samples; // Stop reading after num_samples
+
+    // Size the windows so that both of them fit in the memory cap
+    const bool dpu_hashing = KERNEL_CONSUMES_INPUTS(p->kernel);
+    const unsigned int hashes_per_sample = model.num_filters * model.filter_hashes;
+    const unsigned int input_sample_bytes = ROUND_UP_TO_MULTIPLE_OF_8(input_size);
+    const unsigned int bytes_per_sample = dpu_hashing ? input_sample_bytes : hashes_per_sample * sizeof(entry_t);
+    const size_t window_sample_bytes = stream_window_sample_bytes(input_size, !dpu_hashing);
+    size_t shared_sample_bytes = 0;
+#if defined(CHECK_RES)
+    shared_sample_bytes += sizeof(uint64_t); // Verified samples and their references, shared by both windows
+#endif
+    // Each of the 4 arena buffers of a window may round up by up to one alignment
+    const size_t stream_mem_bytes = (size_t) p->stream_mem_mb << 20;
+    const size_t padding_bytes = 2 * 4 * ARENA_ALIGNMENT;
+    size_t window_max = stream_mem_bytes > padding_bytes ? (stream_mem_bytes - padding_bytes) / (2 * window_sample_bytes + shared_sample_bytes) : 0;
+    window_max = (window_max / nr_of_dpus) * nr_of_dpus;
+    if(window_max < nr_of_dpus) window_max = nr_of_dpus;
+    if(window_max > divceil(num_samples, nr_of_dpus) * nr_of_dpus) window_max = divceil(num_samples, nr_of_dpus) * nr_of_dpus;
+
+    // A window is one launch: it is capped by the MRAM of the DPUs too
+    const unsigned int model_bytes = build_model_directory();
+    const unsigned int ring_slots = dpu_hashing ? pipeline_ring_slots(&model, p->hash_tasklets, input_sample_bytes) : 0;
+    capacity_plan_t plan;
+    dpu_params_t plan_config = { .model_size_bytes = model_bytes, .kernel = p->kernel, .probe_batch = coalesced_probe_batch(&model),
+        .input_sample_bytes = input_sample_bytes, .hash_tasklets = p->hash_tasklets, .ring_slots = ring_slots };
+    if(!capacity_plan(&plan, &model, &plan_config, window_max, nr_of_dpus)) {
+        dataset_stream_close(&stream);
+        return;
+    }
+    window_max = plan.launch_samples;
+
+    printf("Streaming %zu samples in windows of %zu samples (%zu MB per window)\n", num_samples, window_max, stream_window_bytes(window_max, input_size, !dpu_hashing) >> 20);
+
+    // MRAM layout and transfer sizes are fixed by the largest window
+    const unsigned int dpu_num_samples_max = window_max / nr_of_dpus;
+    const unsigned int dpu_input_transfer_size_bytes = dpu_hashing ? dpu_num_samples_max * input_sample_bytes
+        : aligned_count(hashes_per_sample * dpu_num_samples_max, sizeof(entry_t)) * sizeof(entry_t);
+    const unsigned int dpu_output_transfer_size_bytes = aligned_count(dpu_num_samples_max, sizeof(uint64_t)) * sizeof(uint64_t);
+
+    // Both windows are carved out of one arena, recycled from window to window without being cleared
+    arena_t arena;
+    const size_t arena_bytes = 2 * stream_window_bytes(window_max, input_size, !dpu_hashing);
+    if(!arena_init(&arena, arena_bytes, host_arena_flags(p))) {
+        printf("Not able to map %zu MB of window buffers\n", arena_bytes >> 20);
+        dataset_stream_close(&stream);
+        return;
+    }
+    stream_window_t windows[2];
+    stream_window_init(&windows[0], window_max, input_size, !dpu_hashing, &arena);
+    stream_window_init(&windows[1], window_max, input_size, !dpu_hashing, &arena);
+
+    FILE* output = NULL;
+    if(p->output_path != NULL) {
+        output = fopen(p->output_path, "wb");
+        if(output == NULL) printf("Not able to write the file at path %s\n", p->output_path);
+    }
+
+    broadcast_model_to_dpus(dpu_set);
+    if(dpu_hashing)
+        broadcast_hash_parameters_to_dpus(dpu_set);
+
+#if defined(CHECK_RES)
+    verifier_t verifier;
+    verifier_init(&verifier, &model, window_max, p->verify_samples, p->verify_max_mismatches);
+#endif
+    size_t window_it = 0;
+    unsigned int cur = 0;
+    stream_window_fill(&windows[cur], &stream, window_max, input_size, !dpu_hashing, &timer, window_it);
+    while(windows[cur].num_samples > 0) {
+        stream_window_t* window = &windows[cur];
+
+        dpu_params_t input_arguments[NR_DPUS];
+        for(unsigned int i = 0; i < nr_of_dpus; i++) {
+            const unsigned int dpu_num_samples = NUM_SAMPLES(nr_of_dpus, window->num_samples, i);
+            input_arguments[i] = (dpu_params_t) {
+                .model_size_bytes = model_bytes,
+
+                .input_size_bytes = dpu_num_samples * bytes_per_sample,
+                .input_transfer_size_bytes = dpu_input_transfer_size_bytes,
+
+                .output_size_bytes = dpu_num_samples * sizeof(uint64_t),
+                .output_transfer_size_bytes = dpu_output_transfer_size_bytes,
+
+                .nr_inputs = dpu_num_samples,
+
+                .kernel = p->kernel == kernel1 ? tuner_full_evaluation_kernel(&model, divceil(window->num_samples, nr_of_dpus)) : p->kernel,
+                .probe_batch = coalesced_probe_batch(&model),
+                .input_sample_bytes = input_sample_bytes,
+                .hash_tasklets = p->hash_tasklets,
+                .ring_slots = ring_slots,
+                .model_id = p->model_id
+            };
+        }
+
+        start(&timer, 2, window_it);
+        push_input_arguments(dpu_set, input_arguments);
+        if(dpu_hashing)
+            push_inputs_to_dpus(dpu_set, nr_of_dpus, input_arguments, &window->reordered, model_bytes, dpu_input_transfer_size_bytes);
+        else
+            push_hashes_to_dpus(dpu_set, nr_of_dpus, input_arguments, &window->hashes, model_bytes, dpu_input_transfer_size_bytes);
+        stop(&timer, 2);
+
+        // Prepare the next window while the DPUs work on this one
+        start(&timer, 3, window_it);
+        DPU_ASSERT(dpu_launch(dpu_set, DPU_ASYNCHRONOUS));
+#if defined(CHECK_RES)
+        verifier_start(&verifier, NULL, &window->binarized, window->num_samples);
+#endif
+        stream_window_fill(&windows[1 - cur], &stream, window_max, input_size, !dpu_hashing, &timer, window_it + 1);
+        DPU_ASSERT(dpu_sync(dpu_set));
+        stop(&timer, 3);
+
+        start(&timer, 4, window_it);
+        retrieve_data_from_dpus(dpu_set, nr_of_dpus, input_arguments, window->predictions, model_bytes, dpu_input_transfer_size_bytes, dpu_output_transfer_size_bytes);
+        stop(&timer, 4);
+
+        if(output != NULL)
+            fwrite(window->predictions, sizeof(*window->predictions), window->num_samples, output);
+
+#if defined(CHECK_RES)
+        verifier_check(&verifier, window->predictions);
+#endif
+
+        window_it++;
+        cur = 1 - cur;
+    }
+
+    printf("results_and_timings(streaming), %d, %d, %zu, %zu", nr_of_dpus, NR_TASKLETS, num_samples, window_max);
+    for(int it = 0; it < 5; ++it) {
+        printf(", ");
+        print2(&timer, it, 1);
+    }
+    puts("");
+
+#if defined(CHECK_RES)
+    verifier_report(&verifier);
+    if (verifier.total_mismatches == 0) {
+        printf("\n[" ANSI_COLOR_GREEN "OK" ANSI_COLOR_RESET "] Outputs are equal\n");
+    } else {
+        printf("\n[" ANSI_COLOR_RED "ERROR" ANSI_COLOR_RESET "] %zu outputs differ!\n", verifier.total_mismatches);
+    }
+    verifier_free(&verifier);
+#endif
+
+    if(output != NULL) fclose(output);
+    arena_free(&arena);
+    dataset_stream_close(&stream);
+}
+
+// Largest number of requests waiting to be batched, in micro-batches of the largest size
+#define SERVER_QUEUE_BATCHES 4
+// Requests observed between two adjustments of the micro-batch slack
+#define SERVER_WINDOW_REQUESTS 1024
+
+/**
+ * @brief Server mode: the DPUs stay allocated and loaded while requests are read from stdin (or from the
+ * connections of a Unix socket at p->socket_path) and answered in micro-batches of at most p->num_samples 
+ * samples, sized to keep the p99 latency under p->slo_us (see batch_controller_t). It returns once stdin is
+ * closed, or on SIGINT or SIGTERM after answering the requests already received.
+ */
+static void run_server(struct dpu_set_t dpu_set, uint32_t nr_of_dpus, struct Params* p) {
+    const size_t input_size = MNIST_IM_SIZE * model.bits_per_input;
+    const bool dpu_hashing = KERNEL_CONSUMES_INPUTS(p->kernel);
+    const size_t max_batch = p->num_samples;
+
+    // MRAM layout and transfer sizes are fixed by the largest micro-batch
+    const unsigned int hashes_per_sample = model.num_filters * model.filter_hashes;
+    const unsigned int input_sample_bytes = ROUND_UP_TO_MULTIPLE_OF_8(input_size);
+    const unsigned int bytes_per_sample = dpu_hashing ? input_sample_bytes : hashes_per_sample * sizeof(entry_t);
+    const unsigned int model_bytes = build_model_directory();
+    const unsigned int dpu_num_samples_max = divceil(max_batch, nr_of_dpus);
+    const unsigned int dpu_input_transfer_size_bytes = dpu_hashing ? dpu_num_samples_max * input_sample_bytes
+        : aligned_count(hashes_per_sample * dpu_num_samples_max, sizeof(entry_t)) * sizeof(entry_t);
+    const unsigned int dpu_output_transfer_size_bytes = aligned_count(dpu_num_samples_max, sizeof(uint64_t)) * sizeof(uint64_t);
+    const unsigned int ring_slots = dpu_hashing ? pipeline_ring_slots(&model, p->hash_tasklets, input_sample_bytes) : 0;
+
+    // A micro-batch is one launch
+    capacity_plan_t plan;
+    dpu_params_t plan_config = { .model_size_bytes = model_bytes, .kernel = p->kernel, .probe_batch = coalesced_probe_batch(&model),
+        .input_sample_bytes = input_sample_bytes, .hash_tasklets = p->hash_tasklets, .ring_slots = ring_slots };
+    if(!capacity_plan(&plan, &model, &plan_config, max_batch, nr_of_dpus))
+        return;
+    if(plan.num_launches > 1) {
+        printf("Capacity: micro-batches of %zu samples do not fit in MRAM, at most %u do\n", max_batch, plan.launch_samples);
+        return;
+    }
+
+    // Transfers of the last DPUs read up to a full DPU share past the end of the batch
+    const size_t batch_rows = max_batch + dpu_num_samples_max;
+    arena_t arena;
+    const size_t arena_bytes = host_sample_buffers_bytes(batch_rows, input_size)
+        + 2 * ARENA_SIZE(max_batch * sizeof(uint64_t)) + ARENA_SIZE(max_batch * sizeof(server_response_t));
+    if(!arena_init(&arena, arena_bytes, host_arena_flags(p))) {
+        printf("Not able to map %zu MB of batch buffers\n", arena_bytes >> 20);
+        return;
+    }
+    bmatrix_t binarized, reordered;
+    tensor3d_t batch_hashes;
+    bmatrix_init_arena(&binarized, batch_rows, input_size, &arena);
+    bmatrix_init_arena(&reordered, batch_rows, input_size, &arena);
+    tensor_init_arena(&batch_hashes, batch_rows, model.num_filters, model.filter_hashes, &arena);
+    uint64_t* batch_predictions = (uint64_t*) arena_alloc(&arena, batch_rows * sizeof(uint64_t));
+    uint64_t* ids = (uint64_t*) arena_alloc(&arena, max_batch * sizeof(uint64_t));
+    uint64_t* arrival_us = (uint64_t*) arena_alloc(&arena, max_batch * sizeof(uint64_t));
+    server_response_t* responses = (server_response_t*) arena_alloc(&arena, max_batch * sizeof(server_response_t));
+
+    broadcast_model_to_dpus(dpu_set);
+    if(dpu_hashing)
+        broadcast_hash_parameters_to_dpus(dpu_set);
+
+    int listen_fd = -1;
+    int stdout_fd = -1;
+    server_handle_signals();
+    if(p->socket_path != NULL) {
+        listen_fd = server_listen_unix(p->socket_path);
+        if(listen_fd < 0) {
+            printf("Not able to listen on socket %s\n", p->socket_path);
+            return;
+        }
+        printf("Serving on %s\n", p->socket_path);
+    } else {
+        stdout_fd = server_redirect_stdout();
+    }
+
+    latency_histogram_t latencies, window;
+    batch_controller_t controller;
+    batch_controller_init(&controller, p->slo_us, max_batch);
+
+    while(!server_stopping()) {
+        int in_fd = listen_fd >= 0 ? server_accept(listen_fd) : STDIN_FILENO;
+        int out_fd = listen_fd >= 0 ? in_fd : stdout_fd;
+        if(in_fd < 0) continue;
+
+        latency_histogram_reset(&latencies);
+        latency_histogram_reset(&window);
+        size_t num_batches = 0;
+        int connected = 1;
+        const uint64_t session_start_us = server_now_us();
+
+        request_queue_t queue;
+        request_queue_start(&queue, in_fd, input_size, SERVER_QUEUE_BATCHES * max_batch);
+
+        size_t num_requests;
+        while((num_requests = request_queue_take(&queue, binarized.data, ids, arrival_us, 
+            batch_controller_batch(&controller), batch_controller_max_wait_us(&controller))) > 0) {
+            const uint64_t service_start_us = server_now_us();
+
+            reorder_dataset(&reordered, &binarized, model.input_order, num_requests, input_size);
+            if(!dpu_hashing)
+                batch_hashing(&batch_hashes, &model, &reordered, num_requests);
+
+            dpu_params_t input_arguments[NR_DPUS];
+            for(unsigned int i = 0; i < nr_of_dpus; i++) {
+                const unsigned int dpu_num_samples = NUM_SAMPLES(nr_of_dpus, num_requests, i);
+                input_arguments[i] = (dpu_params_t) {
+                    .model_size_bytes = model_bytes,
+
+                    .input_size_bytes = dpu_num_samples * bytes_per_sample,
+                    .input_transfer_size_bytes = dpu_input_transfer_size_bytes,
+
+                    .output_size_bytes = dpu_num_samples * sizeof(uint64_t),
+                    .output_transfer_size_bytes = dpu_output_transfer_size_bytes,
+
+                    .nr_inputs = dpu_num_samples,
+
+                    .kernel = p->kernel,
+                    .probe_batch = coalesced_probe_batch(&model),
+                    .input_sample_bytes = input_sample_bytes,
+                    .hash_tasklets = p->hash_tasklets,
+                    .ring_slots = ring_slots,
+                    .model_id = p->model_id
+                };
+            }
+
+            // Only the share of the micro-batch is transferred, the layout stays the one of the largest batch
+            const unsigned int dpu_num_samples_batch = divceil(num_requests, nr_of_dpus);
+            const unsigned int batch_input_transfer_size_bytes = dpu_hashing ? dpu_num_samples_batch * input_sample_bytes
+                : aligned_count(hashes_per_sample * dpu_num_samples_batch, sizeof(entry_t)) * sizeof(entry_t);
+            const unsigned int batch_output_transfer_size_bytes = aligned_count(dpu_num_samples_batch, sizeof(uint64_t)) * sizeof(uint64_t);
+            // Small micro-batches leave too few samples per DPU to fill the pipeline of its tasklets
+            if(p->kernel == kernel1)
+                for(unsigned int i = 0; i < nr_of_dpus; i++)
+                    input_arguments[i].kernel = tuner_full_evaluation_kernel(&model, dpu_num_samples_batch);
+
+            push_input_arguments(dpu_set, input_arguments);
+            if(dpu_hashing)
+                push_inputs_to_dpus(dpu_set, nr_of_dpus, input_arguments, &reordered, model_bytes, batch_input_transfer_size_bytes);
+            else
+                push_hashes_to_dpus(dpu_set, nr_of_dpus, input_arguments, &batch_hashes, model_bytes, batch_input_transfer_size_bytes);
+            DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
+            retrieve_data_from_dpus(dpu_set, nr_of_dpus, input_arguments, batch_predictions, model_bytes, dpu_input_transfer_size_bytes, batch_output_transfer_size_bytes);
+
+            for(size_t it = 0; it < num_requests; ++it)
+                responses[it] = (server_response_t) { .id = ids[it], .prediction = batch_predictions[it] };
+            if(connected)
+                connected = server_write_full(out_fd, responses, num_requests * sizeof(server_response_t));
+
+            const uint64_t done_us = server_now_us();
+            for(size_t it = 0; it < num_requests; ++it) {
+                latency_histogram_record(&latencies, done_us - arrival_us[it]);
+                latency_histogram_record(&window, done_us - arrival_us[it]);
+            }
+            batch_controller_update(&controller, num_requests, done_us - service_start_us);
+            if(window.count >= SERVER_WINDOW_REQUESTS) {
+                batch_controller_feedback(&controller, latency_histogram_percentile(&window, 99.0));
+                latency_histogram_reset(&window);
+            }
+            num_batches++;
+        }
+        request_queue_stop(&queue);
+
+        const double elapsed_s = (server_now_us() - session_start_us) / 1e6;
+        printf("server, requests, batches, mean batch, throughput (req/s), mean, p50, p90, p99, p999, max (us), target p99 (us)\n");
+        printf("server, %lu, %zu, %.2f, %.1f, %.1f, %lu, %lu, %lu, %lu, %lu, %u\n",
+            (unsigned long) latencies.count, num_batches, num_batches > 0 ? (double) latencies.count / num_batches : 0.0,
+            elapsed_s > 0 ? latencies.count / elapsed_s : 0.0, latencies.count > 0 ? latencies.sum_us / latencies.count : 0.0,
+            (unsigned long) latency_histogram_percentile(&latencies, 50.0), (unsigned long) latency_histogram_percentile(&latencies, 90.0),
+            (unsigned long) latency_histogram_percentile(&latencies, 99.0), (unsigned long) latency_histogram_percentile(&latencies, 99.9),
+            (unsigned long) latencies.max_us, p->slo_us);
+        latency_histogram_print(&latencies);
+        fflush(stdout);
+
+        if(listen_fd < 0) break; // stdin is closed
+        server_close(in_fd);
+    }
+    if(listen_fd >= 0) {
+        server_close(listen_fd);
+        unlink(p->socket_path);
+    }
+
+    arena_free(&arena);
+}
+
+// Picks the kernel (and probe batch of kernel_coalesced) of the batches with the lowest predicted time. The costs
+// of tuner.h are fitted to short launches of samples_per_dpu samples, on the first samples of the hashed batch.
+static void autotune_launch(struct dpu_set_t dpu_set, unsigned int nr_dpus, struct Params* p, unsigned int model_bytes, unsigned int num_samples,
+    unsigned int dpu_samples_max, bool cache_hit, bmatrix_t* input_reordered, bmatrix_t* input_binarized, unsigned int* probe_batch, tuner_estimate_t* choice) {
+
+    Timer timer;
+    tuner_costs_t costs = { 0 };
+    const unsigned int sample_bytes = model.num_filters * model.filter_hashes * sizeof(entry_t);
+    unsigned int samples_per_dpu = p->autotune_samples;
+    if(samples_per_dpu * nr_dpus > num_samples)
+        samples_per_dpu = num_samples / nr_dpus;
+    if(samples_per_dpu > dpu_samples_max)
+        samples_per_dpu = dpu_samples_max;
+    assert(samples_per_dpu > 0 && "Too few samples for the calibration launches!");
+    const unsigned int calibration_samples = samples_per_dpu * nr_dpus;
+
+    // Host preprocessing, skipped with a cache hit as in the timed loop
+    if(!cache_hit) {
+        start(&timer, 0, 0);
+        reorder_dataset(input_reordered, input_binarized, model.input_order, calibration_samples, MNIST_IM_SIZE * model.bits_per_input);
+        batch_hashing(&hashes, &model, input_reordered, calibration_samples);
+        stop(&timer, 0);
+        costs.host_sample_s = timer.time[0] / 1e6 / calibration_samples;
+    }
+
+    // Two sizes of the same kernel separate the launch cost, the other kernels weigh DMAs against probes
+    const unsigned int max_probe_batch = coalesced_probe_batch(&model);
+    tuner_run_t runs[TUNER_MAX_RUNS];
+    unsigned int num_runs = 0;
+    runs[num_runs++] = (tuner_run_t) { .workload = { .kernel = kernel1 }, .samples_per_dpu = samples_per_dpu / 2 > 0 ? samples_per_dpu / 2 : 1 };
+    runs[num_runs++] = (tuner_run_t) { .workload = { .kernel = kernel1 }, .samples_per_dpu = samples_per_dpu };
+    runs[num_runs++] = (tuner_run_t) { .workload = { .kernel = kernel_early_exit }, .samples_per_dpu = samples_per_dpu };
+    runs[num_runs++] = (tuner_run_t) { .workload = { .kernel = kernel_coalesced, .probe_batch = max_probe_batch }, .samples_per_dpu = samples_per_dpu };
+    if(model.class_masks != NULL)
+        runs[num_runs++] = (tuner_run_t) { .workload = { .kernel = kernel_class_masks }, .samples_per_dpu = samples_per_dpu };
+
+    double to_dpu_bytes = 0, to_dpu_s = 0, from_dpu_bytes = 0, from_dpu_s = 0;
+    for(unsigned int run_it = 0; run_it < num_runs; ++run_it) {
+        tuner_run_t* run = &runs[run_it];
+        const unsigned int input_transfer_size_bytes = ROUND_UP_TO_MULTIPLE_OF_8(run->samples_per_dpu * sample_bytes);
+        const unsigned int output_transfer_size_bytes = run->samples_per_dpu * sizeof(uint64_t);
+
+        dpu_params_t input_arguments[NR_DPUS];
+        for(unsigned int i = 0; i < nr_dpus; i++) {
+            input_arguments[i] = (dpu_params_t) {
+                .model_size_bytes = model_bytes,
+                .input_size_bytes = run->samples_per_dpu * sample_bytes,
+                .input_transfer_size_bytes = input_transfer_size_bytes,
+                .output_size_bytes = output_transfer_size_bytes,
+                .output_transfer_size_bytes = output_transfer_size_bytes,
+                .nr_inputs = run->samples_per_dpu,
+                .kernel = run->workload.kernel,
+                .probe_batch = run->workload.probe_batch > 0 ? run->workload.probe_batch : max_probe_batch,
+                .model_id = p->model_id
+            };
+        }
+        push_input_arguments(dpu_set, input_arguments);
+
+        start(&timer, 2, 0);
+        push_hashes_to_dpus(dpu_set, nr_dpus, input_arguments, &hashes, model_bytes, input_transfer_size_bytes);
+        stop(&timer, 2);
+        start(&timer, 3, 0);
+        DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
+        stop(&timer, 3);
+        start(&timer, 4, 0);
+        retrieve_data_from_dpus(dpu_set, nr_dpus, input_arguments, predictions, model_bytes, input_transfer_size_bytes, output_transfer_size_bytes);
+        stop(&timer, 4);
+
+        to_dpu_bytes += input_transfer_size_bytes;
+        to_dpu_s += timer.time[2] / 1e6;
+        from_dpu_bytes += output_transfer_size_bytes;
+        from_dpu_s += timer.time[4] / 1e6;
+        run->kernel_s = timer.time[3] / 1e6;
+        tuner_workload(&run->workload, &model, &hashes, run->samples_per_dpu * nr_dpus);
+    }
+    tuner_calibrate(&costs, runs, num_runs);
+    costs.to_dpu_byte_s = to_dpu_s / to_dpu_bytes;
+    costs.from_dpu_byte_s = from_dpu_s / from_dpu_bytes;
+
+    // launch (us), DMA setup (ns), probe (ns), host to DPU (ns/B), DPU to host (ns/B), host preprocessing (us/sample)
+    printf("autotune(costs), %u, %.3f, %.3f, %.3f, %.4f, %.4f, %.3f\n", samples_per_dpu, costs.launch_s * 1e6, costs.dma_s * 1e9,
+        costs.probe_s * 1e9, costs.to_dpu_byte_s * 1e9, costs.from_dpu_byte_s * 1e9, costs.host_sample_s * 1e6);
+
+    // Candidates: every kernel, and probe batches of kernel_coalesced in powers of two up to what fits in WRAM
+    tuner_candidate_t candidates[TUNER_MAX_CANDIDATES];
+    unsigned int num_candidates = 0;
+    candidates[num_candidates++].workload = (tuner_workload_t) { .kernel = kernel1 };
+    candidates[num_candidates++].workload = (tuner_workload_t) { .kernel = kernel_early_exit };
+    for(unsigned int batch = 1; batch < max_probe_batch && num_candidates < TUNER_MAX_CANDIDATES - 2; batch *= 2)
+        candidates[num_candidates++].workload = (tuner_workload_t) { .kernel = kernel_coalesced, .probe_batch = batch };
+    candidates[num_candidates++].workload = (tuner_workload_t) { .kernel = kernel_coalesced, .probe_batch = max_probe_batch };
+    if(model.class_masks != NULL)
+        candidates[num_candidates++].workload = (tuner_workload_t) { .kernel = kernel_class_masks };
+
+    // kernel, probe batch, DMAs, bytes and probes per sample, predicted host, to DPU, kernel, from DPU and total (ms)
+    for(unsigned int it = 0; it < num_candidates; ++it) {
+        tuner_candidate_t* candidate = &candidates[it];
+        tuner_workload(&candidate->workload, &model, &hashes, calibration_samples);
+        tuner_estimate(&candidate->estimate, &costs, &candidate->workload, sample_bytes, num_samples, nr_dpus);
+        printf("autotune(candidate), %s, %u, %.1f, %.1f, %.1f, %f, %f, %f, %f, %f\n", tuner_kernel_name(candidate->workload.kernel),
+            candidate->workload.probe_batch, candidate->workload.dmas, candidate->workload.bytes, candidate->workload.probes,
+            candidate->estimate.host_s * 1e3, candidate->estimate.to_dpu_s * 1e3, candidate->estimate.kernel_s * 1e3,
+            candidate->estimate.from_dpu_s * 1e3, candidate->estimate.total_s * 1e3);
+    }
+
+    tuner_candidate_t* best = &candidates[tuner_best(candidates, num_candidates)];
+    p->kernel = best->workload.kernel;
+    *probe_batch = best->workload.kernel == kernel_coalesced ? best->workload.probe_batch : max_probe_batch;
+    *choice = best->estimate;
+    printf("autotune(choice), %s, %u, %u, %f\n", tuner_kernel_name(p->kernel), *probe_batch, divceil(num_samples, nr_dpus), best->estimate.total_s * 1e3);
+
+    // NR_TASKLETS is fixed by the DPU binary, a rebuild with enough tasklets to fill the pipeline is only suggested
+    if(NR_TASKLETS < TUNER_PIPELINE_TASKLETS)
+        printf("autotune(tasklets), %d, %f, %d, %f\n", NR_TASKLETS, best->estimate.kernel_s * 1e3,
+            TUNER_PIPELINE_TASKLETS, tuner_kernel_s_with_tasklets(&costs, &best->estimate, TUNER_PIPELINE_TASKLETS) * 1e3);
+}
+
 // Main of the Host Application
 int main(int argc, char **argv) {
 
@@ -138,7 +1110,7 @@ printf("\n");
     // Allocate DPUs
     struct dpu_set_t dpu_set, dpu;
     uint32_t nr_of_dpus;
-    DPU_ASSERT(dpu_alloc(NR_DPUS, NULL, &dpu_set));
+    DPU_ASSERT(dpu_alloc(NR_DPUS, DPU_ALLOC_PROFILE, &dpu_set));
     DPU_ASSERT(dpu_get_nr_dpus(dpu_set, &nr_of_dpus)); // Number of DPUs in the DPU set
     printf("Allocated %d DPU(s)\t", nr_of_dpus);
     printf("NR_TASKLETS\t%d\n", NR_TASKLETS);
@@ -149,39 +1121,136 @@ printf("\n");
     // Load model
     printf("Loading model\n");
          
-    read_model(MODEL_PATH, &model);
+    // Model 0 is MODEL_PATH, the others are the additional models of the table.
+    // The class masks are only needed by their kernel, or when the auto-tuner may pick it.
+    const bool class_masks = p.kernel == kernel_class_masks || p.autotune_samples > 0;
+    load_model(MODEL_PATH, &models[0], p.counter_bytes, p.kernel == kernel_sparse, class_masks);
+    for(num_models = 1; num_models <= p.num_model_paths; ++num_models)
+        load_model(p.model_paths[num_models - 1], &models[num_models], p.counter_bytes, p.kernel == kernel_sparse, class_masks);
+    assert(p.model_id < num_models && "Invalid model id!");
+    model = models[p.model_id];
+    assert((p.kernel != kernel_class_masks || model.class_masks != NULL) && "The class masks kernel needs at most 32 classes!");
+    assert((p.autotune_samples == 0 || TUNER_KERNEL(p.kernel)) && "The auto-tuner chooses among the kernels probing host hashes!");
+
+    printf("Model %u of %u has bleach %d, %u-byte counters\n", p.model_id, num_models, model.bleach, p.counter_bytes);
 
-    printf("Model has bleach %d\n", model.bleach);
+    if(p.slo_us > 0) {
+        run_server(dpu_set, nr_of_dpus, &p);
+        DPU_ASSERT(dpu_free(dpu_set));
+        return 0;
+    }
+
+    if(p.stream_mem_mb > 0) {
+        run_streaming(dpu_set, nr_of_dpus, &p);
+        DPU_ASSERT(dpu_free(dpu_set));
+        return 0;
+    }
 
-    // Loading binarized dataset
-    printf("Loading dataset\n");
     const unsigned int num_samples = p.num_samples;
+    const bool dpu_hashing = KERNEL_CONSUMES_INPUTS(p.kernel);
+    // The dedup kernel works on the reordered inputs too, deduplicated on the host
+    const bool host_inputs = dpu_hashing || p.kernel == kernel_dedup;
+    // kernel_thermometer: raw samples are sent, binarized from the thermometer table that follows the model table
+    const bool dpu_binarizing = KERNEL_CONSUMES_PIXELS(p.kernel);
+    const unsigned int input_sample_bytes = ROUND_UP_TO_MULTIPLE_OF_8(MNIST_IM_SIZE * (dpu_binarizing ? 1 : model.bits_per_input));
+    const unsigned int thermometer_offset_bytes = build_model_directory();
+    const unsigned int model_bytes = thermometer_offset_bytes
+        + (dpu_binarizing ? ROUND_UP_TO_MULTIPLE_OF_8(model.num_inputs_total * sizeof(dpu_thermometer_input_t)) : 0);
+    const unsigned int ring_slots = dpu_hashing ? pipeline_ring_slots(&model, p.hash_tasklets, input_sample_bytes) : 0;
+
+    // Shares of the DPUs that do not fit in MRAM are split into several launches
+    capacity_plan_t plan;
+    dpu_params_t plan_config = { .model_size_bytes = model_bytes, .kernel = p.kernel, .probe_batch = coalesced_probe_batch(&model),
+        .input_sample_bytes = input_sample_bytes, .hash_tasklets = p.hash_tasklets, .ring_slots = ring_slots };
+    if(!capacity_plan(&plan, &model, &plan_config, num_samples, nr_of_dpus)) {
+        DPU_ASSERT(dpu_free(dpu_set));
+        return 1;
+    }
+    assert((p.kernel != kernel_dedup || plan.num_launches == 1) && "The dedup kernel needs the batch in one launch!");
+    printf("capacity, %u, %u, %zu, %zu, %zu\n", plan.num_launches, plan.dpu_samples_max, plan.mram_bytes, plan.model_bytes, plan.wram_bytes);
+
+    // Every host buffer comes from one arena, prefaulted here rather than in the timed regions.
+    // Transfers of the last DPUs read up to a full DPU share past num_samples, hence the padding rows.
+    const unsigned int dpu_num_samples_max = plan.dpu_samples_max;
+    const size_t host_rows = (size_t) num_samples + dpu_num_samples_max;
+    arena_t arena;
+    const size_t raw_bytes = dpu_binarizing ? ARENA_SIZE(host_rows * input_sample_bytes) : 0;
+    if(!arena_init(&arena, host_sample_buffers_bytes(host_rows, MNIST_IM_SIZE * model.bits_per_input) + raw_bytes + ARENA_SIZE(host_rows + 8), host_arena_flags(&p))) {
+        printf("Not able to map the host buffers\n");
+        DPU_ASSERT(dpu_free(dpu_set));
+        return 1;
+    }
+
+    // The hashes and reordered inputs are the destination of the dataset cache, so they are allocated first
+    tensor_init_arena(&hashes, host_rows, model.num_filters, model.filter_hashes, &arena);
+    bmatrix_t reordered_binarized_infinimnist;
+    bmatrix_init_arena(&reordered_binarized_infinimnist, host_rows, MNIST_IM_SIZE * model.bits_per_input, &arena);
+
+    // Look up the preprocessed dataset cache
+    char cache_path[DATASET_CACHE_PATH_LEN];
+    const uint64_t cache_key = dataset_cache_key(&model, DATASET_PATH);
+    bool cache_hit = false;
+    if(p.cache_dir != NULL && !dpu_binarizing) {
+        dataset_cache_path(cache_path, sizeof(cache_path), p.cache_dir, cache_key);
+        cache_hit = dataset_cache_load(cache_path, cache_key, &model, &hashes, host_inputs ? &reordered_binarized_infinimnist : NULL, num_samples);
+        printf("Dataset cache %s (%s)\n", cache_hit ? "hit" : "miss", cache_path);
+    }
+
     bmatrix_t binarized_infimnist;
-    bmatrix_init(&binarized_infimnist, num_samples, MNIST_IM_SIZE * model.bits_per_input);
-    size_t num_samples_total, sample_size;
-    read_dataset_partial("../data/binarized8m.dat", &binarized_infimnist, num_samples, &num_samples_total, &sample_size);
+    bmatrix_t raw_infimnist;
+    binarizer_t binarizer;
+    if(dpu_binarizing) {
+        // The raw samples go to the DPUs, binarized with thresholds from the statistics of the whole raw dataset:
+        // they match the precomputed binarized dataset, which the references of the host are computed from
+        printf("Loading raw dataset\n");
+        bmatrix_init_arena(&raw_infimnist, host_rows, input_sample_bytes, &arena);
+        load_patterns(&raw_infimnist, RAW_DATASET_PATH, num_samples);
+        if(!binarizer_init_file(&binarizer, RAW_DATASET_PATH, MNIST_IM_SIZE, model.bits_per_input)) exit(1); // Reported by binarizer_init_file
+        bmatrix_init_arena(&binarized_infimnist, host_rows, MNIST_IM_SIZE * model.bits_per_input, &arena);
+        size_t num_samples_total, sample_size;
+        read_dataset_partial(DATASET_PATH, &binarized_infimnist, num_samples, &num_samples_total, &sample_size);
+    }
+    else if(!cache_hit) {
+        // Loading binarized dataset
+        printf("Loading dataset\n");
+        bmatrix_init_arena(&binarized_infimnist, host_rows, MNIST_IM_SIZE * model.bits_per_input, &arena);
+        size_t num_samples_total, sample_size;
+        read_dataset_partial(DATASET_PATH, &binarized_infimnist, num_samples, &num_samples_total, &sample_size);
 
 #if PRINT
-    print_binarized_image_raw(&binarized_infimnist, infimnist_labels, 0, 2);
+        print_binarized_image_raw(&binarized_infimnist, infimnist_labels, 0, 2);
 #endif
 
-    printf("Reordering dataset\n");
-    bmatrix_t reordered_binarized_infinimnist;
-    bmatrix_init(&reordered_binarized_infinimnist, num_samples, MNIST_IM_SIZE * model.bits_per_input);
-    reorder_dataset(&reordered_binarized_infinimnist, &binarized_infimnist, model.input_order, num_samples, MNIST_IM_SIZE * model.bits_per_input);
+        printf("Reordering dataset\n");
+        reorder_dataset(&reordered_binarized_infinimnist, &binarized_infimnist, model.input_order, num_samples, MNIST_IM_SIZE * model.bits_per_input);
+    }
+
+    // The host references do not trust the cache: on a hit they are computed from the dataset itself,
+    // so a corrupted or stale cache entry shows up as mismatches
+    tensor3d_t reference_hashes = hashes;
+#if defined(CHECK_RES)
+    if(cache_hit) {
+        printf("Hashing dataset for the host references\n");
+        bmatrix_init_arena(&binarized_infimnist, host_rows, MNIST_IM_SIZE * model.bits_per_input, &arena);
+        size_t num_samples_total, sample_size;
+        read_dataset_partial(DATASET_PATH, &binarized_infimnist, num_samples, &num_samples_total, &sample_size);
+
+        bmatrix_t reference_reordered;
+        bmatrix_init(&reference_reordered, num_samples, MNIST_IM_SIZE * model.bits_per_input);
+        reorder_dataset(&reference_reordered, &binarized_infimnist, model.input_order, num_samples, MNIST_IM_SIZE * model.bits_per_input);
+        tensor_init(&reference_hashes, num_samples, model.num_filters, model.filter_hashes);
+        batch_hashing(&reference_hashes, &model, &reference_reordered, num_samples);
+        free(reference_reordered.data);
+    }
+#endif
 
     // Calculate model size (transfer size is identical to model size)
-    const unsigned int model_entries = model.filter_entries * model.num_filters * model.num_classes;
-    const unsigned int model_entry_bytes = sizeof(entry_t);
-    const unsigned int model_entries_aligned = aligned_count(model_entries, model_entry_bytes);
 
     // Input size calculations
-    const unsigned int dpu_num_samples_max = divceil(num_samples, nr_of_dpus);
-
     const unsigned int hashes_per_sample = model.num_filters * model.filter_hashes;
     const unsigned int dpu_num_hashes_max = hashes_per_sample * dpu_num_samples_max;
     const unsigned bytes_per_hash = sizeof(entry_t);
-    const unsigned int bytes_per_sample = hashes_per_sample * bytes_per_hash;
+    const unsigned int bytes_per_sample = dpu_hashing || dpu_binarizing ? input_sample_bytes : hashes_per_sample * bytes_per_hash;
     const unsigned int dpu_num_hashes_max_aligned = aligned_count(dpu_num_hashes_max, bytes_per_hash);
 
     // Output size calculations
@@ -191,155 +1260,274 @@ printf("\n");
 
     // Input/output allocation in host main memory
     printf("Input/output allocation in host main memory\n");
-    tensor_init(&hashes, num_samples, model.num_filters, model.filter_hashes);
-    predictions = (uint64_t *) calloc(num_samples, sizeof(*predictions));
-    predictions_host = (uint64_t *) calloc(num_samples, sizeof(*predictions_host));
+    predictions = (uint64_t *) arena_alloc(&arena, host_rows * sizeof(*predictions));
+    predictions_host = (uint64_t *) arena_alloc(&arena, host_rows * sizeof(*predictions_host));
+
+    // The rows of the samples of a rank are moved to its node (the arena is prefaulted, so pages migrate once here),
+    // and the preprocessing of a range of samples runs on the cores of the node they go to
+    rank_numa_t numa;
+    if(p.numa_node >= -1 && rank_numa_init(&numa, dpu_set, nr_of_dpus, &plan, num_samples, p.numa_node) > 0) {
+        size_t bound_bytes = rank_numa_bind_rows(&numa, hashes.data, hashes.stride1 * sizeof(entry_t))
+            + rank_numa_bind_rows(&numa, reordered_binarized_infinimnist.data, reordered_binarized_infinimnist.stride)
+            + rank_numa_bind_rows(&numa, predictions, sizeof(*predictions));
+        if(!cache_hit || dpu_binarizing)
+            bound_bytes += rank_numa_bind_rows(&numa, binarized_infimnist.data, binarized_infimnist.stride);
+        if(dpu_binarizing)
+            bound_bytes += rank_numa_bind_rows(&numa, raw_infimnist.data, raw_infimnist.stride);
+        parallel_set_node_map(rank_numa_sample_node, &numa);
+        printf("numa, %u, %d, %zu\n", numa.num_ranks, placement_num_nodes(), bound_bytes);
+    }
 
     unsigned int i = 0;
 
     // Transfer sizes
-    const unsigned int model_bytes = model_entries_aligned * model_entry_bytes;
-    const unsigned int dpu_input_transfer_size_bytes =  dpu_num_hashes_max_aligned * bytes_per_hash;
+    unsigned int dpu_input_transfer_size_bytes = dpu_hashing || dpu_binarizing ? dpu_num_samples_max * input_sample_bytes : dpu_num_hashes_max_aligned * bytes_per_hash;
     const unsigned int dpu_output_transfer_size_bytes = dpu_num_preds_max_aligned * bytes_per_prediction;
 
     unsigned int each_dpu = 0;
+    dpu_probe_stats_t probe_stats = { .probes = 0, .skipped_probes = 0 };
+    dpu_stage_stats_t stage_stats[2] = { { .role = PIPELINE_ROLE_HASH }, { .role = PIPELINE_ROLE_PROBE } };
 
-    printf("Batch hashing\n");
-    batch_hashing(&hashes, &model, &reordered_binarized_infinimnist, num_samples);
+    // kernel_dedup: the index rows of a DPU come first, then the records of its segment (sized per batch)
+    uint32_t dedup_records[NR_DPUS];
+    const unsigned int dedup_index_transfer_size_bytes = dpu_num_samples_max * DEDUP_INDEX_SIZE_B(model_directory[p.model_id].params);
+    const unsigned int dedup_record_bytes = DEDUP_RECORD_SIZE_B(model_directory[p.model_id].params);
+    if(p.kernel == kernel_dedup) {
+        assert(model.num_classes <= DEDUP_MAX_CLASSES && "Too many classes for the dedup kernel!");
+        batch_dedup_init(&dedup, &model, host_rows, dpu_num_samples_max);
+    }
+
+    // kernel_bleach_sweep: the labels of a DPU follow its hashes
+    uint64_t sweep_correct[SWEEP_BLEACH_VALUES] = { 0 };
+    uint64_t sweep_correct_host[SWEEP_BLEACH_VALUES] = { 0 };
+#if defined(CHECK_RES)
+    // The references of the checked samples are computed while the DPUs run
+    verifier_t verifier;
+    verifier_init(&verifier, &model, num_samples, p.verify_samples, p.verify_max_mismatches);
+#endif
+
+    // kernel_confusion: only the (label, prediction) counts of each DPU are retrieved
+    uint64_t confusion[CONFUSION_MAX_CLASSES * CONFUSION_MAX_CLASSES] = { 0 };
+    uint64_t confusion_host[CONFUSION_MAX_CLASSES * CONFUSION_MAX_CLASSES] = { 0 };
+    const unsigned int labels_offset_bytes = dpu_input_transfer_size_bytes;
+    if(KERNEL_CONSUMES_LABELS(p.kernel)) {
+        assert((p.kernel != kernel_bleach_sweep || model.num_filters <= SWEEP_MAX_FILTERS) && "Too many filters for the bleach sweep!");
+        assert((p.kernel != kernel_confusion || model.num_classes <= CONFUSION_MAX_CLASSES) && "Too many classes for the confusion matrix!");
+        labels = (unsigned char*) arena_alloc(&arena, host_rows + 8); // Label transfers are rounded up to 8 bytes
+        load_labels(labels, LABELS_PATH, num_samples);
+        dpu_input_transfer_size_bytes += ROUND_UP_TO_MULTIPLE_OF_8(dpu_num_samples_max);
+    }
+
+    if(!cache_hit && !dpu_binarizing) {
+        printf("Batch hashing\n");
+        batch_hashing(&hashes, &model, &reordered_binarized_infinimnist, num_samples);
+
+        if(p.cache_dir != NULL && !dataset_cache_store(cache_path, cache_key, &model, &hashes, host_inputs ? &reordered_binarized_infinimnist : NULL, num_samples))
+            printf("Could not store the dataset cache\n");
+    }
+
+    // The model table stays resident in MRAM across batches
+    broadcast_model_to_dpus(dpu_set);
+    if(dpu_hashing || dpu_binarizing)
+        broadcast_hash_parameters_to_dpus(dpu_set);
+    if(dpu_binarizing) {
+        broadcast_thermometer_table_to_dpus(dpu_set, &binarizer, thermometer_offset_bytes);
+        binarizer_free(&binarizer);
+    }
+
+    unsigned int probe_batch = coalesced_probe_batch(&model);
+    tuner_estimate_t autotune_choice;
+    if(p.autotune_samples > 0)
+        autotune_launch(dpu_set, nr_of_dpus, &p, model_bytes, num_samples, plan.dpu_samples_max, cache_hit, &reordered_binarized_infinimnist, &binarized_infimnist, &probe_batch, &autotune_choice);
+    if(p.kernel == kernel1)
+        printf("parallel, %s, %u\n", tuner_full_evaluation_kernel(&model, plan.dpu_samples_max) == kernel1 ? "sample" : "filter", plan.dpu_samples_max);
 
     // Loop over main kernel
     for(int rep = 0; rep < p.n_warmup + p.n_reps; rep++) {
 
+        // With a cache hit the preprocessing is skipped entirely (its timings stay at 0)
         if(rep >= p.n_warmup)
             start(&timer, 0, rep - p.n_warmup);
-        reorder_dataset(&reordered_binarized_infinimnist, &binarized_infimnist, model.input_order, num_samples, MNIST_IM_SIZE * model.bits_per_input);
+        if(!cache_hit && !dpu_binarizing)
+            reorder_dataset(&reordered_binarized_infinimnist, &binarized_infimnist, model.input_order, num_samples, MNIST_IM_SIZE * model.bits_per_input);
         if(rep >= p.n_warmup)
             stop(&timer, 0);
 
         if(rep >= p.n_warmup)
             start(&timer, 1, rep - p.n_warmup);
-        batch_hashing(&hashes, &model, &reordered_binarized_infinimnist, num_samples);
+        if(p.kernel == kernel_dedup) {
+            // Only the unique chunks of each DPU are hashed
+            const unsigned int max_records = dedup_batch_per_dpu(&reordered_binarized_infinimnist, nr_of_dpus, num_samples, dedup_records);
+            dpu_input_transfer_size_bytes = dedup_index_transfer_size_bytes + max_records * dedup_record_bytes;
+        }
+        else if(!cache_hit && !dpu_hashing && !dpu_binarizing)
+            batch_hashing(&hashes, &model, &reordered_binarized_infinimnist, num_samples);
         if(rep >= p.n_warmup)
             stop(&timer, 1);
+
+        // Statistics of the DPUs add up over the launches of the batch
+        probe_stats = (dpu_probe_stats_t) { .probes = 0, .skipped_probes = 0 };
+        for(unsigned int bleach_it = 0; bleach_it < SWEEP_BLEACH_VALUES; ++bleach_it)
+            sweep_correct[bleach_it] = 0;
+        for(unsigned int it = 0; it < model.num_classes * model.num_classes; ++it)
+            confusion[it] = 0;
+
 #if defined(CHECK_RES)
-        batch_prediction(predictions_host, &model, &binarized_infimnist, num_samples);
+        if(p.kernel != kernel_confusion)
+            verifier_start(&verifier, cache_hit ? &reference_hashes : NULL, &binarized_infimnist, num_samples);
 #endif
 
-        printf("Load DPU arguments\n");
-        // Input arguments
-        unsigned int kernel = 0;
-        dpu_model_params_t model_params = (dpu_model_params_t) {
-            .num_classes = model.num_classes,
-            .num_filters = model.num_filters,
-            .filter_inputs = model.filter_inputs,
-            .filter_entries = model.filter_entries,
-            .filter_hashes = model.filter_hashes,
-            .bleach = model.bleach
-        };
-        dpu_params_t input_arguments[NR_DPUS];
-        for(i = 0; i < nr_of_dpus; i++) {
-            const unsigned int dpu_num_samples = NUM_SAMPLES(nr_of_dpus, num_samples, i);
-            input_arguments[i] = (dpu_params_t) {
-                .model_size_bytes = model_bytes,
+        // Launches of the batch (see capacity_plan_t), each one on the next samples
+        unsigned int first_sample = 0;
+        for(unsigned int launch_it = 0; launch_it < plan.num_launches; ++launch_it) {
+            const unsigned int launch_samples = capacity_launch_samples(&plan, num_samples, launch_it);
+            const int timed_launch = (rep - p.n_warmup) * plan.num_launches + launch_it; // Timers restart with the first launch
 
-                .input_size_bytes = dpu_num_samples * bytes_per_sample,
-                .input_transfer_size_bytes = dpu_input_transfer_size_bytes,
+            printf("Load DPU arguments\n");
+            // Input arguments
+            unsigned int kernel = p.kernel == kernel1 ? tuner_full_evaluation_kernel(&model, divceil(launch_samples, nr_of_dpus)) : p.kernel;
+            dpu_params_t input_arguments[NR_DPUS];
+            for(i = 0; i < nr_of_dpus; i++) {
+                const unsigned int dpu_num_samples = NUM_SAMPLES(nr_of_dpus, launch_samples, i);
+                input_arguments[i] = (dpu_params_t) {
+                    .model_size_bytes = model_bytes,
 
-                .output_size_bytes = dpu_num_samples * bytes_per_prediction,
-                .output_transfer_size_bytes = dpu_output_transfer_size_bytes,
+                    .input_size_bytes = dpu_num_samples * bytes_per_sample,
+                    .input_transfer_size_bytes = dpu_input_transfer_size_bytes,
 
-                .nr_inputs = dpu_num_samples,
+                    .output_size_bytes = dpu_num_samples * bytes_per_prediction,
+                    .output_transfer_size_bytes = dpu_output_transfer_size_bytes,
 
-                .kernel = kernel,
-                .model_params = model_params
-            };
-            // log_input_args(input_arguments[i], i);
-        }
-        // printf("\n");
+                    .nr_inputs = dpu_num_samples,
 
+                    .kernel = kernel,
+                    .probe_batch = probe_batch,
+                    .input_sample_bytes = input_sample_bytes,
+                    .hash_tasklets = p.hash_tasklets,
+                    .ring_slots = ring_slots,
+                    .model_id = p.model_id,
+                    .dedup_records = p.kernel == kernel_dedup ? dedup_records[i] : 0,
+                    .dedup_records_offset = dedup_index_transfer_size_bytes,
+                    .labels_offset_bytes = labels_offset_bytes,
+                    .thermometer_offset_bytes = thermometer_offset_bytes
+                };
+                // log_input_args(input_arguments[i], i);
+            }
+            // printf("\n");
 
-        if(rep >= p.n_warmup)
-            start(&timer, 2, rep - p.n_warmup); // Start timer (CPU-DPU transfers)
-        i = 0;
-		// Copy input arguments
-        // Parallel transfers
-        DPU_FOREACH(dpu_set, dpu, i) {
-            DPU_ASSERT(dpu_prepare_xfer(dpu, &input_arguments[i]));
-        }
-        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(input_arguments[0]), DPU_XFER_DEFAULT));
 
-        transfer_data_to_dpus(dpu_set, nr_of_dpus, input_arguments, model_bytes, dpu_input_transfer_size_bytes);
+            if(rep >= p.n_warmup)
+                start(&timer, 2, timed_launch); // Start timer (CPU-DPU transfers)
+            i = 0;
+            // Copy input arguments
+            // Parallel transfers
+            push_input_arguments(dpu_set, input_arguments);
 
-        if(rep >= p.n_warmup)
-            stop(&timer, 2); // Stop timer (CPU-DPU transfers)
-		
-        printf("Run program on DPU(s) \n");
-        // Run DPU kernel
-        if(rep >= p.n_warmup) {
-            start(&timer, 3, rep - p.n_warmup); // Start timer (DPU kernel)
-        }
-        DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
-        if(rep >= p.n_warmup) {
-            stop(&timer, 3); // Stop timer (DPU kernel)
-        }
+            transfer_data_to_dpus(dpu_set, nr_of_dpus, input_arguments, dpu_binarizing ? &raw_infimnist : &reordered_binarized_infinimnist, first_sample, model_bytes, dpu_input_transfer_size_bytes);
+
+            if(rep >= p.n_warmup)
+                stop(&timer, 2); // Stop timer (CPU-DPU transfers)
+
+            printf("Run program on DPU(s) \n");
+            // Run DPU kernel
+            if(rep >= p.n_warmup) {
+                start(&timer, 3, timed_launch); // Start timer (DPU kernel)
+            }
+            DPU_ASSERT(dpu_launch(dpu_set, DPU_SYNCHRONOUS));
+            if(rep >= p.n_warmup) {
+                stop(&timer, 3); // Stop timer (DPU kernel)
+            }
 
 #if PRINT
-        {
-            unsigned int each_dpu = 0;
-            printf("Display DPU Logs\n");
-            DPU_FOREACH (dpu_set, dpu) {
-                printf("DPU#%d:\n", each_dpu);
-                DPU_ASSERT(dpulog_read_for_dpu(dpu.dpu, stdout));
-                each_dpu++;
+            {
+                unsigned int each_dpu = 0;
+                printf("Display DPU Logs\n");
+                DPU_FOREACH (dpu_set, dpu) {
+                    printf("DPU#%d:\n", each_dpu);
+                    DPU_ASSERT(dpulog_read_for_dpu(dpu.dpu, stdout));
+                    each_dpu++;
+                }
             }
-        }
 #endif
 
-        printf("Retrieve results\n");
-        if(rep >= p.n_warmup)
-            start(&timer, 4, rep - p.n_warmup); // Start timer (DPU-CPU transfers)
-        i = 0;
+            printf("Retrieve results\n");
+            if(rep >= p.n_warmup)
+                start(&timer, 4, timed_launch); // Start timer (DPU-CPU transfers)
+            i = 0;
 
-        retrieve_data_from_dpus(dpu_set, nr_of_dpus, input_arguments, model_bytes, dpu_input_transfer_size_bytes, dpu_output_transfer_size_bytes);
+            if(p.kernel == kernel_confusion)
+                retrieve_confusion(dpu_set, nr_of_dpus, model.num_classes, confusion);
+            else
+                retrieve_data_from_dpus(dpu_set, nr_of_dpus, input_arguments, predictions + first_sample, model_bytes, dpu_input_transfer_size_bytes, dpu_output_transfer_size_bytes);
 
-        if(rep >= p.n_warmup)
-            stop(&timer, 4); // Stop timer (DPU-CPU transfers)
+            if(rep >= p.n_warmup)
+                stop(&timer, 4); // Stop timer (DPU-CPU transfers)
+
+            if(p.kernel == kernel_early_exit || p.kernel == kernel_coalesced)
+                retrieve_probe_stats(dpu_set, nr_of_dpus, &probe_stats);
+            if(p.kernel == kernel_pipeline && rep >= p.n_warmup)
+                retrieve_stage_stats(dpu_set, nr_of_dpus, stage_stats);
+            if(p.kernel == kernel_bleach_sweep)
+                retrieve_bleach_sweep(dpu_set, nr_of_dpus, sweep_correct);
 
 #if defined(CYCLES) || defined(INSTRUCTIONS)
-        dpu_results_t results[nr_of_dpus];
-        // Parallel transfers
-        dpu_results_t* results_retrieve[nr_of_dpus];
-        DPU_FOREACH(dpu_set, dpu, i) {
-            results_retrieve[i] = (dpu_results_t*)malloc(NR_TASKLETS * sizeof(dpu_results_t));
-            DPU_ASSERT(dpu_prepare_xfer(dpu, results_retrieve[i]));
-        }
-        DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, "DPU_RESULTS", 0, NR_TASKLETS * sizeof(dpu_results_t), DPU_XFER_DEFAULT));
-        DPU_FOREACH(dpu_set, dpu, i) {
-            results[i].count = 0;
-            // Retrieve tasklet count
-            for (unsigned int each_tasklet = 0; each_tasklet < NR_TASKLETS; each_tasklet++) {
-                // printf("instr. dpu %d. tasklet %d. %d\n", i, each_tasklet, results_retrieve[i][each_tasklet].count);
-                if (results_retrieve[i][each_tasklet].count > results[i].count)
-                    results[i].count = results_retrieve[i][each_tasklet].count;
+            dpu_results_t results[nr_of_dpus];
+            // Parallel transfers
+            dpu_results_t* results_retrieve[nr_of_dpus];
+            DPU_FOREACH(dpu_set, dpu, i) {
+                results_retrieve[i] = (dpu_results_t*)malloc(NR_TASKLETS * sizeof(dpu_results_t));
+                DPU_ASSERT(dpu_prepare_xfer(dpu, results_retrieve[i]));
+            }
+            DPU_ASSERT(dpu_push_xfer(dpu_set, DPU_XFER_FROM_DPU, "DPU_RESULTS", 0, NR_TASKLETS * sizeof(dpu_results_t), DPU_XFER_DEFAULT));
+            DPU_FOREACH(dpu_set, dpu, i) {
+                results[i].count = 0;
+                // Retrieve tasklet count
+                for (unsigned int each_tasklet = 0; each_tasklet < NR_TASKLETS; each_tasklet++) {
+                    // printf("instr. dpu %d. tasklet %d. %d\n", i, each_tasklet, results_retrieve[i][each_tasklet].count);
+                    if (results_retrieve[i][each_tasklet].count > results[i].count)
+                        results[i].count = results_retrieve[i][each_tasklet].count;
+                }
+                free(results_retrieve[i]);
             }
-            free(results_retrieve[i]);
-        }
 
-        uint64_t max_count = 0;
-        uint64_t min_count = 0xFFFFFFFFFFFFFFFF;
-        // Print performance results
-        if(rep >= p.n_warmup){
-            i = 0;
-            DPU_FOREACH(dpu_set, dpu) {
-                if(results[i].count > max_count)
-                    max_count = results[i].count;
-                if(results[i].count < min_count)
-                    min_count = results[i].count;
-                i++;
+            uint64_t max_count = 0;
+            uint64_t min_count = 0xFFFFFFFFFFFFFFFF;
+            // Print performance results
+            if(rep >= p.n_warmup){
+                i = 0;
+                DPU_FOREACH(dpu_set, dpu) {
+                    if(results[i].count > max_count)
+                        max_count = results[i].count;
+                    if(results[i].count < min_count)
+                        min_count = results[i].count;
+                    i++;
+                }
+                cc += (double)max_count;
+                cc_min += (double)min_count;
             }
-            cc += (double)max_count;
-            cc_min += (double)min_count;
+#endif
+            first_sample += launch_samples;
+        }
+
+#if defined(CHECK_RES)
+        if(p.kernel != kernel_confusion)
+            verifier_check(&verifier, predictions);
+#endif
+
+        if(p.kernel == kernel_class_masks) {
+            // One probe per hash of each filter, for all classes at once
+            const uint64_t probes_per_sample = model.num_filters * model.filter_hashes;
+            probe_stats.probes += num_samples * probes_per_sample;
+            probe_stats.skipped_probes += num_samples * probes_per_sample * (model.num_classes - 1);
+        }
+        if(p.kernel == kernel_dedup) {
+            // Each record is probed once per class, instead of each filter of each sample
+            const uint64_t probes_per_record = model.num_classes * model.filter_hashes;
+            probe_stats.probes += dedup.num_records * probes_per_record;
+            probe_stats.skipped_probes += ((uint64_t) num_samples * model.num_filters - dedup.num_records) * probes_per_record;
         }
+
+#if defined(CYCLES) || defined(INSTRUCTIONS)
         // Per tasklet
         cc /= (double) NR_TASKLETS;
         cc_min /= (double) NR_TASKLETS;
@@ -347,7 +1535,29 @@ printf("\n");
 
         if(rep >= p.n_warmup)
             start(&timer, 5, rep - p.n_warmup);
-        batch_prediction(predictions_host, &model, &binarized_infimnist, num_samples);
+        if(p.kernel == kernel_early_exit)
+            batch_prediction_hashed_early_exit(predictions_host, &model, &reference_hashes, num_samples, NULL);
+        else if(p.kernel == kernel_dedup)
+            batch_prediction_dedup(predictions_host, &model, &dedup, num_samples);
+        else if(p.kernel == kernel_class_masks)
+            batch_prediction_hashed_class_masks(predictions_host, &model, &reference_hashes, num_samples);
+        else if(p.kernel == kernel_sparse)
+            batch_prediction_hashed(predictions_host, &model, &reference_hashes, num_samples); // The dense counters check the sparse layout
+        else if(p.kernel == kernel_bleach_sweep) {
+            for(unsigned int bleach_it = 0; bleach_it < SWEEP_BLEACH_VALUES; ++bleach_it)
+                sweep_correct_host[bleach_it] = 0;
+            batch_bleach_sweep(sweep_correct_host, &model, &reference_hashes, labels, num_samples, SWEEP_BLEACH_VALUES);
+        }
+        else if(p.kernel == kernel_confusion) {
+            for(unsigned int it = 0; it < model.num_classes * model.num_classes; ++it)
+                confusion_host[it] = 0;
+            batch_prediction_hashed(predictions_host, &model, &reference_hashes, num_samples);
+            batch_confusion(confusion_host, predictions_host, labels, num_samples, model.num_classes);
+        }
+        else if(cache_hit)
+            batch_prediction_hashed(predictions_host, &model, &reference_hashes, num_samples);
+        else
+            batch_prediction(predictions_host, &model, &binarized_infimnist, num_samples);
         if(rep >= p.n_warmup)
             stop(&timer, 5);
     }
@@ -384,16 +1594,68 @@ printf("\n");
     print2(&timer, 6, p.n_reps);
 
     puts("");
+
+    // Predicted against measured transfer and kernel times (ms)
+    if(p.autotune_samples > 0)
+        printf("autotune(measured), %f, %f, %f, %f, %f, %f\n", autotune_choice.to_dpu_s * 1e3, timer.time[2] / (1000 * p.n_reps),
+            autotune_choice.kernel_s * 1e3, timer.time[3] / (1000 * p.n_reps), autotune_choice.from_dpu_s * 1e3, timer.time[4] / (1000 * p.n_reps));
+
+    if(p.kernel == kernel_early_exit || p.kernel == kernel_coalesced || p.kernel == kernel_dedup || p.kernel == kernel_class_masks) {
+        uint64_t total_probes = probe_stats.probes + probe_stats.skipped_probes;
+        printf("probes(%s), %lu, %lu, %.2f%%\n", p.kernel == kernel_early_exit ? "early_exit" : p.kernel == kernel_coalesced ? "coalesced" 
+            : p.kernel == kernel_dedup ? "dedup" : "class_masks", 
+            (unsigned long) probe_stats.probes, (unsigned long) probe_stats.skipped_probes,
+            total_probes > 0 ? 100.0 * probe_stats.skipped_probes / total_probes : 0.0);
+    }
+    if(p.kernel == kernel_pipeline) {
+        // Occupancy: share of its active time a stage spent working rather than waiting on the ring
+        for(unsigned int role = 0; role < 2; ++role) {
+            uint64_t active = stage_stats[role].busy + stage_stats[role].wait;
+            printf("pipeline(%s), %u, %u, %lu, %.2f%%\n", role == PIPELINE_ROLE_HASH ? "hash" : "probe",
+                role == PIPELINE_ROLE_HASH ? p.hash_tasklets : NR_TASKLETS - p.hash_tasklets, ring_slots,
+                (unsigned long) stage_stats[role].items, active > 0 ? 100.0 * stage_stats[role].busy / active : 0.0);
+        }
+    }
+    if(p.kernel == kernel_bleach_sweep) {
+        // Accuracy at every bleach from the last repetition, the best bleach is the lowest of the ties
+        unsigned int best_bleach = 0;
+        for(unsigned int bleach_it = 0; bleach_it < SWEEP_BLEACH_VALUES; ++bleach_it) {
+            printf("bleach_sweep, %u, %lu, %.2f%%\n", bleach_it, (unsigned long) sweep_correct[bleach_it], 100.0 * sweep_correct[bleach_it] / num_samples);
+            if(sweep_correct[bleach_it] > sweep_correct[best_bleach]) best_bleach = bleach_it;
+        }
+        printf("bleach_sweep(best), %u, %.2f%%\n", best_bleach, 100.0 * sweep_correct[best_bleach] / num_samples);
+#if defined(CHECK_RES)
+        if(memcmp(sweep_correct, sweep_correct_host, sizeof(sweep_correct)) != 0)
+            printf("\n[" ANSI_COLOR_RED "ERROR" ANSI_COLOR_RESET "] Bleach sweeps differ!\n");
+#endif
+    }
+
+    if(p.kernel == kernel_confusion) {
+        // Rows are labels, columns are predictions, from the last repetition
+        uint64_t correct = 0;
+        for(unsigned int label_it = 0; label_it < model.num_classes; ++label_it) {
+            printf("confusion, %u", label_it);
+            for(unsigned int prediction_it = 0; prediction_it < model.num_classes; ++prediction_it)
+                printf(", %lu", (unsigned long) confusion[label_it * model.num_classes + prediction_it]);
+            puts("");
+            correct += confusion[label_it * model.num_classes + label_it];
+        }
+        printf("confusion(accuracy), %lu, %.2f%%\n", (unsigned long) correct, 100.0 * correct / num_samples);
+    }
+    parallel_set_node_map(NULL, NULL);
+
 #if defined(CHECK_RES)
     // Check output
     bool status = true;
-    for (i = 0; i < num_samples; i++) {
-        if(predictions_host[i] != predictions[i]) {
-            status = false;
-            printf("Sample %d> %u -- %u_ \n", i, predictions[i], predictions_host[i]);
-        }
-        // printf("Sample %d> %u -- %u_ \n", i, predictions[i], predictions_host[i]);
+    if(p.kernel == kernel_confusion)
+        status = memcmp(confusion, confusion_host, model.num_classes * model.num_classes * sizeof(*confusion)) == 0;
+    else {
+        verifier_report(&verifier);
+        status = verifier.total_mismatches == 0;
     }
+    verifier_free(&verifier);
+    if(cache_hit)
+        free(reference_hashes.data);
     if (status) {
         printf("\n[" ANSI_COLOR_GREEN "OK" ANSI_COLOR_RESET "] Outputs are equal\n");
     } else {
@@ -405,6 +1667,9 @@ printf("\n");
     // free(X);
     // free(Y);
     // free(Y_host);
+    if(p.kernel == kernel_dedup)
+        batch_dedup_free(&dedup);
+    arena_free(&arena);
     DPU_ASSERT(dpu_free(dpu_set)); // Deallocate DPUs
 	
     return 0;
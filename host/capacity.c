@@ -0,0 +1,87 @@
+#include "capacity.h"
+
+// WRAM heap the kernel allocates over all tasklets (see the mem_alloc calls of dpu/task.c)
+static size_t kernel_wram_bytes(model_t* model, dpu_params_t* config) {
+    const size_t hashes_block_b = ROUND_UP_TO_MULTIPLE_OF_8(model->num_filters * model->filter_hashes * sizeof(uint32_t));
+    const size_t popcounts_b = ROUND_UP_TO_MULTIPLE_OF_8(model->num_classes * sizeof(uint32_t));
+    const size_t probe_batch = config->probe_batch;
+
+    switch(config->kernel) {
+    case kernel_coalesced:
+        return NR_TASKLETS * (COALESCE_WINDOW_B + probe_batch * hashes_block_b
+            + ROUND_UP_TO_MULTIPLE_OF_8(probe_batch * model->filter_hashes * sizeof(uint32_t))
+            + ROUND_UP_TO_MULTIPLE_OF_8(probe_batch * sizeof(uint32_t))
+            + ROUND_UP_TO_MULTIPLE_OF_8(probe_batch * model->num_classes * sizeof(uint32_t)));
+    case kernel_pipeline:
+        return config->ring_slots * hashes_block_b + config->hash_tasklets * config->input_sample_bytes
+            + (NR_TASKLETS - config->hash_tasklets) * (8 + popcounts_b);
+    case kernel_dedup:
+        return NR_TASKLETS * (8 + DEDUP_RECORD_SIZE_B(*model) + DEDUP_INDEX_SIZE_B(*model) + popcounts_b);
+    case kernel_class_masks:
+        return NR_TASKLETS * (8 + hashes_block_b + 32 * sizeof(uint32_t));
+    case kernel_bleach_sweep:
+        return NR_TASKLETS * (16 + hashes_block_b + popcounts_b + ROUND_UP_TO_MULTIPLE_OF_8(model->num_classes * SWEEP_BLEACH_VALUES));
+    case kernel_confusion:
+        return NR_TASKLETS * (16 + hashes_block_b + popcounts_b + ROUND_UP_TO_MULTIPLE_OF_8(model->num_classes * model->num_classes * sizeof(uint32_t)));
+    case kernel_filter_parallel:
+        return NR_TASKLETS * (16 + ROUND_UP_TO_MULTIPLE_OF_8(divceil(model->num_filters, NR_TASKLETS) * model->filter_hashes * sizeof(uint32_t) + 4))
+            + 2 * NR_TASKLETS * popcounts_b;
+    case kernel_thermometer:
+        return NR_TASKLETS * (8 + config->input_sample_bytes + THERMOMETER_BLOCK_B + hashes_block_b + popcounts_b);
+    default:
+        return NR_TASKLETS * (8 + hashes_block_b + popcounts_b);
+    }
+}
+
+// MRAM of a sample in the input region of a launch
+static size_t kernel_input_bytes(model_t* model, dpu_params_t* config) {
+    if(KERNEL_CONSUMES_INPUTS(config->kernel) || KERNEL_CONSUMES_PIXELS(config->kernel))
+        return config->input_sample_bytes;
+    if(config->kernel == kernel_dedup) // Every chunk of the sample unique
+        return DEDUP_INDEX_SIZE_B(*model) + model->num_filters * DEDUP_RECORD_SIZE_B(*model);
+    return model->num_filters * model->filter_hashes * sizeof(entry_t) + (KERNEL_CONSUMES_LABELS(config->kernel) ? 1 : 0);
+}
+
+bool capacity_plan(capacity_plan_t* plan, model_t* model, dpu_params_t* config, size_t num_samples, unsigned int nr_dpus) {
+    const size_t hashes_block_b = ROUND_UP_TO_MULTIPLE_OF_8(model->num_filters * model->filter_hashes * sizeof(uint32_t));
+
+    plan->model_bytes = config->model_size_bytes;
+    plan->sample_bytes = kernel_input_bytes(model, config) + sizeof(uint64_t);
+    plan->wram_bytes = kernel_wram_bytes(model, config);
+
+    if(plan->wram_bytes > WRAM_HEAP_BUDGET_B) {
+        printf("Capacity: the kernel buffers need %zu bytes of WRAM, %u are available\n", plan->wram_bytes, WRAM_HEAP_BUDGET_B);
+        return false;
+    }
+    if(KERNEL_CONSUMES_PIXELS(config->kernel) && model->filter_inputs * sizeof(dpu_thermometer_input_t) > THERMOMETER_BLOCK_B - 8) {
+        printf("Capacity: the thermometer inputs of a filter take %zu bytes, a block holds %u\n",
+            model->filter_inputs * sizeof(dpu_thermometer_input_t), THERMOMETER_BLOCK_B - 8);
+        return false;
+    }
+    if(!KERNEL_CONSUMES_INPUTS(config->kernel) && !KERNEL_CONSUMES_PIXELS(config->kernel) && config->kernel != kernel_dedup && hashes_block_b > DPU_MRAM_READ_MAX_B) {
+        printf("Capacity: the hashes of a sample take %zu bytes, one MRAM read takes at most %u\n", hashes_block_b, DPU_MRAM_READ_MAX_B);
+        return false;
+    }
+
+    // Slack for the alignment of the regions of a launch (hashes are padded to a multiple of 8 entries)
+    const size_t padding_b = 64;
+    if(plan->model_bytes + padding_b + plan->sample_bytes > DPU_MRAM_HEAP_B) {
+        printf("Capacity: the model table takes %zu bytes of MRAM, a sample needs %zu more of the %u available\n",
+            plan->model_bytes, plan->sample_bytes, DPU_MRAM_HEAP_B);
+        return false;
+    }
+    const size_t dpu_samples_fit = (DPU_MRAM_HEAP_B - plan->model_bytes - padding_b) / plan->sample_bytes;
+    const size_t dpu_samples_batch = divceil(num_samples, nr_dpus);
+
+    // Full launches, the remainder of the batch goes to the last one
+    plan->dpu_samples_max = dpu_samples_batch < dpu_samples_fit ? dpu_samples_batch : dpu_samples_fit;
+    plan->launch_samples = dpu_samples_batch < dpu_samples_fit ? num_samples : plan->dpu_samples_max * nr_dpus;
+    plan->num_launches = divceil(num_samples, plan->launch_samples);
+    plan->mram_bytes = plan->model_bytes + padding_b + plan->dpu_samples_max * plan->sample_bytes;
+    return true;
+}
+
+unsigned int capacity_launch_samples(capacity_plan_t* plan, size_t num_samples, unsigned int launch_it) {
+    const size_t first_sample = (size_t) launch_it * plan->launch_samples;
+    return num_samples - first_sample < plan->launch_samples ? num_samples - first_sample : plan->launch_samples;
+}
@@ -0,0 +1,48 @@
+#ifndef CAPACITY_H
+#define CAPACITY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "../support/common.h"
+#include "../cbthowen/model.h"
+
+/**
+ * MRAM and WRAM budget of a DPU for a model and a batch. The model table stays resident at the start of the MRAM
+ * heap, then each launch lays out the inputs of its samples and their predictions. A batch whose share of a DPU
+ * does not fit is split into launches of as many samples as fit, the last one taking the remainder.
+ */
+
+// MRAM of a DPU past DPU_MRAM_HEAP_POINTER (the DPU binary keeps no __mram variable)
+#define DPU_MRAM_HEAP_B (64u << 20)
+// Largest mram_read: the kernels reading the hashes of a sample at once need them to fit
+#define DPU_MRAM_READ_MAX_B 2048
+
+typedef struct {
+    size_t model_bytes; // Resident model table
+    size_t sample_bytes; // MRAM of a sample in a launch: its inputs (at worst for kernel_dedup), its label and its prediction
+    size_t wram_bytes; // WRAM heap of all tasklets
+    unsigned int dpu_samples_max; // Largest share of a DPU in one launch
+    unsigned int launch_samples; // Samples of a full launch over all DPUs
+    unsigned int num_launches;
+    size_t mram_bytes; // MRAM used by the largest launch
+} capacity_plan_t;
+
+/**
+ * @brief Plans the launches of a batch, or explains on stdout why the configuration cannot run
+ *
+ * @param config Launch the batch is run with: model_size_bytes, kernel, probe_batch, input_sample_bytes,
+ * hash_tasklets and ring_slots are used
+ * @param num_samples Samples of the batch, or the largest batch of a session
+ * @return false if a single sample does not fit in MRAM, or if the kernel buffers do not fit in WRAM
+ */
+bool capacity_plan(capacity_plan_t* plan, model_t* model, dpu_params_t* config, size_t num_samples, unsigned int nr_dpus);
+
+/**
+ * @brief Samples of the launch `launch_it` of the plan, out of num_samples
+ */
+unsigned int capacity_launch_samples(capacity_plan_t* plan, size_t num_samples, unsigned int launch_it);
+
+#endif
@@ -0,0 +1,91 @@
+#include "rank_numa.h"
+#include "../cbthowen/placement.h"
+
+#include <dpu_management.h>
+
+// Node of the PCI device of a rank, as reported by the driver (the ranks of a set are not the first ones of the machine)
+static int rank_node(struct dpu_set_t rank) {
+    const int node = dpu_get_rank_numa_node(dpu_rank_from_set(rank));
+    return node >= 0 ? node : -1;
+}
+
+unsigned int rank_numa_init(rank_numa_t* numa, struct dpu_set_t dpu_set, unsigned int nr_dpus, capacity_plan_t* plan, size_t num_samples, int forced_node) {
+    struct dpu_set_t rank, dpu;
+    uint32_t rank_it;
+    unsigned int dpu_it = 0, known = 0;
+    const int single_node = placement_num_nodes() <= 1;
+
+    numa->nr_dpus = nr_dpus;
+    numa->num_ranks = 0;
+    numa->plan = plan;
+    numa->num_samples = num_samples;
+
+    // DPUs are numbered rank after rank, as in the DPU_FOREACH of the transfers
+    DPU_RANK_FOREACH(dpu_set, rank, rank_it) {
+        assert(rank_it < RANK_NUMA_MAX_RANKS && "Too many ranks for the NUMA placement!");
+        numa->rank_node[rank_it] = single_node ? -1 : forced_node >= 0 ? forced_node : rank_node(rank);
+        if(numa->rank_node[rank_it] >= 0) ++known;
+        DPU_FOREACH(rank, dpu) {
+            numa->rank_of_dpu[dpu_it++] = rank_it;
+        }
+        numa->num_ranks = rank_it + 1;
+    }
+    assert(dpu_it == nr_dpus);
+    return known;
+}
+
+// Calls fn on the rows [begin; end) of each DPU of the launch, from first_sample on
+static void launch_dpu_rows(rank_numa_t* numa, unsigned int launch_it, size_t first_sample,
+    void (*fn)(rank_numa_t* numa, unsigned int dpu_it, size_t begin, size_t end, void* ctx), void* ctx) {
+    const size_t launch_samples = capacity_launch_samples(numa->plan, numa->num_samples, launch_it);
+    size_t begin = first_sample;
+    for(unsigned int dpu_it = 0; dpu_it < numa->nr_dpus; ++dpu_it) {
+        const size_t dpu_samples = launch_samples / numa->nr_dpus + (launch_samples % numa->nr_dpus > dpu_it ? 1 : 0);
+        fn(numa, dpu_it, begin, begin + dpu_samples, ctx);
+        begin += dpu_samples;
+    }
+}
+
+typedef struct {
+    size_t sample;
+    int node;
+} sample_node_ctx_t;
+
+static void find_sample(rank_numa_t* numa, unsigned int dpu_it, size_t begin, size_t end, void* arg) {
+    sample_node_ctx_t* ctx = (sample_node_ctx_t*) arg;
+    if(ctx->sample >= begin && ctx->sample < end)
+        ctx->node = numa->rank_node[numa->rank_of_dpu[dpu_it]];
+}
+
+int rank_numa_sample_node(void* arg, size_t sample) {
+    rank_numa_t* numa = (rank_numa_t*) arg;
+    // Padding rows past the batch belong to no DPU
+    if(sample >= numa->num_samples) return -1;
+
+    const unsigned int launch_it = sample / numa->plan->launch_samples;
+    sample_node_ctx_t ctx = { .sample = sample, .node = -1 };
+    launch_dpu_rows(numa, launch_it, (size_t) launch_it * numa->plan->launch_samples, find_sample, &ctx);
+    return ctx.node;
+}
+
+typedef struct {
+    unsigned char* rows;
+    size_t row_bytes;
+    size_t bound_bytes;
+} bind_rows_ctx_t;
+
+static void bind_dpu_rows(rank_numa_t* numa, unsigned int dpu_it, size_t begin, size_t end, void* arg) {
+    bind_rows_ctx_t* ctx = (bind_rows_ctx_t*) arg;
+    const int node = numa->rank_node[numa->rank_of_dpu[dpu_it]];
+    if(node < 0 || end == begin) return;
+
+    if(placement_bind_range(ctx->rows + begin * ctx->row_bytes, (end - begin) * ctx->row_bytes, node) == 0)
+        ctx->bound_bytes += (end - begin) * ctx->row_bytes;
+}
+
+size_t rank_numa_bind_rows(rank_numa_t* numa, void* rows, size_t row_bytes) {
+    bind_rows_ctx_t ctx = { .rows = (unsigned char*) rows, .row_bytes = row_bytes, .bound_bytes = 0 };
+    for(unsigned int launch_it = 0; launch_it < numa->plan->num_launches; ++launch_it)
+        launch_dpu_rows(numa, launch_it, (size_t) launch_it * numa->plan->launch_samples, bind_dpu_rows, &ctx);
+    return ctx.bound_bytes;
+}
@@ -0,0 +1,49 @@
+#ifndef RANK_NUMA_H
+#define RANK_NUMA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <dpu.h>
+
+#include "capacity.h"
+
+/**
+ * NUMA placement of the batch mode. The ranks of a DPU set may hang off different sockets: the host rows of the
+ * samples a rank receives (inputs, hashes, predictions) are kept on its node, and the threads preprocessing them
+ * run on its cores. On a single node, or if the node of a rank is unknown, nothing is moved nor pinned.
+ */
+
+// Ranks of the largest UPMEM servers
+#define RANK_NUMA_MAX_RANKS 40
+
+typedef struct {
+    unsigned int nr_dpus;
+    unsigned int num_ranks;
+    unsigned int rank_of_dpu[NR_DPUS];
+    int rank_node[RANK_NUMA_MAX_RANKS]; // -1 if unknown
+    capacity_plan_t* plan; // Launches the rows of the batch are split into
+    size_t num_samples;
+} rank_numa_t;
+
+/**
+ * @brief Finds the node of each rank of dpu_set
+ *
+ * @param forced_node Node of every rank if non-negative, otherwise the node of each rank is queried from the SDK
+ * @return Number of ranks with a known node
+ */
+unsigned int rank_numa_init(rank_numa_t* numa, struct dpu_set_t dpu_set, unsigned int nr_dpus, capacity_plan_t* plan, size_t num_samples, int forced_node);
+
+/**
+ * @brief Node of the rank the sample is sent to, a parallel_node_fn_t on a rank_numa_t
+ */
+int rank_numa_sample_node(void* numa, size_t sample);
+
+/**
+ * @brief Moves each slice of rows (one row per sample of the batch) to the node of the rank the samples go to
+ *
+ * @return Bytes moved to a node
+ */
+size_t rank_numa_bind_rows(rank_numa_t* numa, void* rows, size_t row_bytes);
+
+#endif
@@ -0,0 +1,312 @@
+#define _GNU_SOURCE
+#include "server.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Decay of the service time fit per batch
+#define BATCH_CONTROLLER_DECAY 0.9
+#define BATCH_CONTROLLER_MAX_SLACK 0.5
+#define BATCH_CONTROLLER_MIN_SLACK 0.05
+// Period at which blocked reads and accepts check for a stop request
+#define SERVER_POLL_MS 100
+
+static volatile sig_atomic_t server_stop_requested = 0;
+
+uint64_t server_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void latency_histogram_reset(latency_histogram_t* h) {
+    memset(h, 0, sizeof(*h));
+}
+
+static size_t latency_bucket(uint64_t latency_us) {
+    if(latency_us < LATENCY_SUB_BUCKETS) return latency_us;
+
+    unsigned int exponent = 63 - __builtin_clzll(latency_us); // >= 4
+    size_t sub_bucket = (latency_us >> (exponent - 4)) & (LATENCY_SUB_BUCKETS - 1);
+    size_t bucket = (exponent - 3) * LATENCY_SUB_BUCKETS + sub_bucket;
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+static uint64_t latency_bucket_lower(size_t bucket) {
+    if(bucket < LATENCY_SUB_BUCKETS) return bucket;
+
+    unsigned int exponent = bucket / LATENCY_SUB_BUCKETS + 3;
+    return (uint64_t) (LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << (exponent - 4);
+}
+
+static uint64_t latency_bucket_upper(size_t bucket) {
+    return bucket + 1 < LATENCY_BUCKETS ? latency_bucket_lower(bucket + 1) - 1 : UINT64_MAX;
+}
+
+void latency_histogram_record(latency_histogram_t* h, uint64_t latency_us) {
+    h->counts[latency_bucket(latency_us)]++;
+    h->count++;
+    h->sum_us += latency_us;
+    if(latency_us > h->max_us) h->max_us = latency_us;
+}
+
+uint64_t latency_histogram_percentile(latency_histogram_t* h, double percentile) {
+    if(h->count == 0) return 0;
+
+    uint64_t rank = (uint64_t) (percentile / 100.0 * h->count + 0.5);
+    if(rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for(size_t bucket = 0; bucket < LATENCY_BUCKETS; ++bucket) {
+        seen += h->counts[bucket];
+        if(seen >= rank) {
+            uint64_t upper = latency_bucket_upper(bucket);
+            return upper < h->max_us ? upper : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+void latency_histogram_print(latency_histogram_t* h) {
+    for(size_t bucket = 0; bucket < LATENCY_BUCKETS; ++bucket) {
+        if(h->counts[bucket] == 0) continue;
+        printf("latency_histogram, %lu, %lu, %lu\n", (unsigned long) latency_bucket_lower(bucket),
+            (unsigned long) latency_bucket_upper(bucket), (unsigned long) h->counts[bucket]);
+    }
+}
+
+void batch_controller_init(batch_controller_t* c, uint64_t target_us, size_t max_batch) {
+    memset(c, 0, sizeof(*c));
+    c->target_us = target_us;
+    c->max_batch = max_batch;
+    c->slack = BATCH_CONTROLLER_MAX_SLACK;
+    c->batch = 1; // Grows as soon as the service time is known
+}
+
+size_t batch_controller_batch(batch_controller_t* c) {
+    return c->batch;
+}
+
+uint64_t batch_controller_max_wait_us(batch_controller_t* c) {
+    return (uint64_t) (c->target_us * (1.0 - c->slack));
+}
+
+// Largest batch whose fitted service time fits in the slack of the target
+static void batch_controller_resize(batch_controller_t* c) {
+    if(c->w == 0 || c->sb == 0) return;
+
+    double per_sample_us = c->st / c->sb;
+    double fixed_us = 0;
+    double denominator = c->w * c->sbb - c->sb * c->sb;
+    if(denominator > 1e-9 * c->w * c->sbb) {
+        double slope = (c->w * c->sbt - c->sb * c->st) / denominator;
+        if(slope > 0) {
+            per_sample_us = slope;
+            fixed_us = (c->st - slope * c->sb) / c->w;
+            if(fixed_us < 0) fixed_us = 0;
+        }
+    }
+
+    double budget_us = c->slack * c->target_us - fixed_us;
+    double batch = per_sample_us > 0 ? budget_us / per_sample_us : (double) c->max_batch;
+    if(batch < 1) batch = 1;
+    if(batch > c->max_batch) batch = c->max_batch;
+    c->batch = (size_t) batch;
+}
+
+void batch_controller_update(batch_controller_t* c, size_t batch, uint64_t service_us) {
+    c->w = BATCH_CONTROLLER_DECAY * c->w + 1;
+    c->sb = BATCH_CONTROLLER_DECAY * c->sb + batch;
+    c->sbb = BATCH_CONTROLLER_DECAY * c->sbb + (double) batch * batch;
+    c->st = BATCH_CONTROLLER_DECAY * c->st + service_us;
+    c->sbt = BATCH_CONTROLLER_DECAY * c->sbt + (double) batch * service_us;
+    batch_controller_resize(c);
+}
+
+void batch_controller_feedback(batch_controller_t* c, uint64_t p99_us) {
+    if(p99_us > c->target_us)
+        c->slack = c->slack * 0.8 > BATCH_CONTROLLER_MIN_SLACK ? c->slack * 0.8 : BATCH_CONTROLLER_MIN_SLACK;
+    else
+        c->slack = c->slack * 1.05 < BATCH_CONTROLLER_MAX_SLACK ? c->slack * 1.05 : BATCH_CONTROLLER_MAX_SLACK;
+    batch_controller_resize(c);
+}
+
+static int read_full(int fd, void* buffer, size_t size) {
+    unsigned char* bytes = (unsigned char*) buffer;
+    while(size > 0) {
+        ssize_t ret = read(fd, bytes, size);
+        if(ret <= 0) return 0;
+        bytes += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+int server_write_full(int fd, const void* buffer, size_t size) {
+    const unsigned char* bytes = (const unsigned char*) buffer;
+    while(size > 0) {
+        ssize_t ret = write(fd, bytes, size);
+        if(ret <= 0) return 0;
+        bytes += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+static void server_request_stop(int signum) {
+    (void) signum;
+    server_stop_requested = 1;
+}
+
+void server_handle_signals() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = server_request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+}
+
+int server_stopping() {
+    return server_stop_requested;
+}
+
+// Waits until fd has data (or is closed), returns 0 once the server is stopping
+static int wait_readable(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while(!server_stop_requested) {
+        int ret = poll(&pfd, 1, SERVER_POLL_MS);
+        if(ret > 0) return 1;
+        if(ret < 0 && errno != EINTR) return 0;
+    }
+    return 0;
+}
+
+static void* request_queue_reader(void* arg) {
+    request_queue_t* q = (request_queue_t*) arg;
+    unsigned char* sample = (unsigned char*) malloc(q->sample_bytes);
+    uint64_t id;
+
+    while(wait_readable(q->fd) && read_full(q->fd, &id, sizeof(id)) && read_full(q->fd, sample, q->sample_bytes)) {
+        uint64_t arrival_us = server_now_us();
+
+        pthread_mutex_lock(&q->mutex);
+        while(q->count == q->capacity)
+            pthread_cond_wait(&q->changed, &q->mutex);
+        size_t slot = (q->head + q->count) % q->capacity;
+        memcpy(q->samples + slot * q->sample_bytes, sample, q->sample_bytes);
+        q->ids[slot] = id;
+        q->arrival_us[slot] = arrival_us;
+        q->count++;
+        pthread_cond_broadcast(&q->changed);
+        pthread_mutex_unlock(&q->mutex);
+    }
+
+    pthread_mutex_lock(&q->mutex);
+    q->eof = 1;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->mutex);
+
+    free(sample);
+    return NULL;
+}
+
+void request_queue_start(request_queue_t* q, int fd, size_t sample_bytes, size_t capacity) {
+    q->fd = fd;
+    q->sample_bytes = sample_bytes;
+    q->capacity = capacity;
+    q->samples = (unsigned char*) malloc(capacity * sample_bytes);
+    q->ids = (uint64_t*) malloc(capacity * sizeof(uint64_t));
+    q->arrival_us = (uint64_t*) malloc(capacity * sizeof(uint64_t));
+    q->head = 0;
+    q->count = 0;
+    q->eof = 0;
+
+    // Deadlines are on the monotonic clock, like the arrival times
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&q->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&q->mutex, NULL);
+
+    pthread_create(&q->reader, NULL, request_queue_reader, q);
+}
+
+size_t request_queue_take(request_queue_t* q, unsigned char* samples, uint64_t* ids, uint64_t* arrival_us, size_t max_batch, uint64_t max_wait_us) {
+    pthread_mutex_lock(&q->mutex);
+    while(q->count == 0 && !q->eof)
+        pthread_cond_wait(&q->changed, &q->mutex);
+
+    if(q->count > 0) {
+        uint64_t deadline_us = q->arrival_us[q->head] + max_wait_us;
+        struct timespec deadline = { .tv_sec = deadline_us / 1000000, .tv_nsec = (deadline_us % 1000000) * 1000 };
+        while(q->count < max_batch && q->count < q->capacity && !q->eof && server_now_us() < deadline_us)
+            pthread_cond_timedwait(&q->changed, &q->mutex, &deadline);
+    }
+
+    size_t taken = q->count < max_batch ? q->count : max_batch;
+    for(size_t it = 0; it < taken; ++it) {
+        size_t slot = (q->head + it) % q->capacity;
+        memcpy(samples + it * q->sample_bytes, q->samples + slot * q->sample_bytes, q->sample_bytes);
+        ids[it] = q->ids[slot];
+        arrival_us[it] = q->arrival_us[slot];
+    }
+    q->head = (q->head + taken) % q->capacity;
+    q->count -= taken;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->mutex);
+
+    return taken;
+}
+
+void request_queue_stop(request_queue_t* q) {
+    pthread_join(q->reader, NULL);
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->changed);
+    free(q->samples);
+    free(q->ids);
+    free(q->arrival_us);
+}
+
+int server_listen_unix(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+
+    unlink(path);
+    if(bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int server_accept(int listen_fd) {
+    if(!wait_readable(listen_fd)) return -1;
+    return accept(listen_fd, NULL, NULL);
+}
+
+void server_close(int fd) {
+    close(fd);
+}
+
+int server_redirect_stdout() {
+    fflush(stdout);
+    int stdout_fd = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    return stdout_fd;
+}
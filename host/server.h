@@ -0,0 +1,119 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/**
+ * Framing of the server mode, on stdin/stdout or on a Unix socket connection:
+ *  request:  uint64_t id, then the binarized sample (one byte per input, 0 or 1)
+ *  response: a server_response_t, in the order the requests were received
+ */
+typedef struct {
+    uint64_t id;
+    uint64_t prediction;
+} server_response_t;
+
+uint64_t server_now_us();
+
+// Log-linear latency histogram: power of two ranges split in LATENCY_SUB_BUCKETS linear buckets
+#define LATENCY_SUB_BUCKETS 16
+#define LATENCY_BUCKETS (LATENCY_SUB_BUCKETS * 38) // Up to 2^41 us
+
+typedef struct {
+    uint64_t counts[LATENCY_BUCKETS];
+    uint64_t count;
+    uint64_t max_us;
+    double sum_us;
+} latency_histogram_t;
+
+void latency_histogram_reset(latency_histogram_t* h);
+void latency_histogram_record(latency_histogram_t* h, uint64_t latency_us);
+
+/**
+ * @brief Latency under which a share `percentile` (in %) of the recorded requests fall,
+ * rounded up to the upper bound of its bucket
+ */
+uint64_t latency_histogram_percentile(latency_histogram_t* h, double percentile);
+
+// Prints one line per non-empty bucket: lower bound, upper bound (us), count
+void latency_histogram_print(latency_histogram_t* h);
+
+/**
+ * Sizes micro-batches for a p99 latency target. The service time of a batch is fitted as
+ * fixed_us + per_sample_us * batch over recent batches; a batch may take at most `slack` of the target
+ * and its oldest request may wait the rest. The slack shrinks while the observed p99 misses the target.
+ */
+typedef struct {
+    double target_us;
+    size_t max_batch;
+    double slack;
+
+    // Exponentially decayed sums of the least-squares fit
+    double w, sb, sbb, st, sbt;
+
+    size_t batch;
+} batch_controller_t;
+
+void batch_controller_init(batch_controller_t* c, uint64_t target_us, size_t max_batch);
+size_t batch_controller_batch(batch_controller_t* c);
+uint64_t batch_controller_max_wait_us(batch_controller_t* c);
+void batch_controller_update(batch_controller_t* c, size_t batch, uint64_t service_us);
+void batch_controller_feedback(batch_controller_t* c, uint64_t p99_us);
+
+// Requests received by a reader thread, waiting to be batched
+typedef struct {
+    int fd;
+    size_t sample_bytes;
+    size_t capacity;
+
+    unsigned char* samples; // (capacity, sample_bytes) ring
+    uint64_t* ids;
+    uint64_t* arrival_us;
+    size_t head;
+    size_t count;
+    int eof;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    pthread_t reader;
+} request_queue_t;
+
+void request_queue_start(request_queue_t* q, int fd, size_t sample_bytes, size_t capacity);
+
+/**
+ * @brief Waits for a micro-batch: returns as soon as max_batch requests are queued, the oldest request
+ * has waited max_wait_us or the input is closed (the reader also stops once the server is stopping).
+ *
+ * @param q
+ * @param samples Rows of sample_bytes bytes, at least max_batch of them
+ * @param ids
+ * @param arrival_us
+ * @param max_batch
+ * @param max_wait_us
+ * @return size_t Number of requests taken, 0 once the input is closed and drained
+ */
+size_t request_queue_take(request_queue_t* q, unsigned char* samples, uint64_t* ids, uint64_t* arrival_us, size_t max_batch, uint64_t max_wait_us);
+
+void request_queue_stop(request_queue_t* q);
+
+// Writes the whole buffer, returns 0 if the peer is gone
+int server_write_full(int fd, const void* buffer, size_t size);
+
+// SIGINT and SIGTERM ask the server to stop: the requests already received are answered, then the server returns.
+// SIGPIPE is ignored, so that a client or consumer leaving does not stop the server.
+void server_handle_signals();
+int server_stopping();
+
+// Listening Unix stream socket at path (replacing a stale socket file), -1 on error
+int server_listen_unix(const char* path);
+// Next connection, -1 on error or once the server is stopping
+int server_accept(int listen_fd);
+void server_close(int fd);
+
+// Moves the logs of stdout to stderr, returns a descriptor of the original stdout for the responses
+int server_redirect_stdout();
+
+#endif
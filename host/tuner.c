@@ -0,0 +1,202 @@
+#include "tuner.h"
+#include "../cbthowen/batch.h"
+
+#include <math.h>
+#include <string.h>
+
+#define TUNER_NUM_COSTS 3 // launch_s, dma_s, probe_s
+
+static int compare_entries(const void* a, const void* b) {
+    entry_t x = *(const entry_t*) a, y = *(const entry_t*) b;
+    return (x > y) - (x < y);
+}
+
+// Mirrors the windows of coalesced_kernel: the sorted probes of a filter for probe_batch samples are read
+// in DMAs of up to COALESCE_WINDOW_B, and the same windows are read for every class
+static void coalesced_windows(tuner_workload_t* workload, model_t* model, tensor3d_t* hashes, size_t num_samples) {
+    const size_t entry_bytes = model->packed_data != NULL ? model->counter_bytes : sizeof(entry_t);
+    const size_t max_probes = workload->probe_batch * model->filter_hashes;
+    entry_t* entries = (entry_t*) malloc(max_probes * sizeof(*entries));
+
+    double dmas = 0, bytes = 0;
+    for(size_t batch_start = 0; batch_start < num_samples; batch_start += workload->probe_batch) {
+        const size_t batch_size = num_samples - batch_start < workload->probe_batch ? num_samples - batch_start : workload->probe_batch;
+        const size_t num_probes = batch_size * model->filter_hashes;
+
+        for(size_t filter_it = 0; filter_it < model->num_filters; ++filter_it) {
+            for(size_t batch_it = 0; batch_it < batch_size; ++batch_it)
+                memcpy(&entries[batch_it * model->filter_hashes], TENSOR3D_AXIS2(*hashes, batch_start + batch_it, filter_it), model->filter_hashes * sizeof(entry_t));
+            qsort(entries, num_probes, sizeof(*entries), compare_entries);
+
+            size_t probe_it = 0;
+            while(probe_it < num_probes) {
+                const size_t window_addr = ROUND_DOWN_TO_MULTIPLE_OF_8(entries[probe_it] * entry_bytes);
+                size_t last_addr = window_addr;
+                while(probe_it < num_probes && entries[probe_it] * entry_bytes + entry_bytes <= window_addr + COALESCE_WINDOW_B)
+                    last_addr = entries[probe_it++] * entry_bytes;
+
+                dmas += model->num_classes;
+                bytes += model->num_classes * ROUND_UP_TO_MULTIPLE_OF_8(last_addr + entry_bytes - window_addr);
+            }
+        }
+    }
+    free(entries);
+
+    workload->dmas += dmas / num_samples;
+    workload->bytes += bytes / num_samples;
+}
+
+void tuner_workload(tuner_workload_t* workload, model_t* model, tensor3d_t* hashes, size_t num_samples) {
+    assert(TUNER_KERNEL(workload->kernel) && num_samples > 0);
+
+    // Every kernel reads the hashes of the sample first
+    const size_t hashes_block_b = ROUND_UP_TO_MULTIPLE_OF_8(model->num_filters * model->filter_hashes * sizeof(entry_t));
+    const double all_probes = model->num_classes * model->num_filters * model->filter_hashes;
+    workload->dmas = divceil(hashes_block_b, 2048);
+    workload->bytes = hashes_block_b;
+    workload->probes = 0;
+
+    if(workload->kernel == kernel1) {
+        workload->dmas += all_probes;
+        workload->bytes += 8 * all_probes;
+        workload->probes = all_probes;
+    }
+    else if(workload->kernel == kernel_early_exit) {
+        size_t* predictions = (size_t*) malloc(num_samples * sizeof(*predictions));
+        size_t probes = 0;
+        batch_prediction_hashed_early_exit(predictions, model, hashes, num_samples, &probes);
+        free(predictions);
+
+        workload->dmas += (double) probes / num_samples;
+        workload->bytes += 8.0 * probes / num_samples;
+        workload->probes = (double) probes / num_samples;
+    }
+    else if(workload->kernel == kernel_coalesced) {
+        coalesced_windows(workload, model, hashes, num_samples);
+        workload->probes = all_probes;
+    }
+    else {
+        // One mask per hash of each filter answers for all classes
+        const double masks = model->num_filters * model->filter_hashes;
+        workload->dmas += masks;
+        workload->bytes += 8 * masks;
+        workload->probes = masks;
+    }
+}
+
+// Solves the normal equations restricted to the enabled costs, by Gaussian elimination
+static bool solve_least_squares(double* solution, double x[][TUNER_NUM_COSTS], double* y, size_t num_rows, bool* enabled) {
+    size_t index[TUNER_NUM_COSTS], n = 0;
+    for(size_t it = 0; it < TUNER_NUM_COSTS; ++it) {
+        solution[it] = 0;
+        if(enabled[it]) index[n++] = it;
+    }
+
+    double a[TUNER_NUM_COSTS][TUNER_NUM_COSTS + 1] = { { 0 } };
+    for(size_t i = 0; i < n; ++i) {
+        for(size_t j = 0; j < n; ++j)
+            for(size_t row = 0; row < num_rows; ++row)
+                a[i][j] += x[row][index[i]] * x[row][index[j]];
+        for(size_t row = 0; row < num_rows; ++row)
+            a[i][n] += x[row][index[i]] * y[row];
+    }
+
+    for(size_t col = 0; col < n; ++col) {
+        size_t pivot = col;
+        for(size_t row = col + 1; row < n; ++row)
+            if(fabs(a[row][col]) > fabs(a[pivot][col])) pivot = row;
+        if(fabs(a[pivot][col]) < 1e-30) return false;
+        for(size_t it = 0; it <= n; ++it) {
+            double tmp = a[col][it]; a[col][it] = a[pivot][it]; a[pivot][it] = tmp;
+        }
+        for(size_t row = 0; row < n; ++row) {
+            if(row == col) continue;
+            double factor = a[row][col] / a[col][col];
+            for(size_t it = col; it <= n; ++it)
+                a[row][it] -= factor * a[col][it];
+        }
+    }
+    for(size_t it = 0; it < n; ++it)
+        solution[index[it]] = a[it][n] / a[it][it];
+    return true;
+}
+
+void tuner_calibrate(tuner_costs_t* costs, tuner_run_t* runs, size_t num_runs) {
+    assert(num_runs <= TUNER_MAX_RUNS);
+
+    double x[TUNER_MAX_RUNS][TUNER_NUM_COSTS], y[TUNER_MAX_RUNS];
+    for(size_t it = 0; it < num_runs; ++it) {
+        tuner_workload_t* workload = &runs[it].workload;
+        x[it][0] = 1;
+        x[it][1] = runs[it].samples_per_dpu * (workload->dmas + TUNER_DMA_BYTE_RATIO * workload->bytes);
+        x[it][2] = runs[it].samples_per_dpu * workload->probes;
+        y[it] = runs[it].kernel_s;
+    }
+
+    bool enabled[TUNER_NUM_COSTS] = { true, true, true };
+    double solution[TUNER_NUM_COSTS];
+    for(size_t attempt = 0; attempt < TUNER_NUM_COSTS; ++attempt) {
+        bool solved = solve_least_squares(solution, x, y, num_runs, enabled);
+
+        size_t most_negative = TUNER_NUM_COSTS;
+        for(size_t it = 0; it < TUNER_NUM_COSTS; ++it)
+            if(enabled[it] && (!solved || solution[it] < 0) && (most_negative == TUNER_NUM_COSTS || solution[it] < solution[most_negative]))
+                most_negative = it;
+        if(most_negative == TUNER_NUM_COSTS) break;
+        enabled[most_negative] = false;
+        solution[most_negative] = 0;
+    }
+
+    costs->launch_s = solution[0] > 0 ? solution[0] : 0;
+    costs->dma_s = solution[1] > 0 ? solution[1] : 0;
+    costs->dma_byte_s = TUNER_DMA_BYTE_RATIO * costs->dma_s;
+    costs->probe_s = solution[2] > 0 ? solution[2] : 0;
+}
+
+void tuner_estimate(tuner_estimate_t* estimate, tuner_costs_t* costs, tuner_workload_t* workload, size_t sample_bytes, size_t num_samples, unsigned int nr_dpus) {
+    const double samples_per_dpu = divceil(num_samples, nr_dpus);
+
+    estimate->host_s = num_samples * costs->host_sample_s;
+    estimate->to_dpu_s = samples_per_dpu * sample_bytes * costs->to_dpu_byte_s;
+    estimate->kernel_s = costs->launch_s
+        + samples_per_dpu * (workload->dmas * costs->dma_s + workload->bytes * costs->dma_byte_s + workload->probes * costs->probe_s);
+    estimate->from_dpu_s = samples_per_dpu * sizeof(uint64_t) * costs->from_dpu_byte_s;
+    estimate->total_s = estimate->host_s + estimate->to_dpu_s + estimate->kernel_s + estimate->from_dpu_s;
+}
+
+size_t tuner_best(tuner_candidate_t* candidates, size_t num_candidates) {
+    size_t best = 0;
+    for(size_t it = 1; it < num_candidates; ++it)
+        if(candidates[it].estimate.total_s < candidates[best].estimate.total_s) best = it;
+    return best;
+}
+
+double tuner_kernel_s_with_tasklets(tuner_costs_t* costs, tuner_estimate_t* estimate, unsigned int tasklets) {
+    const double built = NR_TASKLETS < TUNER_PIPELINE_TASKLETS ? NR_TASKLETS : TUNER_PIPELINE_TASKLETS;
+    const double target = tasklets < TUNER_PIPELINE_TASKLETS ? tasklets : TUNER_PIPELINE_TASKLETS;
+    return costs->launch_s + (estimate->kernel_s - costs->launch_s) * built / target;
+}
+
+// Adding up a partial popcount of a class, relative to a probe (its DMA included)
+#define TUNER_REDUCTION_PROBE_RATIO 0.1
+
+unsigned int tuner_full_evaluation_kernel(model_t* model, unsigned int dpu_samples) {
+    // In units of a sample evaluated on one tasklet: a round of n tasklets lasts max(P, n) since each one issues
+    // every P cycles at most. kernel1 runs full rounds of NR_TASKLETS samples then the remainder, kernel_filter_parallel
+    // runs every sample over all tasklets on ranges of the filters, then tasklet 0 adds up NR_TASKLETS partials alone.
+    const double pipeline = TUNER_PIPELINE_TASKLETS;
+    const double round = NR_TASKLETS > pipeline ? NR_TASKLETS : pipeline;
+    const unsigned int remainder = dpu_samples % NR_TASKLETS;
+    const double sample_parallel = (dpu_samples / NR_TASKLETS) * round
+        + (remainder == 0 ? 0 : remainder > pipeline ? remainder : pipeline);
+
+    const double filter_share = (double) divceil(model->num_filters, NR_TASKLETS) / model->num_filters;
+    const double reduction = NR_TASKLETS * TUNER_REDUCTION_PROBE_RATIO * pipeline / (model->num_filters * model->filter_hashes);
+    const double filter_parallel = dpu_samples * (filter_share * round + reduction);
+
+    return filter_parallel < sample_parallel ? kernel_filter_parallel : kernel1;
+}
+
+const char* tuner_kernel_name(unsigned int kernel) {
+    return kernel == kernel1 ? "full" : kernel == kernel_early_exit ? "early_exit" : kernel == kernel_coalesced ? "coalesced" : "class_masks";
+}
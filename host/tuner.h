@@ -0,0 +1,110 @@
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "../support/common.h"
+#include "../cbthowen/model.h"
+
+/**
+ * Analytical cost model of a batch launch, for the kernels working on host hashes. A sample costs each DPU
+ * its MRAM DMAs (a setup plus a cost per byte) and the counters it compares. The costs are calibrated by short
+ * launches of the kernels, then the configuration with the lowest predicted time is picked for the whole batch.
+ */
+
+// Kernels the tuner chooses from: same inputs (hashes) and outputs (predictions)
+#define TUNER_KERNEL(k) ((k) == kernel1 || (k) == kernel_early_exit || (k) == kernel_coalesced || (k) == kernel_class_masks)
+// A DMA byte costs about 0.5 cycles against 77 cycles of setup: only their sum is observable in calibration launches
+#define TUNER_DMA_BYTE_RATIO (0.5 / 77.0)
+// Tasklets needed to fill the DPU pipeline, fewer tasklets leave issue slots idle
+#define TUNER_PIPELINE_TASKLETS 11
+#define TUNER_MAX_CANDIDATES 16
+#define TUNER_MAX_RUNS 8
+
+typedef struct {
+    double launch_s; // Fixed cost of a launch
+    double dma_s; // Setup of an MRAM DMA, per DPU
+    double dma_byte_s; // Per byte DMA'd, TUNER_DMA_BYTE_RATIO * dma_s
+    double probe_s; // Per counter compared, apart from its DMA
+    double to_dpu_byte_s; // Host to DPU, per byte of each DPU (transfers to all DPUs are parallel)
+    double from_dpu_byte_s; // DPU to host, per byte of each DPU
+    double host_sample_s; // Host reordering and hashing, per sample
+} tuner_costs_t;
+
+// DPU work of one sample for a kernel configuration
+typedef struct {
+    unsigned int kernel;
+    unsigned int probe_batch; // kernel_coalesced
+    double dmas;
+    double bytes;
+    double probes;
+} tuner_workload_t;
+
+typedef struct {
+    double host_s;
+    double to_dpu_s;
+    double kernel_s;
+    double from_dpu_s;
+    double total_s;
+} tuner_estimate_t;
+
+typedef struct {
+    tuner_workload_t workload;
+    tuner_estimate_t estimate;
+} tuner_candidate_t;
+
+// A calibration launch: samples_per_dpu samples of the workload took kernel_s
+typedef struct {
+    tuner_workload_t workload;
+    unsigned int samples_per_dpu;
+    double kernel_s;
+} tuner_run_t;
+
+/**
+ * @brief Counts the DPU work per sample of a kernel configuration on the given hashed samples
+ *
+ * @param workload Its kernel and probe_batch are set by the caller
+ * @param model With packed counters of counter_bytes
+ * @param hashes of shape (num_samples, #num_filters, #filter_hashes)
+ * @param num_samples
+ */
+void tuner_workload(tuner_workload_t* workload, model_t* model, tensor3d_t* hashes, size_t num_samples);
+
+/**
+ * @brief Fits launch_s, dma_s (and dma_byte_s) and probe_s to the calibration launches, in the least squares sense.
+ * A cost that comes out negative is dropped and the others are fitted again.
+ */
+void tuner_calibrate(tuner_costs_t* costs, tuner_run_t* runs, size_t num_runs);
+
+/**
+ * @brief Predicted time of each phase of a batch of num_samples split over nr_dpus
+ *
+ * @param sample_bytes Bytes of the hashes of a sample
+ */
+void tuner_estimate(tuner_estimate_t* estimate, tuner_costs_t* costs, tuner_workload_t* workload, size_t sample_bytes, size_t num_samples, unsigned int nr_dpus);
+
+/**
+ * @brief Index of the candidate with the lowest predicted total time
+ */
+size_t tuner_best(tuner_candidate_t* candidates, size_t num_candidates);
+
+/**
+ * @brief Short name of a kernel the tuner chooses from
+ */
+const char* tuner_kernel_name(unsigned int kernel);
+
+/**
+ * @brief Kernel time predicted with `tasklets` tasklets, from an estimate made with the NR_TASKLETS of the build
+ */
+double tuner_kernel_s_with_tasklets(tuner_costs_t* costs, tuner_estimate_t* estimate, unsigned int tasklets);
+
+/**
+ * @brief Layout of a full evaluation over the tasklets for a DPU share of dpu_samples samples: kernel1 when the
+ * samples keep the pipeline busy, kernel_filter_parallel when too few of them run at once to fill it
+ */
+unsigned int tuner_full_evaluation_kernel(model_t* model, unsigned int dpu_samples);
+
+#endif
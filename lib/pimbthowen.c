@@ -0,0 +1,269 @@
+#include "pimbthowen.h"
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "../cbthowen/data_manager.h"
+#include "../cbthowen/data_loader.h"
+#include "../cbthowen/batch.h"
+#include "../cbthowen/packed_model.h"
+
+#define NUM_SAMPLES(num_dpus, num_samples, dpu_idx) (num_samples / num_dpus + (num_samples % num_dpus > dpu_idx ? 1 : 0))
+
+// Kernels a session can feed: they only need the model and the hashes (or reordered inputs) of the batch.
+// A kernel joins this list together with the setup it needs (class masks, sparse layout, labels, ...)
+#define SESSION_KERNEL(k) ((k) == kernel1 || (k) == kernel_early_exit || (k) == kernel_coalesced || (k) == kernel_pipeline || (k) == kernel_filter_parallel)
+
+// Returns 0 from the calling function on a DPU error
+#define SESSION_CHECK(call) do { if((call) != DPU_OK) return 0; } while(0)
+
+// Same sizing as the benchmark host (see coalesced_probe_batch and pipeline_ring_slots in host/app.c)
+static unsigned int session_probe_batch(model_t* model) {
+    const unsigned int tasklet_budget = WRAM_HEAP_BUDGET_B / NR_TASKLETS - COALESCE_WINDOW_B;
+    const unsigned int bytes_per_sample = ROUND_UP_TO_MULTIPLE_OF_8(model->num_filters * model->filter_hashes * sizeof(entry_t))
+        + model->filter_hashes * sizeof(uint32_t) + sizeof(uint32_t) + model->num_classes * sizeof(uint32_t);
+
+    unsigned int probe_batch = tasklet_budget / bytes_per_sample;
+    if(probe_batch > COALESCE_MAX_PROBES / model->filter_hashes)
+        probe_batch = COALESCE_MAX_PROBES / model->filter_hashes;
+    return probe_batch > 0 ? probe_batch : 1;
+}
+
+static unsigned int session_ring_slots(model_t* model, unsigned int hash_tasklets, unsigned int input_sample_bytes) {
+    const unsigned int hashes_block_b = ROUND_UP_TO_MULTIPLE_OF_8(model->num_filters * model->filter_hashes * sizeof(uint32_t));
+    const unsigned int probe_buffers_b = 8 + ROUND_UP_TO_MULTIPLE_OF_8(model->num_classes * sizeof(uint32_t));
+    const unsigned int used_b = hash_tasklets * input_sample_bytes + (NR_TASKLETS - hash_tasklets) * probe_buffers_b;
+
+    unsigned int ring_slots = used_b < WRAM_HEAP_BUDGET_B ? (WRAM_HEAP_BUDGET_B - used_b) / hashes_block_b : 0;
+    return ring_slots > PIPELINE_MAX_SLOTS ? PIPELINE_MAX_SLOTS : ring_slots;
+}
+
+// Model table of a single model, and the hash parameters for kernels hashing on the DPUs
+static int session_broadcast_model(pimbthowen_session_t* session) {
+    model_t* model = &session->model;
+
+    dpu_model_entry_t directory[MAX_MODELS];
+    memset(directory, 0, sizeof(directory));
+    directory[0] = (dpu_model_entry_t) {
+        .offset_bytes = 0,
+        .size_bytes = session->model_bytes,
+        .hash_parameters_offset = 0,
+        .params = {
+            .num_classes = model->num_classes,
+            .num_filters = model->num_filters,
+            .filter_inputs = model->filter_inputs,
+            .filter_entries = model->filter_entries,
+            .filter_hashes = model->filter_hashes,
+            .bleach = model->bleach,
+            .entry_bytes = model->counter_bytes
+        }
+    };
+    SESSION_CHECK(dpu_broadcast_to(session->dpu_set, DPU_MRAM_HEAP_POINTER_NAME, 0, model_counters(model), session->model_bytes, DPU_XFER_DEFAULT));
+    SESSION_CHECK(dpu_broadcast_to(session->dpu_set, "DPU_MODEL_DIRECTORY", 0, directory, sizeof(directory), DPU_XFER_DEFAULT));
+
+    if(KERNEL_CONSUMES_INPUTS(session->config.kernel)) {
+        const size_t num_parameters = model->filter_hashes * model->filter_inputs;
+        if(num_parameters > MAX_HASH_PARAMETERS) return 0;
+
+        uint32_t parameters[MAX_HASH_PARAMETERS];
+        memset(parameters, 0, sizeof(parameters));
+        for(size_t hash_it = 0; hash_it < model->filter_hashes; ++hash_it)
+            for(size_t input_it = 0; input_it < model->filter_inputs; ++input_it)
+                parameters[hash_it * model->filter_inputs + input_it] = *MATRIX(model->hash_parameters, hash_it, input_it);
+        SESSION_CHECK(dpu_broadcast_to(session->dpu_set, "DPU_HASH_PARAMETERS", 0, parameters, ROUND_UP_TO_MULTIPLE_OF_8(num_parameters * sizeof(uint32_t)), DPU_XFER_DEFAULT));
+    }
+    return 1;
+}
+
+// read_model does not report errors: the file has to open, and to hold the whole model its header describes
+static int session_read_model(const char* path, model_t* model) {
+    if(is_packed_model_file(path))
+        return read_packed_model(path, model);
+
+    FILE* fd = fopen(path, "rb");
+    if(fd == NULL) return 0;
+    fclose(fd);
+
+    read_model(path, model);
+    return model->input_order != NULL && model->data.data != NULL && model_file_holds(path, model);
+}
+
+int pimbthowen_session_open(pimbthowen_session_t* session, const pimbthowen_config_t* config) {
+    memset(session, 0, sizeof(*session));
+    session->config = *config;
+
+    if(config->max_batch == 0 || !SESSION_KERNEL(config->kernel))
+        return 0;
+    if(config->kernel == kernel_pipeline && (config->hash_tasklets == 0 || config->hash_tasklets >= NR_TASKLETS))
+        return 0;
+    if(config->counter_bytes != 1 && config->counter_bytes != 2 && config->counter_bytes != 4)
+        return 0;
+
+    if(dpu_alloc(config->nr_dpus, NULL, &session->dpu_set) != DPU_OK)
+        return 0;
+    session->dpus_allocated = 1;
+    if(dpu_get_nr_dpus(session->dpu_set, &session->nr_dpus) != DPU_OK || dpu_load(session->dpu_set, config->dpu_binary, NULL) != DPU_OK) {
+        pimbthowen_session_close(session);
+        return 0;
+    }
+
+    model_t* model = &session->model;
+    if(!session_read_model(config->model_path, model)) {
+        pimbthowen_session_close(session);
+        return 0;
+    }
+    if(model->packed_data == NULL || model->counter_bytes != config->counter_bytes)
+        model_pack_counters(model, config->counter_bytes);
+
+    // MRAM layout
+    const bool dpu_hashing = KERNEL_CONSUMES_INPUTS(config->kernel);
+    const unsigned int hashes_per_sample = model->num_filters * model->filter_hashes;
+    session->input_size = model->num_inputs_total;
+    session->model_bytes = ROUND_UP_TO_MULTIPLE_OF_8(model_counters_size_bytes(model));
+    session->input_sample_bytes = ROUND_UP_TO_MULTIPLE_OF_8(session->input_size);
+    session->bytes_per_sample = dpu_hashing ? session->input_sample_bytes : hashes_per_sample * sizeof(entry_t);
+    session->dpu_num_samples_max = divceil(config->max_batch, session->nr_dpus);
+    session->dpu_input_transfer_size_bytes = dpu_hashing ? session->dpu_num_samples_max * session->input_sample_bytes
+        : aligned_count(hashes_per_sample * session->dpu_num_samples_max, sizeof(entry_t)) * sizeof(entry_t);
+    session->dpu_output_transfer_size_bytes = aligned_count(session->dpu_num_samples_max, sizeof(uint64_t)) * sizeof(uint64_t);
+    session->ring_slots = dpu_hashing ? session_ring_slots(model, config->hash_tasklets, session->input_sample_bytes) : 0;
+    if(dpu_hashing && (session->ring_slots == 0 || session->input_sample_bytes != session->input_size)) {
+        pimbthowen_session_close(session);
+        return 0;
+    }
+
+    const size_t rows = config->max_batch + session->dpu_num_samples_max;
+    bmatrix_init(&session->reordered, rows, session->input_size);
+    tensor_init(&session->hashes, rows, model->num_filters, model->filter_hashes);
+    session->predictions = (uint64_t*) calloc(rows, sizeof(uint64_t));
+    session->input_arguments = (dpu_params_t*) calloc(session->nr_dpus, sizeof(dpu_params_t));
+
+    if(!session_broadcast_model(session)) {
+        pimbthowen_session_close(session);
+        return 0;
+    }
+    return 1;
+}
+
+void pimbthowen_session_close(pimbthowen_session_t* session) {
+    if(session->pending_predictions != NULL)
+        dpu_sync(session->dpu_set);
+    if(session->dpus_allocated)
+        dpu_free(session->dpu_set);
+
+    free(session->reordered.data);
+    free(session->hashes.data);
+    free(session->predictions);
+    free(session->input_arguments);
+    model_free(&session->model);
+    memset(session, 0, sizeof(*session));
+}
+
+size_t pimbthowen_input_size(pimbthowen_session_t* session) {
+    return session->input_size;
+}
+
+// Preprocesses a batch and transfers it with its arguments
+static int session_push_batch(pimbthowen_session_t* session, const unsigned char* samples, size_t num_samples) {
+    model_t* model = &session->model;
+    const bool dpu_hashing = KERNEL_CONSUMES_INPUTS(session->config.kernel);
+
+    bmatrix_t batch = { .stride = session->input_size, .data = (unsigned char*) samples };
+    reorder_dataset(&session->reordered, &batch, model->input_order, num_samples, session->input_size);
+    if(!dpu_hashing)
+        batch_hashing(&session->hashes, model, &session->reordered, num_samples);
+
+    for(unsigned int i = 0; i < session->nr_dpus; ++i) {
+        const unsigned int dpu_num_samples = NUM_SAMPLES(session->nr_dpus, num_samples, i);
+        session->input_arguments[i] = (dpu_params_t) {
+            .model_size_bytes = session->model_bytes,
+
+            .input_size_bytes = dpu_num_samples * session->bytes_per_sample,
+            .input_transfer_size_bytes = session->dpu_input_transfer_size_bytes,
+
+            .output_size_bytes = dpu_num_samples * sizeof(uint64_t),
+            .output_transfer_size_bytes = session->dpu_output_transfer_size_bytes,
+
+            .nr_inputs = dpu_num_samples,
+
+            .kernel = session->config.kernel,
+            .probe_batch = session_probe_batch(model),
+            .input_sample_bytes = session->input_sample_bytes,
+            .hash_tasklets = session->config.hash_tasklets,
+            .ring_slots = session->ring_slots,
+            .model_id = 0
+        };
+    }
+
+    unsigned int each_dpu = 0;
+    struct dpu_set_t dpu;
+    DPU_FOREACH(session->dpu_set, dpu, each_dpu) {
+        SESSION_CHECK(dpu_prepare_xfer(dpu, &session->input_arguments[each_dpu]));
+    }
+    SESSION_CHECK(dpu_push_xfer(session->dpu_set, DPU_XFER_TO_DPU, "DPU_INPUT_ARGUMENTS", 0, sizeof(dpu_params_t), DPU_XFER_DEFAULT));
+
+    // Only the share of the batch is transferred
+    const unsigned int dpu_num_samples = divceil(num_samples, session->nr_dpus);
+    const unsigned int input_transfer_size_bytes = dpu_hashing ? dpu_num_samples * session->input_sample_bytes
+        : aligned_count(model->num_filters * model->filter_hashes * dpu_num_samples, sizeof(entry_t)) * sizeof(entry_t);
+
+    unsigned int sample_it = 0;
+    DPU_FOREACH(session->dpu_set, dpu, each_dpu) {
+        void* source = dpu_hashing ? (void*) MATRIX_AXIS1(session->reordered, sample_it) : (void*) TENSOR3D_AXIS1(session->hashes, sample_it);
+        SESSION_CHECK(dpu_prepare_xfer(dpu, source));
+        sample_it += session->input_arguments[each_dpu].nr_inputs;
+    }
+    SESSION_CHECK(dpu_push_xfer(session->dpu_set, DPU_XFER_TO_DPU, DPU_MRAM_HEAP_POINTER_NAME, session->model_bytes, input_transfer_size_bytes, DPU_XFER_DEFAULT));
+
+    return 1;
+}
+
+static int session_pull_predictions(pimbthowen_session_t* session, size_t num_samples, uint64_t* predictions) {
+    const unsigned int output_transfer_size_bytes = divceil(num_samples, session->nr_dpus) * sizeof(uint64_t);
+
+    unsigned int each_dpu = 0;
+    struct dpu_set_t dpu;
+    unsigned int pred_it = 0;
+    DPU_FOREACH(session->dpu_set, dpu, each_dpu) {
+        SESSION_CHECK(dpu_prepare_xfer(dpu, &session->predictions[pred_it]));
+        pred_it += session->input_arguments[each_dpu].nr_inputs;
+    }
+    SESSION_CHECK(dpu_push_xfer(session->dpu_set, DPU_XFER_FROM_DPU, DPU_MRAM_HEAP_POINTER_NAME,
+        session->model_bytes + session->dpu_input_transfer_size_bytes, output_transfer_size_bytes, DPU_XFER_DEFAULT));
+
+    memcpy(predictions, session->predictions, num_samples * sizeof(uint64_t));
+    return 1;
+}
+
+int pimbthowen_infer_batch(pimbthowen_session_t* session, const unsigned char* samples, size_t num_samples, uint64_t* predictions) {
+    if(session->pending_predictions != NULL) return 0;
+
+    for(size_t sample_it = 0; sample_it < num_samples; sample_it += session->config.max_batch) {
+        size_t batch = num_samples - sample_it < session->config.max_batch ? num_samples - sample_it : session->config.max_batch;
+
+        if(!session_push_batch(session, samples + sample_it * session->input_size, batch)) return 0;
+        SESSION_CHECK(dpu_launch(session->dpu_set, DPU_SYNCHRONOUS));
+        if(!session_pull_predictions(session, batch, predictions + sample_it)) return 0;
+    }
+    return 1;
+}
+
+int pimbthowen_infer_async(pimbthowen_session_t* session, const unsigned char* samples, size_t num_samples, uint64_t* predictions) {
+    if(session->pending_predictions != NULL || num_samples == 0 || num_samples > session->config.max_batch) return 0;
+
+    if(!session_push_batch(session, samples, num_samples)) return 0;
+    SESSION_CHECK(dpu_launch(session->dpu_set, DPU_ASYNCHRONOUS));
+
+    session->pending_samples = num_samples;
+    session->pending_predictions = predictions;
+    return 1;
+}
+
+int pimbthowen_wait(pimbthowen_session_t* session) {
+    if(session->pending_predictions == NULL) return 0;
+
+    uint64_t* predictions = session->pending_predictions;
+    session->pending_predictions = NULL;
+    SESSION_CHECK(dpu_sync(session->dpu_set));
+    return session_pull_predictions(session, session->pending_samples, predictions);
+}
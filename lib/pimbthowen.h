@@ -0,0 +1,93 @@
+#ifndef PIMBTHOWEN_H
+#define PIMBTHOWEN_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <dpu.h>
+
+#include "../support/common.h"
+#include "../cbthowen/tensor.h"
+#include "../cbthowen/model.h"
+
+/**
+ * libpimbthowen: BTHOWeN inference on UPMEM DPUs from another process.
+ *
+ * A session owns the DPU set (allocated and loaded once), the model resident in MRAM and transfer buffers
+ * sized for config.max_batch samples, so that a call only pays the preprocessing, transfers and launch of its batch.
+ * A session is not thread-safe: at most one batch is in flight.
+ */
+typedef struct {
+    const char* dpu_binary;
+    const char* model_path; // Full or packed model file
+    uint32_t nr_dpus; // DPU_ALLOCATE_ALL for every available DPU
+    size_t max_batch; // Samples of one launch, larger synchronous batches are split
+    unsigned int counter_bytes; // 1, 2 or 4
+    unsigned int kernel; // kernel1, kernel_early_exit, kernel_coalesced, kernel_pipeline or kernel_filter_parallel, others are rejected
+    unsigned int hash_tasklets; // kernel_pipeline only
+} pimbthowen_config_t;
+
+typedef struct {
+    pimbthowen_config_t config;
+    struct dpu_set_t dpu_set;
+    int dpus_allocated;
+    uint32_t nr_dpus;
+    model_t model;
+
+    // Layout of the MRAM of each DPU, fixed by config.max_batch
+    size_t input_size; // Bytes of a binarized sample, one per input
+    unsigned int model_bytes;
+    unsigned int input_sample_bytes;
+    unsigned int bytes_per_sample;
+    unsigned int dpu_num_samples_max;
+    unsigned int dpu_input_transfer_size_bytes;
+    unsigned int dpu_output_transfer_size_bytes;
+    unsigned int ring_slots;
+
+    // Transfer buffers: (max_batch + dpu_num_samples_max) rows, as transfers of the last DPUs read past the batch
+    bmatrix_t reordered;
+    tensor3d_t hashes;
+    uint64_t* predictions;
+    dpu_params_t* input_arguments; // (nr_dpus)
+
+    // Batch in flight (pimbthowen_infer_async)
+    size_t pending_samples;
+    uint64_t* pending_predictions;
+} pimbthowen_session_t;
+
+/**
+ * @brief Allocates and loads the DPUs, reads the model and broadcasts it, allocates the transfer buffers
+ *
+ * @param session
+ * @param config
+ * @return 1 on success, 0 otherwise, e.g. for a kernel the session cannot feed (the session is then closed)
+ */
+int pimbthowen_session_open(pimbthowen_session_t* session, const pimbthowen_config_t* config);
+
+void pimbthowen_session_close(pimbthowen_session_t* session);
+
+// Bytes of a binarized sample expected by the session
+size_t pimbthowen_input_size(pimbthowen_session_t* session);
+
+/**
+ * @brief Predicts the class of num_samples binarized samples (rows of pimbthowen_input_size bytes, 0 or 1 each)
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int pimbthowen_infer_batch(pimbthowen_session_t* session, const unsigned char* samples, size_t num_samples, uint64_t* predictions);
+
+/**
+ * @brief Preprocesses and transfers a batch of at most config.max_batch samples, then launches the DPUs without waiting.
+ * The host is free until pimbthowen_wait, which fills predictions.
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int pimbthowen_infer_async(pimbthowen_session_t* session, const unsigned char* samples, size_t num_samples, uint64_t* predictions);
+
+/**
+ * @brief Waits for the batch in flight and retrieves its predictions
+ *
+ * @return 1 on success, 0 otherwise
+ */
+int pimbthowen_wait(pimbthowen_session_t* session);
+
+#endif
@@ -0,0 +1,114 @@
+#!/bin/bash
+
+# Performance regression check on the UPMEM functional simulator: runs fixed workloads, then compares their
+# DPU cycle counts and host phase timings with the baselines. Exits with 1 on a regression.
+#
+#   ./perf_check.sh             check against perf_baselines.csv
+#   ./perf_check.sh --update    record the current values as the new baselines
+#
+# Setup: the baselines depend on the SDK and simulator versions, so they are recorded once per machine with
+# `make perf-baseline` (and again after an SDK upgrade). Until then the check is skipped rather than failed.
+
+BASELINES=perf_baselines.csv
+UPDATE=0
+if [ "$1" == "--update" ]; then
+    UPDATE=1
+    shift
+fi
+if [ -n "$1" ]; then
+    BASELINES=$1
+fi
+
+# Tolerances (%): cycle counts are deterministic on the simulator, timings are not
+CYCLES_TOLERANCE=1
+TIME_TOLERANCE=25
+TIME_FLOOR_MS=1 # Timings below this difference are noise whatever their ratio
+
+if [ ${UPDATE} -eq 0 ] && ! grep -qv '^#' ${BASELINES} 2> /dev/null; then
+    echo "perf_check: SKIPPED, no baselines in ${BASELINES}; record them on this machine with make perf-baseline"
+    exit 0
+fi
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf ${WORK_DIR}' EXIT
+LARGE_MODEL=${WORK_DIR}/synthetic_large.dat
+BUILD_DIR=${WORK_DIR}/bin # bin/ is left alone; the binaries know the path of their DPU programs
+
+# Workloads: name, NR_TASKLETS, host arguments. The synthetic large model is model 1 of the table
+declare -a NAMES=(small_t1 small_t4 small_t11 small_t16 small_early_exit_t16 large_t11 large_t16)
+declare -a TASKLETS=(1 4 11 16 16 11 16)
+declare -a ARGS=(
+    "-i 2000"
+    "-i 2000"
+    "-i 2000"
+    "-i 2000"
+    "-i 2000 -k 2"
+    "-i 500 -m ${LARGE_MODEL} -M 1"
+    "-i 500 -m ${LARGE_MODEL} -M 1"
+)
+# Columns of results_and_timings after the cycles: timers 0 (reordering), 1 (hashing) and 5 (host baseline)
+declare -a METRICS=(cycles reorder_ms hashing_ms host_ms)
+declare -a COLUMNS=(5 6 7 11)
+
+if ! SIMULATOR=1 BUILDDIR=${BUILD_DIR} make bench > /dev/null || ! ${BUILD_DIR}/bench_host -g ${LARGE_MODEL} > /dev/null; then
+    echo "perf_check: not able to build the synthetic large model"
+    exit 1
+fi
+
+RESULTS=${WORK_DIR}/results.csv
+failed=0
+for i in "${!NAMES[@]}"; do
+    if ! SIMULATOR=1 PRINT=0 PERF=CYCLES NR_DPUS=1 NR_TASKLETS=${TASKLETS[$i]} BUILDDIR=${BUILD_DIR} make > /dev/null; then
+        echo "perf_check, ${NAMES[$i]}, build failed"
+        failed=1
+        continue
+    fi
+
+    line=$(${BUILD_DIR}/host_code -w 1 -e 3 ${ARGS[$i]} 2> /dev/null | grep -a "results_and_timings(cycles)")
+    if [ -z "${line}" ]; then
+        echo "perf_check, ${NAMES[$i]}, run failed"
+        failed=1
+        continue
+    fi
+
+    for j in "${!METRICS[@]}"; do
+        value=$(echo "${line}" | cut -d, -f${COLUMNS[$j]} | tr -d ' ')
+        echo "${NAMES[$i]}, ${METRICS[$j]}, ${value}" >> ${RESULTS}
+    done
+done
+
+if [ ${UPDATE} -eq 1 ]; then
+    {
+        echo "# workload, metric, baseline, tolerance (%) -- recorded by ./perf_check.sh --update on the simulator"
+        while IFS=', ' read -r name metric value; do
+            if [ "${metric}" == "cycles" ]; then tolerance=${CYCLES_TOLERANCE}; else tolerance=${TIME_TOLERANCE}; fi
+            echo "${name}, ${metric}, ${value}, ${tolerance}"
+        done < ${RESULTS}
+    } > ${BASELINES}
+    echo "perf_check: baselines written to ${BASELINES}"
+    exit ${failed}
+fi
+
+# workload, metric, baseline, value, delta (%), status
+awk -F', *' -v floor=${TIME_FLOOR_MS} '
+    FILENAME == ARGV[1] { if($0 !~ /^#/ && NF >= 4) { baseline[$1 "," $2] = $3; tolerance[$1 "," $2] = $4 } next }
+    {
+        key = $1 "," $2
+        # A workload added after the baselines were recorded cannot be checked: it fails until recorded with --update
+        if(!(key in baseline)) { printf("perf_check, %s, %s, -, %s, -, MISSING BASELINE\n", $1, $2, $3); regressions++; next }
+        delta = baseline[key] > 0 ? 100.0 * ($3 - baseline[key]) / baseline[key] : 0
+        slack = $2 == "cycles" ? 0 : floor
+        status = "OK"
+        if(delta > tolerance[key] && $3 - baseline[key] > slack) { status = "REGRESSION"; regressions++ }
+        else if(-delta > tolerance[key] && baseline[key] - $3 > slack) status = "IMPROVED"
+        printf("perf_check, %s, %s, %s, %s, %+.2f%%, %s\n", $1, $2, baseline[key], $3, delta, status)
+    }
+    END { exit regressions > 0 }
+' ${BASELINES} ${RESULTS} || failed=1
+
+if [ ${failed} -eq 0 ]; then
+    echo "perf_check: no regression"
+else
+    echo "perf_check: FAILED"
+fi
+exit ${failed}
@@ -13,10 +13,25 @@ typedef struct {
     uint32_t filter_hashes;
     
     uint32_t bleach;
+    uint32_t entry_bytes; // Width of the model counters in MRAM: 1, 2 or 4 bytes
 } dpu_model_params_t;
 
+// Entry of the model table resident in MRAM, see DPU_MODEL_DIRECTORY
 typedef struct {
-    uint32_t model_size_bytes;
+    uint32_t offset_bytes; // Counters of the model (occupancy words in the sparse layout) start at DPU_MRAM_HEAP_POINTER + offset_bytes
+    uint32_t size_bytes;
+    uint32_t hash_parameters_offset; // First hash parameter of the model in DPU_HASH_PARAMETERS
+    uint32_t masks_offset_bytes; // Class masks of the model (kernel_class_masks) start at DPU_MRAM_HEAP_POINTER + masks_offset_bytes
+    uint32_t mask_bytes; // Width of the class masks: 1, 2 or 4 bytes, 0 if the model has none
+    uint32_t sparse_words_per_filter; // Occupancy words of a filter if the counters are in the sparse layout (kernel_sparse), 0 if they are dense
+    uint32_t sparse_values_offset_bytes; // Nonzero counters of the sparse layout start at DPU_MRAM_HEAP_POINTER + sparse_values_offset_bytes
+    dpu_model_params_t params;
+} dpu_model_entry_t;
+
+#define MAX_MODELS 8
+
+typedef struct {
+    uint32_t model_size_bytes; // Size of the whole model table, inputs start right after it
     uint32_t input_size_bytes;
     uint32_t input_transfer_size_bytes;
     uint32_t output_size_bytes;
@@ -25,20 +40,103 @@ typedef struct {
 
     enum kernels {
 	    kernel1 = 0,
-	    nr_kernels = 1,
+	    kernel_print = 1,
+	    kernel_early_exit = 2,
+	    kernel_coalesced = 3,
+	    kernel_pipeline = 4,
+	    kernel_retired_persistent = 5, // Not implemented: the SDK does not transfer to running DPUs
+	    kernel_dedup = 6,
+	    kernel_class_masks = 7,
+	    kernel_bleach_sweep = 8,
+	    kernel_confusion = 9,
+	    kernel_thermometer = 10,
+	    kernel_sparse = 11,
+	    kernel_filter_parallel = 12,
+	    nr_kernels = 13,
 	} kernel;
 
-    dpu_model_params_t model_params;
+    uint32_t probe_batch; // Samples whose probes are sorted and coalesced together (kernel_coalesced)
+
+    uint32_t input_sample_bytes; // Size of a reordered binarized sample in MRAM (kernels consuming inputs)
+    uint32_t hash_tasklets; // Tasklets hashing inputs, the others probe filters (kernel_pipeline)
+    uint32_t ring_slots; // WRAM slots between hashing and probing tasklets (kernel_pipeline)
+
+    uint32_t model_id; // Entry of DPU_MODEL_DIRECTORY the batch is evaluated with
+
+    uint32_t dedup_records; // Unique (filter, hash tuple) records of the batch of the DPU (kernel_dedup)
+    uint32_t dedup_records_offset; // Records start at this offset of the input region, after the index rows (kernel_dedup)
+
+    uint32_t labels_offset_bytes; // Labels (one byte per sample) start at this offset of the input region, after the hashes (KERNEL_CONSUMES_LABELS)
+
+    uint32_t thermometer_offset_bytes; // Thermometer table of the model inputs starts at DPU_MRAM_HEAP_POINTER + thermometer_offset_bytes (kernel_thermometer)
 } dpu_params_t;
  
 typedef struct {
     uint64_t count; // Cycle count
 } dpu_results_t;
 
+typedef struct {
+    uint32_t role; // PIPELINE_ROLE_*
+    uint32_t items; // Samples processed by the tasklet
+    uint64_t busy; // Counter ticks spent working
+    uint64_t wait; // Counter ticks spent waiting on the ring
+} dpu_stage_stats_t;
+
+#define PIPELINE_ROLE_HASH 0
+#define PIPELINE_ROLE_PROBE 1
+
+typedef struct {
+    uint64_t probes; // MRAM probes issued
+    uint64_t skipped_probes; // Probes a full evaluation would have issued on top of these
+} dpu_probe_stats_t;
+
 typedef struct {
     uint64_t prediction;
 } dpu_prediction_t;
 
+// kernel_coalesced: probes of a batch are sorted by MRAM address and fetched in windows of at most COALESCE_WINDOW_B bytes
+#define COALESCE_WINDOW_B 256
+#define COALESCE_MAX_PROBES 256 // probe_batch * filter_hashes must not exceed this
+// kernel_pipeline: hashed samples wait for probing tasklets in a ring of at most PIPELINE_MAX_SLOTS slots
+#define PIPELINE_MAX_SLOTS 16
+#define MAX_HASH_PARAMETERS 512 // filter_hashes * filter_inputs summed over the models of the table
+// Kernel ids the DPU binary implements
+#define KERNEL_VALID(k) ((k) < nr_kernels && (k) != kernel_retired_persistent)
+// kernel_dedup: a record holds a filter id then its hashes, overwritten by the mask of the responding classes
+#define DEDUP_RECORD_SIZE_B(p) (ROUND_UP_TO_MULTIPLE_OF_8((1 + (p).filter_hashes) * sizeof(uint32_t)))
+#define DEDUP_INDEX_SIZE_B(p) (ROUND_UP_TO_MULTIPLE_OF_8((p).num_filters * sizeof(uint32_t)))
+#define DEDUP_MAX_CLASSES 32
+// kernel_bleach_sweep: samples correctly classified for each bleach in [0; SWEEP_BLEACH_VALUES)
+#define SWEEP_BLEACH_VALUES 64
+#define SWEEP_MAX_FILTERS 255 // Per-class histograms of the filter minima are counted on one byte
+// kernel_confusion: confusion matrix of the batch of a DPU, of shape (CONFUSION_MAX_CLASSES, CONFUSION_MAX_CLASSES) indexed by (label, prediction)
+#define CONFUSION_MAX_CLASSES 16
+// Kernels receiving the labels of the samples after their hashes
+#define KERNEL_CONSUMES_LABELS(k) ((k) == kernel_bleach_sweep || (k) == kernel_confusion)
+// Kernels receiving the reordered binarized inputs instead of their hashes
+#define KERNEL_CONSUMES_INPUTS(k) ((k) == kernel_pipeline)
+// Kernels receiving the raw 8-bit pixels of the samples, binarized and reordered on the DPUs
+#define KERNEL_CONSUMES_PIXELS(k) ((k) == kernel_thermometer)
+// kernel_thermometer: input i of the model (in the reordered order) is 1 iff its pixel is at most its threshold.
+// The threshold is -1 for an input that is never set, 255 for one that always is.
+typedef struct {
+    uint16_t pixel;
+    int16_t threshold;
+} dpu_thermometer_input_t;
+#define THERMOMETER_BLOCK_B 1024 // Inputs of the thermometer table read from MRAM at once
+// kernel_sparse: the words of a (discriminator, filter) hold the occupancy of SPARSE_WORD_ENTRIES entries (low half) and
+// the rank of their first nonzero counter (high half), see cbthowen/sparse_model.h
+#define SPARSE_WORD_ENTRIES 32
+// WRAM heap budget shared by all tasklets (the rest holds stacks and globals)
+#define WRAM_HEAP_BUDGET_B (48 << 10)
+
+// Profile of the allocated DPUs: the functional simulator when built with SIMULATOR=1, the hardware otherwise
+#if defined(SIMULATOR) && SIMULATOR
+#define DPU_ALLOC_PROFILE "backend=simulator"
+#else
+#define DPU_ALLOC_PROFILE NULL
+#endif
+
 #define ANSI_COLOR_RED     "\x1b[31m"
 #define ANSI_COLOR_GREEN   "\x1b[32m"
 #define ANSI_COLOR_RESET   "\x1b[0m"
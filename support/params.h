@@ -7,6 +7,22 @@ typedef struct Params {
     unsigned int   num_samples;
     int   n_warmup;
     int   n_reps;
+    char* cache_dir;
+    unsigned int stream_mem_mb;
+    char* output_path;
+    unsigned int counter_bytes;
+    unsigned int kernel;
+    unsigned int hash_tasklets;
+    char* model_paths[MAX_MODELS - 1];
+    unsigned int num_model_paths;
+    unsigned int model_id;
+    unsigned int slo_us;
+    char* socket_path;
+    unsigned int huge_pages;
+    unsigned int verify_samples;
+    unsigned int verify_max_mismatches;
+    unsigned int autotune_samples;
+    int numa_node;
 }Params;
 
 static void usage() {
@@ -19,18 +35,56 @@ static void usage() {
         "\n    -e <E>    # of timed repetition iterations (default=1)"
         "\n"
         "\nWorkload-specific options:"
-        "\n    -i <I>    number of MNIST samples to be processed per DPU transfer (default=1 elements)"
+        "\n    -i <I>    number of MNIST samples to be processed per DPU transfer (default=1 elements, the whole file in streaming mode)"
+        "\n    -c <C>    directory of the preprocessed dataset cache (default=disabled)"
+        "\n    -s <S>    stream the dataset in windows using at most S MB of host memory (default=0, disabled)"
+        "\n    -o <O>    file the predictions are written to in streaming mode (default=none)"
+        "\n    -b <B>    bytes per model counter on the DPUs, counters saturate (1, 2 or 4, default=4)"
+        "\n    -k <K>    DPU kernel: 0 full evaluation (its tasklets split the filters of each sample when a DPU gets too"
+        "\n              few samples to keep them busy), 2 early exit, 3 coalesced probes, 4 hashing/probing pipeline,"
+        "\n              6 deduplicated filter chunks,"
+        "\n              7 class masks of the bleached model, 8 bleach sweep over labeled samples,"
+        "\n              9 confusion matrix of labeled samples, 10 thermometer binarization, reordering and hashing"
+        "\n              of raw pixels on the DPUs, 11 sparse filters (occupancy bitmaps and nonzero counters) for"
+        "\n              models whose dense counters do not fit in MRAM, 12 full evaluation with the filters of each"
+        "\n              sample split among the tasklets (default=0)"
+        "\n    -t <T>    tasklets hashing inputs in the pipeline kernel, the others probe (default=NR_TASKLETS/4)"
+        "\n    -m <M>    additional model file resident in the DPU model table, repeatable (model 0 is MODEL_PATH)"
+        "\n    -M <M>    id of the model of the table the batches are evaluated with (default=0)"
+        "\n    -L <L>    serve requests from stdin with a p99 latency target of L us, -i is the largest micro-batch (default=0, disabled)"
+        "\n    -u <U>    in server mode, serve the connections of a Unix socket at path U instead of stdin/stdout"
+        "\n    -H <H>    back the host buffers with huge pages (0 or 1, default=0)"
+        "\n    -V <V>    with CHECK_RES, random samples of each batch checked against the host reference (default=0, all)"
+        "\n    -X <X>    with CHECK_RES, stop checking after X mismatches (default=16, 0 for no limit)"
+        "\n    -A <A>    pick the kernel of the batches from calibration launches of A samples per DPU (default=0, disabled)"
+        "\n    -N <N>    NUMA node of the host rows and preprocessing threads of every rank in batch mode"
+        "\n              (default=-1, the node of each rank; -2 disables the placement)"
         "\n");
 }
 
 struct Params input_params(int argc, char **argv) {
     struct Params p;
-    p.num_samples    = 1;
+    p.num_samples    = 0; // Set below if -i is not given
     p.n_warmup      = 0;
     p.n_reps        = 1;
+    p.cache_dir     = NULL;
+    p.stream_mem_mb = 0;
+    p.output_path   = NULL;
+    p.counter_bytes = 4;
+    p.kernel        = kernel1;
+    p.hash_tasklets = NR_TASKLETS / 4 > 0 ? NR_TASKLETS / 4 : 1;
+    p.num_model_paths = 0;
+    p.model_id      = 0;
+    p.slo_us        = 0;
+    p.socket_path   = NULL;
+    p.huge_pages    = 0;
+    p.verify_samples = 0;
+    p.verify_max_mismatches = 16;
+    p.autotune_samples = 0;
+    p.numa_node     = -1;
 
     int opt;
-    while((opt = getopt(argc, argv, "h:i:w:e:")) >= 0) {
+    while((opt = getopt(argc, argv, "h:i:w:e:c:s:o:b:k:t:m:M:L:u:H:V:X:A:N:")) >= 0) {
         switch(opt) {
         case 'h':
         usage();
@@ -39,13 +93,43 @@ struct Params input_params(int argc, char **argv) {
         case 'i': p.num_samples    = atoi(optarg); break;
         case 'w': p.n_warmup      = atoi(optarg); break;
         case 'e': p.n_reps        = atoi(optarg); break;
+        case 'c': p.cache_dir     = optarg; break;
+        case 's': p.stream_mem_mb = atoi(optarg); break;
+        case 'o': p.output_path   = optarg; break;
+        case 'b': p.counter_bytes = atoi(optarg); break;
+        case 'k': p.kernel        = atoi(optarg); break;
+        case 't': p.hash_tasklets = atoi(optarg); break;
+        case 'm':
+        assert(p.num_model_paths < MAX_MODELS - 1 && "Too many models!");
+        p.model_paths[p.num_model_paths++] = optarg;
+        break;
+        case 'M': p.model_id      = atoi(optarg); break;
+        case 'L': p.slo_us        = atoi(optarg); break;
+        case 'u': p.socket_path   = optarg; break;
+        case 'H': p.huge_pages    = atoi(optarg); break;
+        case 'V': p.verify_samples = atoi(optarg); break;
+        case 'X': p.verify_max_mismatches = atoi(optarg); break;
+        case 'A': p.autotune_samples = atoi(optarg); break;
+        case 'N': p.numa_node     = atoi(optarg); break;
         default:
             fprintf(stderr, "\nUnrecognized option!\n");
             usage();
             exit(0);
         }
     }
+    // Streaming mode reads the whole file unless -i caps it
+    if(p.num_samples == 0 && p.stream_mem_mb == 0)
+        p.num_samples = 1;
     assert(NR_DPUS > 0 && "Invalid # of dpus!");
+    assert(KERNEL_VALID(p.kernel) && "Invalid kernel!");
+    assert((p.kernel != kernel_pipeline || (p.hash_tasklets > 0 && p.hash_tasklets < NR_TASKLETS)) && "Invalid # of hashing tasklets!");
+    assert((p.kernel != kernel_dedup || (p.slo_us == 0 && p.stream_mem_mb == 0)) && "The dedup kernel needs the batch mode!");
+    assert((!KERNEL_CONSUMES_LABELS(p.kernel) || (p.slo_us == 0 && p.stream_mem_mb == 0)) && "Kernels on labeled samples need the batch mode!");
+    assert((!KERNEL_CONSUMES_PIXELS(p.kernel) || (p.slo_us == 0 && p.stream_mem_mb == 0)) && "Kernels on raw pixels need the batch mode!");
+    assert((p.kernel != kernel_sparse || (p.slo_us == 0 && p.stream_mem_mb == 0)) && "The sparse kernel needs the batch mode!");
+    assert((p.autotune_samples == 0 || (p.slo_us == 0 && p.stream_mem_mb == 0)) && "The auto-tuner needs the batch mode!");
+    assert((p.autotune_samples == 0 || !KERNEL_CONSUMES_PIXELS(p.kernel)) && "The auto-tuner picks among kernels on hashes!");
+    assert((p.counter_bytes == 1 || p.counter_bytes == 2 || p.counter_bytes == 4) && "Invalid counter width!");
 
     return p;
 }